@@ -0,0 +1,119 @@
+#include<iostream>
+#include<algorithm>
+#include<cmath>
+#include <random>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+using namespace std;
+using namespace std::chrono;
+#include "include/snarf_hash.cpp"
+
+// Per-probe latency of a large snarf instance with its arrays on regular pages, transparent huge pages,
+// explicit huge pages and NUMA local copies.
+// Usage: ./alloc_bench.out [number of keys] [number of probes]
+
+snarf_updatable_gcs_hash<uint64_t>* build_snarf(vector<uint64_t> &keys,snarf_arena *arena)
+{
+  snarf_arena_scope scope(arena);
+  snarf_updatable_gcs_hash<uint64_t> *snarf_instance=new snarf_updatable_gcs_hash<uint64_t>();
+  snarf_instance->snarf_init(keys,10,100,4);
+  return snarf_instance;
+}
+
+//returns the average time of a probe in ns, var hits counts the positive answers
+double time_probes(snarf_updatable_gcs_hash<uint64_t> &snarf_instance,vector<uint64_t> &probes,uint64_t range_size,uint64_t &hits)
+{
+  hits=0;
+  auto start = high_resolution_clock::now();
+  for(uint64_t i=0;i<probes.size();i++)
+  {
+    hits+=snarf_instance.range_query(probes[i],probes[i]+range_size);
+  }
+  auto stop = high_resolution_clock::now();
+  return duration_cast<nanoseconds>(stop - start).count()*1.00/probes.size();
+}
+
+void print_row(string name,snarf_updatable_gcs_hash<uint64_t> &snarf_instance,snarf_arena *arena,vector<uint64_t> &probes)
+{
+  uint64_t point_hits,range_hits;
+  //warm up, so every mode starts with the pages faulted in
+  time_probes(snarf_instance,probes,0,point_hits);
+  double point_ns=time_probes(snarf_instance,probes,0,point_hits);
+  double range_ns=time_probes(snarf_instance,probes,1000,range_hits);
+
+  uint64_t huge_mb=(arena==NULL)?0:arena->huge_page_bytes()>>20;
+  cout<<left<<setw(38)<<name<<right<<setw(14)<<huge_mb<<setw(16)<<fixed<<setprecision(1)<<point_ns<<setw(16)<<range_ns<<defaultfloat<<endl;
+  return ;
+}
+
+int main(int argc,char **argv)
+{
+  uint64_t N=(argc>1)?strtoull(argv[1],NULL,10):10'000'000;
+  uint64_t Q=(argc>2)?strtoull(argv[2],NULL,10):2'000'000;
+
+  mt19937_64 gen(7);
+  vector<uint64_t> keys(N);
+  for(uint64_t i=0;i<N;i++)
+  {
+    keys[i]=gen()>>14;
+  }
+  vector<uint64_t> probes(Q);
+  for(uint64_t i=0;i<Q;i++)
+  {
+    probes[i]=(i%2==0)?keys[gen()%N]:(gen()>>14);
+  }
+
+  cout<<"keys: "<<N<<" probes: "<<Q<<endl;
+  cout<<left<<setw(38)<<"memory"<<right<<setw(14)<<"huge MB"<<setw(16)<<"point ns/probe"<<setw(16)<<"range ns/probe"<<endl;
+
+  {
+    vector<uint64_t> temp_keys=keys;
+    snarf_updatable_gcs_hash<uint64_t> *snarf_instance=build_snarf(temp_keys,NULL);
+    print_row("heap",*snarf_instance,NULL,probes);
+    delete snarf_instance;
+  }
+
+  int page_types[2]={SNARF_PAGES_TRANSPARENT_HUGE,SNARF_PAGES_EXPLICIT_HUGE};
+  string page_names[2]={"transparent huge pages","explicit huge pages"};
+  for(int p=0;p<2;p++)
+  {
+    snarf_arena arena;
+    arena.init(page_types[p]);
+    vector<uint64_t> temp_keys=keys;
+    snarf_updatable_gcs_hash<uint64_t> *snarf_instance=build_snarf(temp_keys,&arena);
+    string name=page_names[p];
+    if(arena.explicit_huge_failed)
+    {
+      name+=" (none reserved)";
+    }
+    print_row(name,*snarf_instance,&arena,probes);
+    delete snarf_instance;
+  }
+
+  //one copy per node, probed from a thread on each node
+  {
+    vector<uint64_t> temp_keys=keys;
+    snarf_updatable_gcs_hash<uint64_t> *snarf_instance=build_snarf(temp_keys,NULL);
+    snarf_numa_replicas<snarf_updatable_gcs_hash<uint64_t>> replicas;
+    replicas.init(*snarf_instance,SNARF_PAGES_TRANSPARENT_HUGE);
+    delete snarf_instance;
+
+    for(int i=0;i<replicas.topology.nodes.size();i++)
+    {
+      replicas.topology.run_on_node(i,[&](){
+        print_row("numa local copy, node "+to_string(replicas.topology.nodes[i]),replicas.local(),replicas.arenas[i].get(),probes);
+      });
+      //remote copy, when there is another node
+      if(replicas.topology.nodes.size()>1)
+      {
+        int other=(i+1)%replicas.topology.nodes.size();
+        replicas.topology.run_on_node(i,[&](){
+          print_row("numa remote copy, node "+to_string(replicas.topology.nodes[other]),*replicas.replicas[other],replicas.arenas[other].get(),probes);
+        });
+      }
+    }
+  }
+
+  return 0;
+}
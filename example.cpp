@@ -13,95 +13,109 @@ using namespace std;
 using namespace std::chrono;
 
 #include "include/snarf_hash.cpp"
+#include "include/snarf_workload.cpp"
 
-// To get normal distribution
-vector<uint64_t> get_normal_distribution(uint64_t N, double mean, double stddev, uint64_t range_min, uint64_t range_max) {
+// Seeds of the generators, so every run tests the same keys and queries
+const uint64_t KEY_SEED = 1;
+const uint64_t QUERY_SEED = 2;
 
-    std::vector<uint64_t> results;
-    results.reserve(N); 
+// Queries of one range width with their precomputed answers
+struct test_query_set {
+  vector<uint64_t> lower;
+  vector<uint64_t> upper;
+  vector<char> truth;
+};
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::normal_distribution<> dist(mean, stddev);
+vector<uint64_t> generate_test_keys(string distribution, uint64_t N, uint64_t seed) {
+  if (distribution == "uniform") { // uniform distribution
+    return get_uniform_distribution(N, 0, static_cast<uint64_t>(pow(2, 50))-1, seed);
 
-    for (size_t i = 0; i < N; ++i) {
-        double number;
-        do {
-            number = dist(gen);
-            number = (number - mean) / (4 * stddev) * (range_max - range_min) + (range_min + range_max) / 2.0;
-        } while (number < range_min || number > range_max); // Repeat if the number is outside the range
+  } else if (distribution == "normal") { // normal distribution
+    return get_normal_distribution(N, 0, static_cast<uint64_t>(pow(2, 50))-1, seed);
 
-        results.push_back(static_cast<uint64_t>(number));
-    }
-    return results;
+  } else if (distribution == "exponential") { // exponential distribution
+    return get_exponential_distribution(N, 10.0, 0, static_cast<uint64_t>(pow(2, 50))-1, seed);
+  }
+  return vector<uint64_t>();
 }
 
-
-// To get uniform distribution
-vector<uint64_t> get_uniform_distribution(uint64_t N, uint64_t range_min, uint64_t range_max) {
-    vector<uint64_t> v_keys(N, 0);
-    random_device rd;
-    mt19937_64 gen(rd()); 
-    uniform_int_distribution<uint64_t> dist(range_min, range_max);
-
-    for (uint64_t i = 0; i < N; ++i) {
-        v_keys[i] = dist(gen);
+// Builds the query sets of the test, one per range width, and answers them with the oracle.
+// With close_k the queries start test_num after each key (or end test_num before it when special), otherwise at test_queries
+void build_query_sets(vector<uint64_t>& sorted_v_keys, vector<uint64_t>& test_queries, vector<uint64_t>& rq_ranges,
+                        bool close_k, bool special, uint64_t test_num, vector<test_query_set>& query_sets) {
+  query_sets.resize(rq_ranges.size());
+  for (int i = 0; i < rq_ranges.size(); i++) {
+    test_query_set& q = query_sets[i];
+    vector<uint64_t>& starts = close_k ? sorted_v_keys : test_queries;
+    q.lower.resize(starts.size());
+    q.upper.resize(starts.size());
+    for (uint64_t j = 0; j < starts.size(); j++) {
+      if (!close_k || !special) {
+        q.lower[j] = starts[j] + (close_k ? test_num : 0);
+        q.upper[j] = q.lower[j] + rq_ranges[i];
+      } else {
+        q.upper[j] = starts[j] - test_num;
+        q.lower[j] = q.upper[j] - rq_ranges[i];
+      }
     }
-
-    return v_keys;
+    compute_ground_truth(sorted_v_keys, q.lower, q.upper, q.truth);
+  }
 }
 
-// To get exponential distribution
-vector<uint64_t> get_exponential_distribution(uint64_t N, double lambda, uint64_t range_min, uint64_t range_max) {
-    vector<uint64_t> v_keys(N, 0);
-    random_device rd;
-    mt19937 gen(rd()); 
-    exponential_distribution<> dist(lambda);
+// Probes snarf with a query set and counts false positives and true negatives against the precomputed answers.
+// Only the probes are timed, the time in nanoseconds is returned
+uint64_t probe_query_set(snarf_updatable_gcs_hash<uint64_t>& snarf_instance, test_query_set& q, bool sorted_cursor, uint64_t& fp, uint64_t& tn) {
+  vector<char> answers(q.lower.size());
 
-    double max_exp_value = log(range_max) / lambda;
-    
-    for (uint64_t i = 0; i < N; ++i) {
-        double exp_value = dist(gen);
-        
-        
-        exp_value = min(max_exp_value, exp_value); 
-        double scale = exp_value / max_exp_value;
-        v_keys[i] = range_min + static_cast<uint64_t>((range_max - range_min) * scale);
+  auto start = std::chrono::high_resolution_clock::now();
+  if (sorted_cursor) {
+    // queries walk sorted_v_keys in order, so a cursor can stream through the filter
+    snarf_sorted_cursor<uint64_t> cursor;
+    cursor.init(&snarf_instance);
+    for (uint64_t j = 0; j < q.lower.size(); j++) {
+      answers[j] = cursor.range_query(q.lower[j], q.upper[j]);
     }
-    return v_keys;
-}
-
-// Function to find if a query performs a false positive or not; it checks if a value exists within a certain range in source_vec
-bool find_key_in(const vector<uint64_t>& source_vec, uint64_t left_end, uint64_t right_end) {
-    auto lower = lower_bound(source_vec.begin(), source_vec.end(), left_end);
-
-    if (lower != source_vec.end() && *lower <= right_end) {
-        return true; // Found a value within the range
+  } else {
+    for (uint64_t j = 0; j < q.lower.size(); j++) {
+      answers[j] = snarf_instance.range_query(q.lower[j], q.upper[j]);
     }
+  }
+  auto stop = std::chrono::high_resolution_clock::now();
 
-    return false; // No values found within the range
+  fp = 0;
+  tn = 0;
+  for (uint64_t j = 0; j < q.lower.size(); j++) {
+    if (!q.truth[j]) {
+      fp += answers[j];
+      tn += !answers[j];
+    }
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
 }
 
+// Average FPR over the query sets, the probe time of all sets is added to probe_ns
+double probe_all_sets(snarf_updatable_gcs_hash<uint64_t>& snarf_instance, vector<test_query_set>& query_sets, bool sorted_cursor, uint64_t& probe_ns) {
+  double all_rate = 0;
+  for (int i = 0; i < query_sets.size(); i++) {
+    uint64_t fp, tn;
+    probe_ns += probe_query_set(snarf_instance, query_sets[i], sorted_cursor, fp, tn);
+    all_rate += static_cast<double>(fp) / (fp + tn);
+  }
+  return all_rate / query_sets.size();
+}
 
 
 // Function to test snarf
 void test_snarf(double bits_per_key, uint64_t batch_size, string key_distribution, string query_distribution, 
-                  uint64_t test_num, uint64_t N, bool special, string query_option, uint64_t num_hash_bits) {
+                  uint64_t test_num, uint64_t N, bool special, string query_option, uint64_t num_hash_bits, int block_codec, bool auto_split) {
 
   //----------------------------------------
   //GENERATING DATA
   //----------------------------------------
 
-  vector<uint64_t> v_keys;
-
-  if (key_distribution == "uniform") { // uniform distribution
-    v_keys = get_uniform_distribution(N, 0, static_cast<uint64_t>(pow(2, 50))-1);
-
-  } else if (key_distribution == "normal") { // normal distribution
-    v_keys = get_normal_distribution(N, 100.0, 20.0, 0, static_cast<uint64_t>(pow(2, 50))-1);
-  }
+  vector<uint64_t> v_keys = generate_test_keys(key_distribution, N, KEY_SEED);
 
-  // Sort v_keys for faster verification of false positiviry
+  // Sort v_keys for the ground truth of the queries
   vector<uint64_t> sorted_v_keys = v_keys;
   sort(sorted_v_keys.begin(), sorted_v_keys.end());
 
@@ -113,11 +127,25 @@ void test_snarf(double bits_per_key, uint64_t batch_size, string key_distributio
   //declare and initialize a snarf instance
   snarf_updatable_gcs_hash<uint64_t> snarf_instance;
   // snarf_updatable_gcs_hash<uint64_t> snarf_instance;
-  snarf_instance.snarf_init(v_keys,bits_per_key,batch_size, num_hash_bits);
+  snarf_instance.set_block_codec(block_codec);
+  vector<uint64_t> rq_ranges({0, 16, 64, 256});
+  if(auto_split) {
+    // split bits_per_key + num_hash_bits between the bit blocks and the hash filter for an even mix of the tested ranges
+    vector<snarf_query_class> query_mix;
+    for(int i = 0; i < rq_ranges.size(); i++) {
+      query_mix.push_back({1.0 / rq_ranges.size(), (double)rq_ranges[i]});
+    }
+    snarf_budget_plan plan = snarf_instance.snarf_init_budget(v_keys, bits_per_key + num_hash_bits, batch_size, query_mix);
+    cout << "Budget split: " << plan.golomb_bits_per_key << " bits per key for the bit blocks (" << plan.bit_size << " bit locations), "
+         << plan.hash_bits_per_key << " for hashing with " << plan.num_hash_functions << " hash functions, predicted FPR " << plan.predicted_fpr << endl;
+  } else {
+    snarf_instance.snarf_init(v_keys,bits_per_key,batch_size, num_hash_bits);
+  }
     
   //get the size of the snarf instance
-  int snarf_sz=snarf_instance.return_size();
+  uint64_t snarf_sz=snarf_instance.return_size();
   cout<<"Bits per key used by SNARF: "<<snarf_sz*8.00/v_keys.size()<<endl;
+  snarf_instance.memory_report().print(cout, v_keys.size());
   
   //----------------------------------------
   //BUILDING WORKLOAD
@@ -125,101 +153,73 @@ void test_snarf(double bits_per_key, uint64_t batch_size, string key_distributio
 
   vector<uint64_t> test_queries;
   if(!special){
-    if (query_distribution == "uniform") { // uniform distribution
-      test_queries = get_uniform_distribution(N, 0, static_cast<uint64_t>(pow(2, 50))-1);
-
-    } else if (query_distribution == "normal") { // normal distribution
-      test_queries = get_normal_distribution(N, 100.0, 20.0, 0, static_cast<uint64_t>(pow(2, 50))-1);
-
-    } else if (query_distribution == "exponential") { // exponential distribution
-      test_queries = get_exponential_distribution(N, 10.0, 0, static_cast<uint64_t>(pow(2, 50))-1);
-    }
+    test_queries = generate_test_keys(query_distribution, N, QUERY_SEED);
   }
 
   //----------------------------------------
   //QUERYING SNARF
   //----------------------------------------
 
-  vector<uint64_t> rq_ranges({0, 16, 64, 256});
-  uint64_t fp;
-  uint64_t tn;
-  uint64_t tp;
-  double all_rate = 0;
+  vector<test_query_set> query_sets;
   
   if(!special && (query_option == "all")) {
-    auto start = std::chrono::high_resolution_clock::now();
-    for(int i = 0; i < rq_ranges.size(); i++) {
-      fp = 0;
-      tn = 0;
-      tp = 0;
-      for (int j = 0; j < test_queries.size(); j++) {
-        uint64_t lower_bound = test_queries[j];
-        uint64_t upper_bound = lower_bound + rq_ranges[i];
-        if(snarf_instance.range_query(lower_bound, upper_bound)) {
-          if(find_key_in(sorted_v_keys, lower_bound, upper_bound)) {
-            tp++;
-          } else {
-            fp++;
-          }
-        } else {
-          tn++;
-        }
-      }    
-      double rate = static_cast<double>(fp) / (fp + tn);
-      all_rate += rate;
-    }
-    auto stop = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-    all_rate = all_rate / rq_ranges.size();
+    build_query_sets(sorted_v_keys, test_queries, rq_ranges, false, special, test_num, query_sets);
+    uint64_t probe_ns = 0;
+    double all_rate = probe_all_sets(snarf_instance, query_sets, false, probe_ns);
     cout << "    The false positive rate overall for mixed range query " << key_distribution << " keys and " << query_distribution << " is " << all_rate <<
-          " and it took " << duration.count() << " milliseconds" << endl;
+          " and the probes took " << probe_ns / 1000000 << " milliseconds (" << probe_ns * 1.0 / (rq_ranges.size() * test_queries.size()) << " ns per query)" << endl;
   }
 
   //----------------------------------------
   //SNARF WITH kEY K WE QUERY FROM K+(TEST_NUM)
   //----------------------------------------
-  uint64_t TEST_NUM = test_num;
-  all_rate = 0;
-  auto start = std::chrono::high_resolution_clock::now();
-  for(int i = 0; i < rq_ranges.size(); i++) {
-    fp = 0;
-    tn = 0;
-    tp = 0;
-    for(int j = 0; j < sorted_v_keys.size(); j++) {
-
-      uint64_t lower_bound;
-      uint64_t upper_bound;
-      if(!special) {
-        lower_bound = sorted_v_keys[j] + TEST_NUM;
-        upper_bound = lower_bound + rq_ranges[i];
-      } else {
-        upper_bound = sorted_v_keys[j] - TEST_NUM;
-        lower_bound = upper_bound - rq_ranges[i];
-      }
-      if(snarf_instance.range_query(lower_bound, upper_bound)) {
+  build_query_sets(sorted_v_keys, test_queries, rq_ranges, true, special, test_num, query_sets);
+  uint64_t probe_ns = 0;
+  double all_rate = probe_all_sets(snarf_instance, query_sets, true, probe_ns);
+  cout << "    The false positive rate for close-K " << test_num << " queries is " << all_rate <<  " and the probes took " << probe_ns / 1000000 << " milliseconds (" 
+       << probe_ns * 1.0 / (rq_ranges.size() * sorted_v_keys.size()) << " ns per query)" << endl;
 
-        if(find_key_in(sorted_v_keys, lower_bound, upper_bound)) {
-          tp++;
-        } else {
-          fp++;
-        }
 
-      } else {
-          if(find_key_in(sorted_v_keys, lower_bound, upper_bound)) {
-        } 
-        tn++;
-      }
-    }
-    double rate = static_cast<double>(fp) / (fp + tn);
-    all_rate += rate;
-  }
-  auto stop = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-  all_rate = all_rate / rq_ranges.size();
-  cout << "    The false positive rate for close-K " << test_num << " queries is " << all_rate <<  " and it took " << duration.count() << " milliseconds" << endl;
 
+}
+
+// FPR and probe time for every bits per key of the list. The keys, queries and their answers are built once
+void sweep_snarf(vector<uint64_t>& bits_per_keys, uint64_t batch_size, string key_distribution, string query_distribution,
+                  uint64_t N, uint64_t num_hash_bits, int block_codec) {
+  vector<uint64_t> v_keys = generate_test_keys(key_distribution, N, KEY_SEED);
+  vector<uint64_t> sorted_v_keys = v_keys;
+  sort(sorted_v_keys.begin(), sorted_v_keys.end());
+  vector<uint64_t> test_queries = generate_test_keys(query_distribution, N, QUERY_SEED);
 
+  vector<uint64_t> rq_ranges({0, 16, 64, 256});
+  vector<test_query_set> query_sets;
+  auto start = std::chrono::high_resolution_clock::now();
+  build_query_sets(sorted_v_keys, test_queries, rq_ranges, false, false, 0, query_sets);
+  auto stop = std::chrono::high_resolution_clock::now();
+  cout << "Ground truth for " << rq_ranges.size() * test_queries.size() << " queries took " 
+       << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << " milliseconds" << endl;
 
+  cout << "bits per key, bits per key used, FPR for ranges";
+  for (int i = 0; i < rq_ranges.size(); i++) {
+    cout << " " << rq_ranges[i];
+  }
+  cout << ", ns per query" << endl;
+
+  for (int b = 0; b < bits_per_keys.size(); b++) {
+    snarf_updatable_gcs_hash<uint64_t> snarf_instance;
+    snarf_instance.set_block_codec(block_codec);
+    vector<uint64_t> temp_keys = v_keys;
+    snarf_instance.snarf_init(temp_keys, bits_per_keys[b], batch_size, num_hash_bits);
+
+    cout << bits_per_keys[b] << ", " << snarf_instance.return_size() * 8.00 / v_keys.size() << ",";
+    uint64_t probe_ns = 0;
+    for (int i = 0; i < query_sets.size(); i++) {
+      uint64_t fp, tn;
+      probe_ns += probe_query_set(snarf_instance, query_sets[i], false, fp, tn);
+      cout << " " << static_cast<double>(fp) / (fp + tn);
+    }
+    cout << ", " << probe_ns * 1.0 / (rq_ranges.size() * test_queries.size()) << endl;
+  }
 }
 
 
@@ -278,9 +278,12 @@ int main() {
   vector<string> key_dists({"normal", "uniform"});
   vector<string> query_dists({"normal", "uniform", "exponential"});
   vector<string> query_options({"all", "close-K"});
+  vector<string> block_codecs({"golomb", "rice-lut", "elias-fano"}); // same order as snarf_codec_type
   vector<string> interface_options({"Start test", "Choose key distribution", "Choose query distribution", "Choose bits per key", 
                                       "Choose K, K+n", "Choose number of tests", "Change query options", "Special Case: K-n, K-1", 
-                                        "Change bits per keys allocated to hashing (*)", "Exit test"});
+                                        "Change bits per keys allocated to hashing (*)", "Choose block codec", 
+                                          "Split bits between blocks and hashing automatically (on/off)", 
+                                            "Sweep FPR over all bits per key", "Exit test"});
   uint64_t num_hash_bits = 6;
 
   string key_dist = "normal";
@@ -289,6 +292,8 @@ int main() {
   uint64_t bits_per_key = 8;
   uint64_t test_num = 1;  
   uint64_t N=10'000'000;  
+  int block_codec = SNARF_DEFAULT_BLOCK_CODEC;
+  bool auto_split = false;
 
  
   cout << "Welcome to SNARF test!" << endl;
@@ -303,13 +308,15 @@ int main() {
       << "  Testing for K, K+" << test_num << endl
       << "  Query option testing for " << query_option << endl
       << "  Hashing memory allocated: " << num_hash_bits << " bits" << endl
+      << "  Block codec: " << block_codecs[block_codec] << endl
+      << "  Automatic split of bits per key + hashing bits: " << (auto_split ? "on" : "off") << endl
       << "----------------------------------------------" << endl << endl;
 
     switch(display_select_vec(interface_options)) {
       case 1: // Start test
         cout << endl;
         // string s = snarf_options[display_select_vec(snarf_options)];
-        test_snarf(bits_per_key, 100.0,  key_dist,query_dist, test_num, N, false, query_option, num_hash_bits);
+        test_snarf(bits_per_key, 100.0,  key_dist,query_dist, test_num, N, false, query_option, num_hash_bits, block_codec, auto_split);
         break;
 
       case 2: // Choose key distribution
@@ -338,14 +345,27 @@ int main() {
 
       case 8: // K-n, K-1 case
         // string s = snarf_options[display_select_vec(snarf_options)];
-        test_snarf(bits_per_key, 100.0,  key_dist,query_dist, test_num, N, true, "all", num_hash_bits);
+        test_snarf(bits_per_key, 100.0,  key_dist,query_dist, test_num, N, true, "all", num_hash_bits, block_codec, auto_split);
         break;
 
       case 9: // change bits per hashing
         num_hash_bits = until_number_input(0,32);
         break;
 
-      case 10: // Exit
+      case 10: // Choose block codec
+        block_codec = display_select_vec(block_codecs)-1;
+        break;
+
+      case 11: // Automatic budget split
+        auto_split = !auto_split;
+        break;
+
+      case 12: // FPR sweep over bits_per_keys
+        cout << endl;
+        sweep_snarf(bits_per_keys, 100.0, key_dist, query_dist, N, num_hash_bits, block_codec);
+        break;
+
+      case 13: // Exit
         cout << "Goodbye!" << endl;
         return 0;
 
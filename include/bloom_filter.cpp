@@ -1,42 +1,89 @@
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <cstring>
+
+#include "snarf_memory.cpp"
+#include "snarf_alloc.cpp"
 
 class BloomFilter {
 private:
-    std::vector<bool> bits;
+    // bit i is bit i%64 of words[i/64]
+    std::vector<uint64_t, snarf_allocator<uint64_t>> words;
+    uint64_t numBits = 0;
     int numHashes;
 
+    bool getBit(uint64_t i) {
+        return (words[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void setBit(uint64_t i) {
+        words[i >> 6] |= 1ULL << (i & 63);
+    }
+
+    // sizes the words for size bits, all cleared. The words are reallocated in the arena of the calling thread
+    void resizeBits(uint64_t size) {
+        numBits = size;
+        words = std::vector<uint64_t, snarf_allocator<uint64_t>>((size + 63) / 64, 0);
+    }
+
 public:
     BloomFilter()  {}
 
     void BloomFilter_init(size_t size, int numHashes) {
-        bits.resize(size); 
+        resizeBits(size);
         this->numHashes = numHashes;
     }
 
+    // 64 bit finalizer (splitmix64), every bit of the item affects the positions
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // the n-th position of an item. The range is reduced with a multiply instead of a modulo, which is a long
+    // division that made up most of the cost of a probe
     std::size_t hash(int n, size_t x) {
-        std::hash<int> hasher;
-        return (hasher(x) + n * hasher(x + 1)) % bits.size();
+        uint64_t h = mix(x) + n * mix(x + 1);
+        return (uint64_t)(((unsigned __int128)h * numBits) >> 64);
     }
 
     void add(size_t item) {
         for (int n = 0; n < numHashes; ++n) {
-            bits[hash(n, item)] = true;
+            setBit(hash(n, item));
         }
     }
 
     bool possiblyContains(size_t item) {
         for (int n = 0; n < numHashes; ++n) {
-            if (!bits[hash(n, item)]) {
+            if (!getBit(hash(n, item))) {
                 return false;
             }
         }
         return true;
     }
 
-    int return_size() {
-        size_t bits_size = bits.size();  // This is the number of bits
+    // issues prefetches for the words holding the bits of an item, see snarf_batch.cpp
+    void prefetch(size_t item) {
+        for (int n = 0; n < numHashes; ++n) {
+            __builtin_prefetch(&words[hash(n, item) >> 6]);
+        }
+    }
+
+    // sets the bits of another filter with the same size and number of hashes, returns false if they differ
+    bool merge(BloomFilter &other) {
+        if (other.numBits != numBits || other.numHashes != numHashes) {
+            return false;
+        }
+        for (size_t i = 0; i < words.size(); ++i) {
+            words[i] |= other.words[i];
+        }
+        return true;
+    }
+
+    uint64_t return_size() {
+        size_t bits_size = numBits;  // This is the number of bits
 
         size_t total_size_bytes = (bits_size / 8) + sizeof(numHashes);
 
@@ -46,4 +93,40 @@ public:
         }
         return total_size_bytes;
     }
+
+    // heap bytes held by the words, including unused capacity
+    uint64_t allocated_size() {
+        return snarf_vector_heap_bytes(words);
+    }
+
+    void shrink_to_fit() {
+        words.shrink_to_fit();
+    }
+
+    // number of bytes written by serialize
+    uint64_t serialized_size() {
+        return sizeof(uint64_t) + sizeof(numHashes) + (numBits + 7) / 8;
+    }
+
+    // writes the number of bits, the number of hashes and the bits 8 to a byte, lowest bit first
+    void serialize(unsigned char* arr) {
+        memcpy(arr, &numBits, sizeof(numBits));
+        memcpy(arr + sizeof(numBits), &numHashes, sizeof(numHashes));
+        unsigned char* out = arr + sizeof(numBits) + sizeof(numHashes);
+        for (uint64_t i = 0; i < (numBits + 7) / 8; ++i) {
+            out[i] = (unsigned char)(words[i / 8] >> (8 * (i % 8)));
+        }
+    }
+
+    // reads a filter written by serialize
+    void deserialize(unsigned char* arr) {
+        uint64_t size;
+        memcpy(&size, arr, sizeof(size));
+        memcpy(&numHashes, arr + sizeof(size), sizeof(numHashes));
+        unsigned char* in = arr + sizeof(size) + sizeof(numHashes);
+        resizeBits(size);
+        for (uint64_t i = 0; i < (numBits + 7) / 8; ++i) {
+            words[i / 8] |= (uint64_t)in[i] << (8 * (i % 8));
+        }
+    }
 };
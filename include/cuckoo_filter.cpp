@@ -0,0 +1,320 @@
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+#include "snarf_memory.cpp"
+#include "snarf_alloc.cpp"
+
+// Cuckoo filter with buckets of 4 fingerprints, used as a verification layer that supports deletes.
+// Fingerprints are packed, so a bucket of 4 fingerprints of up to 16 bits is read with one or two word reads,
+// and a key lives in one of two buckets.
+// The second bucket is (h(fingerprint) - first bucket) mod num_buckets, which works for any number of buckets.
+// Tables are filled to target_load, below the ~95% limit of 4 slot buckets, so inserts rarely need long relocation chains.
+// Keys that do not fit after max_kicks relocations go to a stash of at most max_stash fingerprints, so there are no
+// false negatives. Buckets hold fingerprints only and cannot be rehashed into a larger table, so once the stash is full
+// later keys go to an overflow table of twice the capacity of the previous one. A probe reads two buckets per table
+// and a few stash entries, and the number of tables grows with the log of the inserts past the build.
+class CuckooFilter {
+private:
+    static const int slots_per_bucket = 4;
+    static const int max_kicks = 500;
+    static const int max_stash = 8;
+    static constexpr double target_load = 0.9;
+
+    // packed fingerprints, slot i of bucket b starts at bit (b*slots_per_bucket+i)*fingerprintBits
+    std::vector<uint64_t, snarf_allocator<uint64_t>> words;
+    uint64_t numBuckets = 0;
+    int fingerprintBits = 0;
+    uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+    // (bucket, fingerprint) pairs that could not be placed
+    std::vector<std::pair<uint64_t, uint16_t>> stash;
+
+    // tables that take the keys added once the stash is full, each with twice the capacity of the previous one
+    std::vector<CuckooFilter> overflow;
+
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // fingerprint of an item, never 0 since 0 marks an empty slot
+    uint16_t fingerprint(uint64_t item) {
+        uint16_t fp = mix(item + 0x9e3779b97f4a7c15ULL) >> (64 - fingerprintBits);
+        return fp == 0 ? 1 : fp;
+    }
+
+    uint64_t firstBucket(uint64_t item) {
+        return mix(item) % numBuckets;
+    }
+
+    uint64_t altBucket(uint64_t bucket, uint16_t fp) {
+        uint64_t h = mix(fp) % numBuckets;
+        return (h + numBuckets - bucket) % numBuckets;
+    }
+
+    // reads numBits (at most 64) bits at a bit offset
+    uint64_t readBits(uint64_t offset, int numBits) {
+        uint64_t index = offset >> 6, shift = offset & 63;
+        uint64_t ans = words[index] >> shift;
+        if (shift + numBits > 64) {
+            ans |= words[index + 1] << (64 - shift);
+        }
+        return numBits == 64 ? ans : ans & ((1ULL << numBits) - 1);
+    }
+
+    void writeBits(uint64_t offset, int numBits, uint64_t val) {
+        for (int i = 0; i < numBits; ++i) {
+            uint64_t bit = offset + i;
+            words[bit >> 6] = (words[bit >> 6] & ~(1ULL << (bit & 63))) | (((val >> i) & 1ULL) << (bit & 63));
+        }
+    }
+
+    uint16_t getSlot(uint64_t bucket, int i) {
+        return readBits((bucket * slots_per_bucket + i) * fingerprintBits, fingerprintBits);
+    }
+
+    void setSlot(uint64_t bucket, int i, uint16_t fp) {
+        writeBits((bucket * slots_per_bucket + i) * fingerprintBits, fingerprintBits, fp);
+    }
+
+    // returns the slot of a fingerprint in a bucket, -1 if it is not there. The bucket is read at once
+    int findInBucket(uint64_t bucket, uint16_t fp) {
+        uint64_t all = readBits(bucket * slots_per_bucket * fingerprintBits, slots_per_bucket * fingerprintBits);
+        uint64_t mask = (1ULL << fingerprintBits) - 1;
+        for (int i = 0; i < slots_per_bucket; ++i) {
+            if (((all >> (i * fingerprintBits)) & mask) == fp) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool bucketContains(uint64_t bucket, uint16_t fp) {
+        return findInBucket(bucket, fp) >= 0;
+    }
+
+    bool bucketInsert(uint64_t bucket, uint16_t fp) {
+        int i = findInBucket(bucket, 0);
+        if (i < 0) {
+            return false;
+        }
+        setSlot(bucket, i, fp);
+        return true;
+    }
+
+    bool bucketRemove(uint64_t bucket, uint16_t fp) {
+        int i = findInBucket(bucket, fp);
+        if (i < 0) {
+            return false;
+        }
+        setSlot(bucket, i, 0);
+        return true;
+    }
+
+    // number of keys the table is sized for
+    uint64_t capacity() {
+        return numBuckets * slots_per_bucket * target_load;
+    }
+
+    bool stashContains(uint64_t bucket, uint16_t fp) {
+        for (size_t i = 0; i < stash.size(); ++i) {
+            if (stash[i].second == fp && (stash[i].first == bucket || stash[i].first == altBucket(bucket, fp))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // probes this table only
+    bool tableContains(size_t item) {
+        uint16_t fp = fingerprint(item);
+        uint64_t bucket = firstBucket(item);
+        return bucketContains(bucket, fp) || bucketContains(altBucket(bucket, fp), fp) || stashContains(bucket, fp);
+    }
+
+    // removes from this table only
+    bool tableRemove(size_t item) {
+        uint16_t fp = fingerprint(item);
+        uint64_t bucket = firstBucket(item);
+        if (bucketRemove(bucket, fp) || bucketRemove(altBucket(bucket, fp), fp)) {
+            return true;
+        }
+        for (size_t i = 0; i < stash.size(); ++i) {
+            if (stash[i].second == fp && (stash[i].first == bucket || stash[i].first == altBucket(bucket, fp))) {
+                stash.erase(stash.begin() + i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // places a fingerprint in a bucket or its alternate, relocating other fingerprints when both are full
+    void insertFingerprint(uint64_t bucket, uint16_t fp) {
+        if (bucketInsert(bucket, fp) || bucketInsert(altBucket(bucket, fp), fp)) {
+            return;
+        }
+
+        uint64_t curr = bucket;
+        for (int kick = 0; kick < max_kicks; ++kick) {
+            rng_state = mix(rng_state);
+            int victim = rng_state % slots_per_bucket;
+            uint16_t evicted = getSlot(curr, victim);
+            setSlot(curr, victim, fp);
+            fp = evicted;
+            curr = altBucket(curr, fp);
+            if (bucketInsert(curr, fp)) {
+                return;
+            }
+        }
+        stash.push_back(std::make_pair(curr, fp));
+    }
+
+public:
+    CuckooFilter() {}
+
+    // sized for numKeys keys at target_load, with fingerprintBits bits per fingerprint (1 to 16)
+    void CuckooFilter_init(size_t numKeys, int fingerprintBits) {
+        this->fingerprintBits = std::max(1, std::min(16, fingerprintBits));
+        numBuckets = std::max((uint64_t)1, (uint64_t)ceil(numKeys / (slots_per_bucket * target_load)));
+        //reallocated in the arena of the calling thread
+        words = std::vector<uint64_t, snarf_allocator<uint64_t>>((numBuckets * slots_per_bucket * this->fingerprintBits + 63) / 64 + 1, 0);
+        stash.clear();
+        overflow.clear();
+    }
+
+    // a key goes to the newest table whose stash has room, a full stash starts a new table
+    void add(size_t item) {
+        CuckooFilter *table = (overflow.size() > 0) ? &overflow.back() : this;
+        if (table->stash.size() >= max_stash) {
+            CuckooFilter next;
+            next.CuckooFilter_init(2 * table->capacity(), fingerprintBits);
+            overflow.push_back(next);
+            table = &overflow.back();
+        }
+        table->insertFingerprint(table->firstBucket(item), table->fingerprint(item));
+    }
+
+    bool possiblyContains(size_t item) {
+        if (tableContains(item)) {
+            return true;
+        }
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            if (overflow[i].tableContains(item)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // issues prefetches for the two buckets of an item, see snarf_batch.cpp
+    void prefetch(size_t item) {
+        uint64_t bucket = firstBucket(item);
+        __builtin_prefetch(&words[bucket * slots_per_bucket * fingerprintBits / 64]);
+        __builtin_prefetch(&words[altBucket(bucket, fingerprint(item)) * slots_per_bucket * fingerprintBits / 64]);
+    }
+
+    // removes one copy of the fingerprint of an item that was added, returns false if it was not found
+    bool remove(size_t item) {
+        if (tableRemove(item)) {
+            return true;
+        }
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            if (overflow[i].tableRemove(item)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // false positive rate at full load, a probe compares against up to 8 fingerprints per table
+    double expectedFpr() {
+        return std::min(1.0, (1 + overflow.size()) * 2.0 * slots_per_bucket / pow(2.0, fingerprintBits));
+    }
+
+    uint64_t return_size() {
+        uint64_t total_bits = numBuckets * slots_per_bucket * fingerprintBits;
+        uint64_t total = (total_bits + 7) / 8 + stash.size() * (sizeof(uint64_t) + sizeof(uint16_t)) + sizeof(numBuckets) + sizeof(fingerprintBits);
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            total += overflow[i].return_size();
+        }
+        return total;
+    }
+
+    // heap bytes held by the slots, the stash and the overflow tables, including unused capacity
+    uint64_t allocated_size() {
+        uint64_t total = snarf_vector_heap_bytes(words) + snarf_vector_heap_bytes(stash) + snarf_vector_heap_bytes(overflow);
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            total += overflow[i].allocated_size();
+        }
+        return total;
+    }
+
+    void shrink_to_fit() {
+        words.shrink_to_fit();
+        stash.shrink_to_fit();
+        overflow.shrink_to_fit();
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            overflow[i].shrink_to_fit();
+        }
+    }
+
+    // number of bytes written by serialize
+    uint64_t serialized_size() {
+        uint64_t total = 5 * sizeof(uint64_t) + sizeof(fingerprintBits) + words.size() * sizeof(uint64_t)
+            + stash.size() * (sizeof(uint64_t) + sizeof(uint16_t));
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            total += overflow[i].serialized_size();
+        }
+        return total;
+    }
+
+    // writes the parameters, the slots, the stash and the overflow tables
+    void serialize(unsigned char* arr) {
+        uint64_t header[5] = {numBuckets, rng_state, words.size(), stash.size(), overflow.size()};
+        memcpy(arr, header, sizeof(header));
+        arr += sizeof(header);
+        memcpy(arr, &fingerprintBits, sizeof(fingerprintBits));
+        arr += sizeof(fingerprintBits);
+        memcpy(arr, words.data(), words.size() * sizeof(uint64_t));
+        arr += words.size() * sizeof(uint64_t);
+        for (size_t i = 0; i < stash.size(); ++i) {
+            memcpy(arr, &stash[i].first, sizeof(uint64_t));
+            memcpy(arr + sizeof(uint64_t), &stash[i].second, sizeof(uint16_t));
+            arr += sizeof(uint64_t) + sizeof(uint16_t);
+        }
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            overflow[i].serialize(arr);
+            arr += overflow[i].serialized_size();
+        }
+    }
+
+    // reads a filter written by serialize
+    void deserialize(unsigned char* arr) {
+        uint64_t header[5];
+        memcpy(header, arr, sizeof(header));
+        arr += sizeof(header);
+        numBuckets = header[0];
+        rng_state = header[1];
+        memcpy(&fingerprintBits, arr, sizeof(fingerprintBits));
+        arr += sizeof(fingerprintBits);
+        words = std::vector<uint64_t, snarf_allocator<uint64_t>>(header[2]);
+        memcpy(words.data(), arr, words.size() * sizeof(uint64_t));
+        arr += words.size() * sizeof(uint64_t);
+        stash.resize(header[3]);
+        for (size_t i = 0; i < stash.size(); ++i) {
+            memcpy(&stash[i].first, arr, sizeof(uint64_t));
+            memcpy(&stash[i].second, arr + sizeof(uint64_t), sizeof(uint16_t));
+            arr += sizeof(uint64_t) + sizeof(uint16_t);
+        }
+        overflow.resize(header[4]);
+        for (size_t i = 0; i < overflow.size(); ++i) {
+            overflow[i].deserialize(arr);
+            arr += overflow[i].serialized_size();
+        }
+    }
+};
@@ -0,0 +1,577 @@
+#ifndef SNARF_ALLOC_CPP
+#define SNARF_ALLOC_CPP
+
+#include<iostream>
+#include<algorithm>
+#include<string>
+#include<vector>
+#include <fstream>
+#include <cassert>
+#include <cstring>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+using namespace std;
+
+#include "snarf_memory.cpp"
+
+// Arenas for the large arrays of a snarf instance (the bit blocks and the hash filter bits).
+// Probes touch random places of these arrays, so with 4KB pages most probes miss the TLB.
+// An arena maps its memory in large chunks that can be backed by huge pages and bound to a NUMA node:
+//
+// SNARF_PAGES_DEFAULT         : regular pages
+// SNARF_PAGES_TRANSPARENT_HUGE: chunks aligned to 2MB and marked with MADV_HUGEPAGE, backed by transparent huge pages when available
+// SNARF_PAGES_EXPLICIT_HUGE   : chunks mapped with MAP_HUGETLB from the reserved huge pages, falls back to transparent huge pages
+//                               when none are reserved (see /proc/sys/vm/nr_hugepages)
+//
+// The arrays are placed in an arena by building or copying the snarf instance inside a snarf_arena_scope:
+//   snarf_arena arena;
+//   arena.init(SNARF_PAGES_TRANSPARENT_HUGE);
+//   {
+//     snarf_arena_scope scope(&arena);
+//     snarf_instance.snarf_init(keys, bits_per_key, batch_size, num_hash_bits);
+//   }
+// The arena has to outlive the snarf instances built in it.
+// Huge pages, node binding and thread pinning use Linux interfaces. Elsewhere chunks come from malloc with regular pages,
+// every machine is a single node and the page type is ignored.
+// Allocations are rounded up to size classes, four per power of two, and freed allocations are reused by any later
+// allocation of the same class, so arrays that grow and shrink reuse their memory with at most 25% rounding.
+// Allocations over a quarter of a chunk get a chunk of their own, which is unmapped when they are freed.
+enum snarf_page_type
+{
+  SNARF_PAGES_DEFAULT=0,
+  SNARF_PAGES_TRANSPARENT_HUGE=1,
+  SNARF_PAGES_EXPLICIT_HUGE=2
+};
+
+#define SNARF_HUGE_PAGE_SIZE (2ULL<<20)
+
+struct snarf_arena
+{
+  int page_type=SNARF_PAGES_DEFAULT;
+  //node the memory is bound to, -1 for the default policy of the process
+  int numa_node=-1;
+  uint64_t chunk_size=64ULL<<20;
+
+  //set when explicit huge pages were asked for but could not be mapped
+  bool explicit_huge_failed=false;
+
+  vector<pair<char*,uint64_t>> chunks;
+  char *curr=NULL;
+  uint64_t curr_left=0;
+
+  //freed allocations by size class, reused by later allocations of the same class
+  vector<vector<void*>> free_lists;
+
+  //bytes handed out and not freed, and bytes mapped from the system
+  uint64_t used_bytes=0,mapped_bytes=0;
+
+  mutex arena_lock;
+
+  snarf_arena(){}
+  snarf_arena(const snarf_arena&)=delete;
+  snarf_arena& operator=(const snarf_arena&)=delete;
+
+  ~snarf_arena()
+  {
+    release();
+  }
+
+  void init(int page_type_in,int numa_node_in=-1,uint64_t chunk_size_in=64ULL<<20)
+  {
+    release();
+    page_type=page_type_in;
+    numa_node=numa_node_in;
+    chunk_size=(chunk_size_in+SNARF_HUGE_PAGE_SIZE-1)/SNARF_HUGE_PAGE_SIZE*SNARF_HUGE_PAGE_SIZE;
+    explicit_huge_failed=false;
+    return ;
+  }
+
+  //maps a chunk of at least var bytes bytes with the page type and node of the arena
+  char* map_chunk(uint64_t bytes)
+  {
+    bytes=(bytes+SNARF_HUGE_PAGE_SIZE-1)/SNARF_HUGE_PAGE_SIZE*SNARF_HUGE_PAGE_SIZE;
+#ifdef __linux__
+    void *ptr=MAP_FAILED;
+
+    if(page_type==SNARF_PAGES_EXPLICIT_HUGE)
+    {
+      ptr=mmap(NULL,bytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+      explicit_huge_failed|=(ptr==MAP_FAILED);
+    }
+
+    if(ptr==MAP_FAILED)
+    {
+      //over-map by a huge page so the chunk can start on a huge page boundary
+      uint64_t padded=bytes+SNARF_HUGE_PAGE_SIZE;
+      char *raw=(char*)mmap(NULL,padded,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+      bool testbool = (raw!=(char*)MAP_FAILED);
+      assert(("Could not map memory for the arena!", testbool));
+
+      char *aligned=(char*)(((uintptr_t)raw+SNARF_HUGE_PAGE_SIZE-1)&~(uintptr_t)(SNARF_HUGE_PAGE_SIZE-1));
+      if(aligned>raw)
+      {
+        munmap(raw,aligned-raw);
+      }
+      if(aligned+bytes<raw+padded)
+      {
+        munmap(aligned+bytes,(raw+padded)-(aligned+bytes));
+      }
+      ptr=aligned;
+
+      if(page_type!=SNARF_PAGES_DEFAULT)
+      {
+        madvise(ptr,bytes,MADV_HUGEPAGE);
+      }
+    }
+
+    //MPOL_BIND, errors are ignored and leave the default policy
+    if(numa_node>=0)
+    {
+      unsigned long node_mask[16];
+      memset(node_mask,0,sizeof(node_mask));
+      if(numa_node<1024)
+      {
+        node_mask[numa_node/64]|=1UL<<(numa_node%64);
+        syscall(SYS_mbind,ptr,bytes,2,node_mask,1024+1,0);
+      }
+    }
+#else
+    void *ptr=NULL;
+    bool testbool = (posix_memalign(&ptr,SNARF_HUGE_PAGE_SIZE,bytes)==0);
+    assert(("Could not allocate memory for the arena!", testbool));
+    explicit_huge_failed|=(page_type==SNARF_PAGES_EXPLICIT_HUGE);
+#endif
+
+    chunks.push_back(make_pair((char*)ptr,bytes));
+    mapped_bytes+=bytes;
+    return (char*)ptr;
+  }
+
+  //returns a chunk of var bytes bytes made by map_chunk to the system
+  static void free_chunk(char *ptr,uint64_t bytes)
+  {
+#ifdef __linux__
+    munmap(ptr,bytes);
+#else
+    free(ptr);
+#endif
+    return ;
+  }
+
+  //unmaps the chunk starting at var ptr
+  void unmap_chunk(char *ptr)
+  {
+    for(int i=0;i<chunks.size();i++)
+    {
+      if(chunks[i].first==ptr)
+      {
+        free_chunk(chunks[i].first,chunks[i].second);
+        mapped_bytes-=chunks[i].second;
+        chunks[i]=chunks.back();
+        chunks.pop_back();
+        return ;
+      }
+    }
+    return ;
+  }
+
+  //the size class of an allocation of var bytes bytes: sizes are rounded to cache lines, so the arrays do not share
+  //lines, and over 256 bytes to a quarter of their power of two. Returns the class index and sets var bytes to its size
+  static uint64_t size_class(uint64_t &bytes)
+  {
+    bytes=max((uint64_t)64,(bytes+63)&~(uint64_t)63);
+    if(bytes<=256)
+    {
+      return bytes/64-1;
+    }
+    int top=63-__builtin_clzll(bytes-1);
+    uint64_t step=1ULL<<(top-2);
+    bytes=(bytes+step-1)&~(step-1);
+    //classes 0 to 3 are 64 to 256 bytes, then 4 classes per power of two from 2^8
+    return 4+(top-8)*4+(bytes-1-(1ULL<<top))/step;
+  }
+
+  //allocations over a quarter of a chunk are mapped on their own
+  bool is_large(uint64_t bytes)
+  {
+    return bytes>chunk_size/4;
+  }
+
+  //bytes the arena holds for an allocation of var requested bytes: its size class, or its own chunk rounded to
+  //huge pages for large allocations
+  uint64_t held_bytes(uint64_t requested)
+  {
+    if(requested==0)
+    {
+      return 0;
+    }
+    size_class(requested);
+    if(is_large(requested))
+    {
+      return (requested+SNARF_HUGE_PAGE_SIZE-1)/SNARF_HUGE_PAGE_SIZE*SNARF_HUGE_PAGE_SIZE;
+    }
+    return requested;
+  }
+
+  void* allocate(uint64_t bytes)
+  {
+    uint64_t size_index=size_class(bytes);
+
+    lock_guard<mutex> guard(arena_lock);
+    used_bytes+=bytes;
+
+    if(is_large(bytes))
+    {
+      return map_chunk(bytes);
+    }
+
+    if(size_index<free_lists.size() && free_lists[size_index].size()>0)
+    {
+      void *ptr=free_lists[size_index].back();
+      free_lists[size_index].pop_back();
+      return ptr;
+    }
+
+    if(curr_left<bytes)
+    {
+      curr=map_chunk(chunk_size);
+      curr_left=chunk_size;
+    }
+    void *ptr=curr;
+    curr+=bytes;
+    curr_left-=bytes;
+    return ptr;
+  }
+
+  void deallocate(void *ptr,uint64_t bytes)
+  {
+    uint64_t size_index=size_class(bytes);
+
+    lock_guard<mutex> guard(arena_lock);
+    used_bytes-=bytes;
+    if(is_large(bytes))
+    {
+      unmap_chunk((char*)ptr);
+      return ;
+    }
+    if(size_index>=free_lists.size())
+    {
+      free_lists.resize(size_index+1);
+    }
+    free_lists[size_index].push_back(ptr);
+    return ;
+  }
+
+  //bytes of the arena backed by huge pages, read from /proc/self/smaps
+  uint64_t huge_page_bytes()
+  {
+    ifstream smaps("/proc/self/smaps");
+    string line;
+    uint64_t ans=0;
+    char *region_start=NULL;
+    bool in_arena=false;
+    while(getline(smaps,line))
+    {
+      if(line.size()>0 && isxdigit(line[0]) && line.find('-')!=string::npos)
+      {
+        region_start=(char*)strtoull(line.c_str(),NULL,16);
+        in_arena=false;
+        for(int i=0;i<chunks.size();i++)
+        {
+          in_arena|=(region_start>=chunks[i].first && region_start<chunks[i].first+chunks[i].second);
+        }
+        continue;
+      }
+
+      uint64_t kb=0;
+      if(in_arena && (sscanf(line.c_str(),"AnonHugePages: %lu kB",&kb)==1 || sscanf(line.c_str(),"Private_Hugetlb: %lu kB",&kb)==1))
+      {
+        ans+=kb*1024;
+      }
+    }
+    return ans;
+  }
+
+  //unmaps all chunks, the snarf instances built in the arena must be destroyed first
+  void release()
+  {
+    for(int i=0;i<chunks.size();i++)
+    {
+      free_chunk(chunks[i].first,chunks[i].second);
+    }
+    chunks.resize(0);
+    free_lists.clear();
+    curr=NULL;
+    curr_left=0;
+    used_bytes=0;
+    mapped_bytes=0;
+    return ;
+  }
+};
+
+//arena used by the allocations of the current thread, NULL allocates from the heap
+inline thread_local snarf_arena *snarf_current_arena=NULL;
+
+//places the allocations of the current thread in an arena until the end of the scope
+struct snarf_arena_scope
+{
+  snarf_arena *prev_arena;
+
+  snarf_arena_scope(snarf_arena *arena)
+  {
+    prev_arena=snarf_current_arena;
+    snarf_current_arena=arena;
+  }
+
+  ~snarf_arena_scope()
+  {
+    snarf_current_arena=prev_arena;
+  }
+};
+
+//Allocator of the snarf arrays. It takes the arena of the thread when it is created, and containers copied
+//into a new snarf instance take the arena of the thread doing the copy
+template <class T>
+struct snarf_allocator
+{
+  typedef T value_type;
+  typedef true_type propagate_on_container_move_assignment;
+  typedef true_type propagate_on_container_swap;
+
+  snarf_arena *arena;
+
+  snarf_allocator(): arena(snarf_current_arena) {}
+
+  template <class U>
+  snarf_allocator(const snarf_allocator<U> &other): arena(other.arena) {}
+
+  T* allocate(size_t n)
+  {
+    if(arena==NULL)
+    {
+      return std::allocator<T>().allocate(n);
+    }
+    return (T*)arena->allocate(n*sizeof(T));
+  }
+
+  void deallocate(T *ptr,size_t n)
+  {
+    if(arena==NULL)
+    {
+      std::allocator<T>().deallocate(ptr,n);
+      return ;
+    }
+    arena->deallocate(ptr,n*sizeof(T));
+    return ;
+  }
+
+  snarf_allocator select_on_container_copy_construction() const
+  {
+    return snarf_allocator();
+  }
+};
+
+//bytes held for var requested bytes by an allocator, in its arena or on the heap
+template <class T>
+uint64_t snarf_allocator_bytes(const snarf_allocator<T> &allocator,uint64_t requested)
+{
+  if(allocator.arena==NULL)
+  {
+    return snarf_heap_bytes(requested);
+  }
+  return allocator.arena->held_bytes(requested);
+}
+
+template <class T,class U>
+bool operator==(const snarf_allocator<T> &a,const snarf_allocator<U> &b)
+{
+  return a.arena==b.arena;
+}
+
+template <class T,class U>
+bool operator!=(const snarf_allocator<T> &a,const snarf_allocator<U> &b)
+{
+  return a.arena!=b.arena;
+}
+
+
+//NUMA nodes of the machine and their cpus, read from /sys/devices/system/node.
+//Machines without the directory are seen as a single node 0 holding every cpu
+struct snarf_numa_topology
+{
+  vector<int> nodes;
+  vector<vector<int>> node_cpus;
+  vector<int> node_of_cpu;
+
+  //parses a cpu list such as "0-3,8-11"
+  static void parse_cpu_list(string list,vector<int> &cpus)
+  {
+    stringstream ss(list);
+    string part;
+    while(getline(ss,part,','))
+    {
+      if(part.size()==0)
+      {
+        continue;
+      }
+      int first=0,last=0;
+      if(sscanf(part.c_str(),"%d-%d",&first,&last)==2)
+      {
+        for(int c=first;c<=last;c++)
+        {
+          cpus.push_back(c);
+        }
+      }
+      else if(sscanf(part.c_str(),"%d",&first)==1)
+      {
+        cpus.push_back(first);
+      }
+    }
+    return ;
+  }
+
+  void init()
+  {
+    nodes.resize(0);
+    node_cpus.resize(0);
+
+    string online;
+    ifstream online_file("/sys/devices/system/node/online");
+    if(online_file && getline(online_file,online))
+    {
+      parse_cpu_list(online,nodes);
+    }
+
+    for(int i=0;i<nodes.size();i++)
+    {
+      vector<int> cpus;
+      string list;
+      ifstream cpu_file("/sys/devices/system/node/node"+to_string(nodes[i])+"/cpulist");
+      if(cpu_file && getline(cpu_file,list))
+      {
+        parse_cpu_list(list,cpus);
+      }
+      node_cpus.push_back(cpus);
+    }
+
+    if(nodes.size()==0)
+    {
+      nodes.push_back(0);
+      vector<int> cpus;
+      for(int c=0;c<thread::hardware_concurrency();c++)
+      {
+        cpus.push_back(c);
+      }
+      node_cpus.push_back(cpus);
+    }
+
+    node_of_cpu.resize(0);
+    for(int i=0;i<nodes.size();i++)
+    {
+      for(int j=0;j<node_cpus[i].size();j++)
+      {
+        if(node_cpus[i][j]>=node_of_cpu.size())
+        {
+          node_of_cpu.resize(node_cpus[i][j]+1,0);
+        }
+        node_of_cpu[node_cpus[i][j]]=i;
+      }
+    }
+    return ;
+  }
+
+  //returns the index in nodes of the node running the calling thread
+  int current_node_index()
+  {
+#ifdef __linux__
+    int cpu=sched_getcpu();
+#else
+    int cpu=-1;
+#endif
+    if(cpu<0 || cpu>=node_of_cpu.size())
+    {
+      return 0;
+    }
+    return node_of_cpu[cpu];
+  }
+
+  //runs var work on a thread pinned to the cpus of a node(index var node_index in nodes) and waits for it
+  template <class F>
+  void run_on_node(int node_index,F work)
+  {
+    thread worker([&](){
+#ifdef __linux__
+      if(node_cpus[node_index].size()>0)
+      {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for(int j=0;j<node_cpus[node_index].size();j++)
+        {
+          CPU_SET(node_cpus[node_index][j],&cpu_set);
+        }
+        pthread_setaffinity_np(pthread_self(),sizeof(cpu_set),&cpu_set);
+      }
+#endif
+      work();
+    });
+    worker.join();
+    return ;
+  }
+};
+
+//One read-only copy of a snarf instance(type F) per NUMA node, each in an arena bound to its node.
+//Queries go to the copy of the node running the calling thread. Range queries keep their scratch state in local
+//variables, so threads sharing a node can query its copy at the same time
+template <class F>
+struct snarf_numa_replicas
+{
+  snarf_numa_topology topology;
+  vector<unique_ptr<snarf_arena>> arenas;
+  vector<unique_ptr<F>> replicas;
+
+  //copies var source once per node. Each copy is made by a thread pinned to its node, so the pages are also first touched there
+  void init(F &source,int page_type)
+  {
+    replicas.resize(0);
+    arenas.resize(0);
+    topology.init();
+
+    for(int i=0;i<topology.nodes.size();i++)
+    {
+      arenas.push_back(unique_ptr<snarf_arena>(new snarf_arena()));
+      arenas[i]->init(page_type,(topology.nodes.size()>1)?topology.nodes[i]:-1);
+      replicas.push_back(unique_ptr<F>());
+
+      topology.run_on_node(i,[&](){
+        snarf_arena_scope scope(arenas[i].get());
+        replicas[i].reset(new F(source));
+      });
+    }
+    return ;
+  }
+
+  //returns the copy of the node running the calling thread
+  F& local()
+  {
+    return *replicas[topology.current_node_index()];
+  }
+
+  template <class K>
+  bool range_query(K lower_val,K upper_val)
+  {
+    return local().range_query(lower_val,upper_val);
+  }
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+
+using namespace std;
+
+#include "snarf_hash.cpp"
+
+// Stages of a query in snarf_batch_query, each stage starts with the data it needs prefetched by the previous one.
+// The model is searched when a query starts: its boundaries, slopes and biases are a few KB per million keys and stay
+// in cache, so the loads worth overlapping are the ones after it
+enum snarf_batch_stage
+{
+  SNARF_BATCH_DIRECTORY=0,  // block directory entries give the address of the block bits
+  SNARF_BATCH_BLOCK=1,      // block bits (and hash filter bits) give the answer
+  SNARF_BATCH_DONE=2
+};
+
+//Interleaved execution of a batch of range queries on one thread.
+//A query is a chain of dependent loads: model, block directory, block bits and hash filter bits.
+//Each query runs as a small state machine that issues a prefetch for its next load and passes the turn to the next query,
+//so the loads of up to group_size queries are in flight together instead of one after the other.
+//Answers are the same as range_query on the filter. The filter should not be updated during a batch.
+template <class T>
+struct snarf_batch_query
+{
+  //state of a query in flight
+  struct probe_state
+  {
+    T lower_val,upper_val;
+    int stage;
+    uint64_t temp_loc_lower,temp_loc_upper;
+    uint64_t query_index;
+  };
+
+  snarf_updatable_gcs_hash<T> *filter;
+  int group_size;
+
+  snarf_batch_query<T>() {
+    filter=NULL;
+    group_size=16;
+  }
+
+  //group_size is the number of queries in flight, 8 to 16 covers the memory level parallelism of most cores
+  void init(snarf_updatable_gcs_hash<T>* snarf_instance,int num_in_flight=16)
+  {
+    filter=snarf_instance;
+    group_size=max(1,num_in_flight);
+    return ;
+  }
+
+  //prefetches the cache lines of a block, up to max_lines of them
+  void prefetch_block(uint64_t bb_index,int max_lines=4)
+  {
+    uint64_t begin=filter->block_begin(bb_index);
+    const char *bits=(const char*)filter->block_groups[bb_index/filter->blocks_per_group].bb_bitset.m_bits.data()+begin/8;
+    uint64_t num_lines=min((uint64_t)max_lines,((filter->block_end(bb_index)-begin)/8+63)/64);
+    for(uint64_t i=0;i<num_lines;i++)
+    {
+      __builtin_prefetch(bits+64*i);
+    }
+    return ;
+  }
+
+  void prefetch_directory(uint64_t bb_index)
+  {
+    __builtin_prefetch(&filter->block_groups[bb_index/filter->blocks_per_group]);
+    __builtin_prefetch(&filter->block_offset[bb_index]);
+    __builtin_prefetch(&filter->vec_num_keys[bb_index]);
+    __builtin_prefetch(&filter->block_low_bits[bb_index]);
+    return ;
+  }
+
+  //puts a query in a state, with the loads of its first stage prefetched
+  void start_query(probe_state &state,T lower_val,T upper_val,uint64_t query_index)
+  {
+    uint64_t block_range=filter->block_size*filter->P;
+    state.lower_val=lower_val;
+    state.upper_val=upper_val;
+    state.query_index=query_index;
+    state.stage=SNARF_BATCH_DIRECTORY;
+
+    //the hash filter bits load together with the directory, range queries verify their lower end when the block has a hit
+    if(filter->use_hash_filter)
+    {
+      uint64_t folded=snarf_key_fold(lower_val);
+      if(filter->verification_mode==SNARF_VERIFY_CUCKOO)
+      {
+        filter->cf.prefetch(folded);
+      }
+      else
+      {
+        filter->bf.prefetch(folded);
+      }
+    }
+
+    state.temp_loc_lower=filter->calculate_endpoints(lower_val);
+    state.temp_loc_upper=(lower_val==upper_val)?state.temp_loc_lower:filter->calculate_endpoints(upper_val);
+    prefetch_directory(state.temp_loc_lower/block_range);
+    prefetch_directory(state.temp_loc_upper/block_range);
+    return ;
+  }
+
+  //runs one stage of a query, returns true when the answer is set
+  bool step_query(probe_state &state,bool &answer)
+  {
+    bool point=(state.lower_val==state.upper_val);
+    uint64_t block_range=filter->block_size*filter->P;
+
+    if(state.stage==SNARF_BATCH_DIRECTORY)
+    {
+      //the hash filter is the cheap negative of point queries
+      if(point && filter->fingerprint_bits==0 && !filter->verify_hash(state.lower_val))
+      {
+        answer=false;
+        state.stage=SNARF_BATCH_DONE;
+        return true;
+      }
+      prefetch_block(state.temp_loc_lower/block_range);
+      if(state.temp_loc_upper/block_range!=state.temp_loc_lower/block_range)
+      {
+        prefetch_block(state.temp_loc_upper/block_range);
+      }
+      state.stage=SNARF_BATCH_BLOCK;
+      return false;
+    }
+
+    if(point)
+    {
+      answer=filter->contains_at(state.lower_val,state.temp_loc_lower,true);
+    }
+    else
+    {
+      answer=filter->range_query_at(state.lower_val,state.upper_val,state.temp_loc_lower,state.temp_loc_upper);
+    }
+    state.stage=SNARF_BATCH_DONE;
+    return true;
+  }
+
+  //answers the queries [lower_vals[i], upper_vals[i]], answers[i] is 1 when range_query would return true
+  void range_query(const vector<T> &lower_vals,const vector<T> &upper_vals,vector<char> &answers)
+  {
+    uint64_t num_queries=lower_vals.size();
+    answers.assign(num_queries,0);
+
+    vector<probe_state> states(min((uint64_t)group_size,num_queries));
+    uint64_t next_query=0;
+    for(int i=0;i<states.size();i++)
+    {
+      start_query(states[i],lower_vals[next_query],upper_vals[next_query],next_query);
+      next_query++;
+    }
+
+    //round robin over the queries in flight, a finished query hands its state to the next query of the batch
+    int active=states.size();
+    while(active>0)
+    {
+      for(int i=0;i<states.size();i++)
+      {
+        if(states[i].stage==SNARF_BATCH_DONE)
+        {
+          continue;
+        }
+        bool answer=false;
+        if(step_query(states[i],answer))
+        {
+          answers[states[i].query_index]=answer;
+          if(next_query<num_queries)
+          {
+            start_query(states[i],lower_vals[next_query],upper_vals[next_query],next_query);
+            next_query++;
+          }
+          else
+          {
+            active--;
+          }
+        }
+      }
+    }
+    return ;
+  }
+
+  //point queries, answers[i] is 1 when contains would return true
+  void contains(const vector<T> &keys,vector<char> &answers)
+  {
+    range_query(keys,keys,answers);
+    return ;
+  }
+
+};
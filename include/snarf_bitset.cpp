@@ -7,18 +7,23 @@
 #include <cassert>
 #include <set>
 #include <ctime> // time_t
+// gives access to the underlying blocks of the dynamic_bitset for word level reads
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #include <boost/dynamic_bitset.hpp>
 #include <cstring>
 using namespace std;
+
+#include "snarf_memory.cpp"
+#include "snarf_alloc.cpp"
 using namespace std::chrono; 
 
 
 
 // Bitset implementation to store the Golomb Coded values
-// It relies on dynamic_bitset library in boost
+// It relies on dynamic_bitset library in boost, the blocks are allocated from the arena of the thread (see snarf_alloc.cpp)
 struct snarf_bitset
 {
-  boost::dynamic_bitset<> bb_bitset;
+  boost::dynamic_bitset<uint64_t,snarf_allocator<uint64_t>> bb_bitset;
 
   //initialize a dynamic bitset of particular size
   void init(uint64_t size)
@@ -28,9 +33,62 @@ struct snarf_bitset
     return;
   }
 
+  //writes certain amount of bits(var num_bits, at most 64) from a value (var val) at an offset (var offset)
+  //writes the underlying words directly instead of going bit by bit
+  void bitset_write_word(uint64_t offset,uint64_t val,uint64_t num_bits)
+  {
+    if(num_bits==0)
+    {
+      return ;
+    }
+
+    uint64_t mask=(num_bits==64)?~(uint64_t)0:(((uint64_t)1<<num_bits)-1);
+    val&=mask;
+    uint64_t index=offset/64,shift=offset%64;
+    auto &words=bb_bitset.m_bits;
+    words[index]=(words[index]&~(mask<<shift))|(val<<shift);
+    if(shift+num_bits>64)
+    {
+      uint64_t rest_mask=((uint64_t)1<<(shift+num_bits-64))-1;
+      words[index+1]=(words[index+1]&~rest_mask)|(val>>(64-shift));
+    }
+    return ;
+  }
+
+  //copies num_bits bits from offset from to offset to, the two ranges may overlap
+  void bitset_move(uint64_t from,uint64_t to,uint64_t num_bits)
+  {
+    if(to<from)
+    {
+      for(uint64_t done=0;done<num_bits;done+=64)
+      {
+        uint64_t chunk=min((uint64_t)64,num_bits-done);
+        bitset_write_word(to+done,bitset_read_word(from+done,chunk),chunk);
+      }
+    }
+    else if(to>from)
+    {
+      //back to front, so the source bits are read before they are overwritten
+      uint64_t left=num_bits;
+      while(left>0)
+      {
+        uint64_t chunk=min((uint64_t)64,left);
+        left-=chunk;
+        bitset_write_word(to+left,bitset_read_word(from+left,chunk),chunk);
+      }
+    }
+    return ;
+  }
+
   //writes certain amount of bits(var num_bits) from a value (var val) at an offset (var offset)
   void bitset_write_bits(uint64_t offset,uint64_t val, uint64_t num_bits)
   {
+    if(num_bits<=64)
+    {
+      bitset_write_word(offset,val,num_bits);
+      return ;
+    }
+
     uint32_t temp;
     while(num_bits>0)
     {
@@ -51,23 +109,42 @@ struct snarf_bitset
     return ;
   }
 
-  //returns certain amount of bits(var num_bits) at an offset (var offset)
-  uint64_t bitset_read_bits(uint64_t offset,uint64_t num_bits)
+  //returns certain amount of bits(var num_bits, at most 64) at an offset (var offset)
+  //reads the underlying words directly instead of going bit by bit. Bits past the end of the bitset are read as 0
+  uint64_t bitset_read_word(uint64_t offset,uint64_t num_bits)
   {
-    uint64_t ans=0;
-    uint32_t factor=1;
-    while(num_bits>0)
+    static_assert(sizeof(decltype(bb_bitset)::block_type)==8, "snarf_bitset expects 64 bit blocks");
+
+    if(num_bits==0)
     {
-      ans+=bb_bitset.test(offset)*factor;
-      factor*=2;
-      num_bits--;
-      offset++;
+      return 0;
     }
 
+    uint64_t index=offset/64,shift=offset%64;
+    if(index>=bb_bitset.m_bits.size())
+    {
+      return 0;
+    }
 
+    uint64_t ans=bb_bitset.m_bits[index]>>shift;
+    if(shift+num_bits>64 && index+1<bb_bitset.m_bits.size())
+    {
+      ans|=bb_bitset.m_bits[index+1]<<(64-shift);
+    }
+
+    if(num_bits<64)
+    {
+      ans&=((uint64_t)1<<num_bits)-1;
+    }
     return ans;
   }
 
+  //returns certain amount of bits(var num_bits) at an offset (var offset)
+  uint64_t bitset_read_bits(uint64_t offset,uint64_t num_bits)
+  {
+    return bitset_read_word(offset,num_bits);
+  }
+
   // reads a single bit at an offset(var offset)
   uint64_t bitset_read_bit(uint64_t offset,uint64_t num_bits)
   {
@@ -76,48 +153,56 @@ struct snarf_bitset
 
 
   //returns space used by the structure in bytes
-  int return_size()
+  uint64_t return_size()
   {
-    double a=bb_bitset.size();
-    int total_size=sizeof(a);
-
-    total_size=ceil(a/8.00);
+    uint64_t a=bb_bitset.size();
+    uint64_t total_size=(a+7)/8;
 
     return total_size; 
   }
 
-  // writes the model contents into a char array
-  void serialize(unsigned char* arr)
+  //returns the heap bytes held by the bitset, including unused capacity of its blocks
+  uint64_t allocated_size()
   {
+    return snarf_vector_heap_bytes(bb_bitset.m_bits);
+  }
 
+  //releases the unused capacity of the bitset, returns the number of bytes released
+  uint64_t shrink_to_fit()
+  {
+    uint64_t before=allocated_size();
+    if(bb_bitset.m_bits.capacity()>bb_bitset.m_bits.size())
+    {
+      bb_bitset.m_bits.shrink_to_fit();
+    }
+    return before-allocated_size();
+  }
+
+  //returns the number of bytes written by serialize
+  uint64_t serialized_size()
+  {
+    return sizeof(double)+(bb_bitset.size()+7)/8;
+  }
+
+  // writes the bitset contents into a char array: the number of bits, then the bits 8 to a byte, lowest bit first.
+  //This is the byte order of the underlying words on little endian machines, so the words are copied directly
+  void serialize(unsigned char* arr)
+  {
     double a=bb_bitset.size();
 
     int offset=0;
     memcpy(arr+offset,&a,sizeof(a));
     offset+=sizeof(a);
 
-
-    for(int i=0;i<ceil(a/8.00);i++)
-    {
-      unsigned char temp=0;
-      for(int j=0;j<8 && (i*8+j<a);j++)
-      {
-        if(bb_bitset.test(i*8+j))
-        {
-          temp+=pow(2,j);
-        }
-      }
-
-      memcpy(arr+offset,&temp,sizeof(temp));
-      offset+=sizeof(temp);
-    }
+    memcpy(arr+offset,bb_bitset.m_bits.data(),(bb_bitset.size()+7)/8);
 
     return ;
   }
 
-  // writes the model contents into a char array
+  // reads the bitset contents from a char array written by serialize
   void deserialize(unsigned char* arr)
   {
+    static_assert(__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__, "snarf_bitset serialization copies little endian words");
 
     double bitset_size=10.09;
     int offset=0;
@@ -127,29 +212,46 @@ struct snarf_bitset
 
     bb_bitset.resize(bitset_size);
     bb_bitset.reset();
-
-    for(int i=0;i<ceil(bitset_size/8.00);i++)
+    memcpy(bb_bitset.m_bits.data(),arr+offset,((uint64_t)bitset_size+7)/8);
+    //bits past the end of the last word must stay 0
+    if((uint64_t)bitset_size%64!=0)
     {
-      unsigned char temp;
-      memcpy(&temp,arr+offset,sizeof(temp));
-      offset+=sizeof(temp);
-
-      for(int j=0;j<8 && i*8+j<bitset_size;j++)
-      {
-        if(temp%2==1)
-        {
-          bb_bitset.set(i*8+j);
-        }
-        else
-        {
-          bb_bitset.reset(i*8+j);
-        }
-        temp=temp/2;
-      }
+      bb_bitset.m_bits.back()&=((uint64_t)1<<((uint64_t)bitset_size%64))-1;
     }
 
     return ;
   }
 
+};
+
+//Read only view of the bits [base, base+num_bits) of a bitset, used for blocks that share a bitset.
+//Reads past the end of the view return 0, as they do past the end of a bitset
+struct snarf_bitset_view
+{
+  snarf_bitset *bits;
+  uint64_t base,num_bits;
+
+  uint64_t bitset_read_word(uint64_t offset,uint64_t n)
+  {
+    if(offset>=num_bits)
+    {
+      return 0;
+    }
+    return bits->bitset_read_word(base+offset,min(n,num_bits-offset));
+  }
+
+  uint64_t bitset_read_bits(uint64_t offset,uint64_t n)
+  {
+    return bitset_read_word(offset,n);
+  }
+
+  uint64_t bitset_read_bit(uint64_t offset,uint64_t n)
+  {
+    return offset<num_bits && bits->bb_bitset.test(base+offset);
+  }
 
+  uint64_t return_size()
+  {
+    return (num_bits+7)/8;
+  }
 };
@@ -0,0 +1,188 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+#include "snarf_memory.cpp"
+
+// Small fixed size cache of range query results, for workloads that repeat the same ranges (e.g. dashboards).
+// Entries are direct mapped on the locations of the query endpoints, and tagged with the folded endpoints
+// since different ranges with the same locations can have different answers.
+//
+// No locks are taken: each entry has a sequence number that is odd while the entry is written.
+// A reader that sees the sequence number change while it reads the entry treats it as a miss,
+// and a writer that finds the entry being written skips the store.
+//
+// Answers are only cached for ranges whose endpoints fall in the same or neighbouring blocks. An entry holds the epochs
+// of those blocks when the answer was computed, and inserts and deletes bump the epoch of their block,
+// which invalidates every entry that covers it.
+struct snarf_range_cache
+{
+  struct alignas(32) cache_entry
+  {
+    atomic<uint64_t> seq;
+    atomic<uint64_t> lower,upper;
+    //epoch of the lower block (bits 33-63), epoch of the upper block (bits 2-32), answer (bit 1), valid (bit 0)
+    atomic<uint64_t> state;
+  };
+
+  unique_ptr<cache_entry[]> entries;
+  uint64_t num_entries=0;
+  vector<uint32_t> block_epoch;
+
+  atomic<uint64_t> hits,misses;
+
+  snarf_range_cache(){
+    hits=0;
+    misses=0;
+  }
+
+  //a copy starts empty with the same number of entries, the cached answers belong to the filter they were computed on
+  snarf_range_cache(const snarf_range_cache &other){
+    hits=0;
+    misses=0;
+    init(other.num_entries,other.block_epoch.size());
+  }
+
+  snarf_range_cache& operator=(const snarf_range_cache &other)
+  {
+    init(other.num_entries,other.block_epoch.size());
+    return *this;
+  }
+
+  //sets up a cache of var size entries (rounded up to a power of two, 0 disables the cache) over var num_blocks blocks
+  void init(uint64_t size,uint64_t num_blocks)
+  {
+    num_entries=0;
+    entries.reset();
+    if(size>0)
+    {
+      num_entries=1;
+      while(num_entries<size)
+      {
+        num_entries*=2;
+      }
+      entries.reset(new cache_entry[num_entries]);
+    }
+    clear(num_blocks);
+    return ;
+  }
+
+  bool enabled()
+  {
+    return num_entries>0;
+  }
+
+  //drops every entry, used when the blocks are rebuilt
+  void clear(uint64_t num_blocks)
+  {
+    if(!enabled())
+    {
+      return ;
+    }
+    for(uint64_t i=0;i<num_entries;i++)
+    {
+      entries[i].seq.store(0,memory_order_relaxed);
+      entries[i].state.store(0,memory_order_relaxed);
+    }
+    block_epoch.assign(num_blocks,0);
+    hits=0;
+    misses=0;
+    return ;
+  }
+
+  //bumps the epoch of a block(var bb_index) after it was updated
+  void invalidate_block(uint64_t bb_index)
+  {
+    if(enabled())
+    {
+      block_epoch[bb_index]++;
+    }
+    return ;
+  }
+
+  //the state an entry must have to answer a query whose endpoints are in blocks var lower_block and var upper_block
+  uint64_t expected_state(uint64_t lower_block,uint64_t upper_block,bool answer)
+  {
+    uint64_t epoch_lower=block_epoch[lower_block]&0x7FFFFFFF,epoch_upper=block_epoch[upper_block]&0x7FFFFFFF;
+    return (epoch_lower<<33)|(epoch_upper<<2)|((uint64_t)answer<<1)|1;
+  }
+
+  cache_entry& slot(uint64_t temp_loc_lower,uint64_t temp_loc_upper)
+  {
+    uint64_t h=(temp_loc_lower*0x9E3779B97F4A7C15ULL)^(temp_loc_upper*0xC2B2AE3D27D4EB4FULL);
+    return entries[(h^(h>>29))&(num_entries-1)];
+  }
+
+  //looks up the answer of the range with folded endpoints var lower, var upper at locations var temp_loc_lower,
+  //var temp_loc_upper (in blocks of var block_range locations), returns true on a hit
+  bool lookup(uint64_t lower,uint64_t upper,uint64_t temp_loc_lower,uint64_t temp_loc_upper,uint64_t block_range,bool &answer)
+  {
+    uint64_t lower_block=temp_loc_lower/block_range,upper_block=temp_loc_upper/block_range;
+    if(upper_block-lower_block>1)
+    {
+      misses.fetch_add(1,memory_order_relaxed);
+      return false;
+    }
+
+    cache_entry &entry=slot(temp_loc_lower,temp_loc_upper);
+    uint64_t seq=entry.seq.load(memory_order_acquire);
+    uint64_t entry_lower=entry.lower.load(memory_order_relaxed);
+    uint64_t entry_upper=entry.upper.load(memory_order_relaxed);
+    uint64_t state=entry.state.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+
+    bool hit=(seq%2==0 && entry.seq.load(memory_order_relaxed)==seq && entry_lower==lower && entry_upper==upper
+              && (state|2)==expected_state(lower_block,upper_block,true));
+    if(!hit)
+    {
+      misses.fetch_add(1,memory_order_relaxed);
+      return false;
+    }
+    answer=(state>>1)&1;
+    hits.fetch_add(1,memory_order_relaxed);
+    return true;
+  }
+
+  //stores the answer of a range, see lookup
+  void store(uint64_t lower,uint64_t upper,uint64_t temp_loc_lower,uint64_t temp_loc_upper,uint64_t block_range,bool answer)
+  {
+    uint64_t lower_block=temp_loc_lower/block_range,upper_block=temp_loc_upper/block_range;
+    if(upper_block-lower_block>1)
+    {
+      return ;
+    }
+
+    cache_entry &entry=slot(temp_loc_lower,temp_loc_upper);
+    uint64_t seq=entry.seq.load(memory_order_relaxed);
+    if(seq%2==1 || !entry.seq.compare_exchange_strong(seq,seq+1,memory_order_relaxed))
+    {
+      return ;
+    }
+    atomic_thread_fence(memory_order_release);
+    entry.lower.store(lower,memory_order_relaxed);
+    entry.upper.store(upper,memory_order_relaxed);
+    entry.state.store(expected_state(lower_block,upper_block,answer),memory_order_relaxed);
+    entry.seq.store(seq+2,memory_order_release);
+    return ;
+  }
+
+  double hit_rate()
+  {
+    uint64_t total=hits+misses;
+    return (total==0)?0:hits*1.0/total;
+  }
+
+  uint64_t return_size()
+  {
+    return num_entries*sizeof(cache_entry)+block_epoch.size()*sizeof(uint32_t);
+  }
+
+  uint64_t allocated_size()
+  {
+    return snarf_heap_bytes(num_entries*sizeof(cache_entry))+snarf_vector_heap_bytes(block_epoch);
+  }
+};
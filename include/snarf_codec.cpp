@@ -0,0 +1,293 @@
+#include<iostream>
+#include<algorithm>
+#include<cmath>
+#include <vector>
+#include <cstring>
+using namespace std;
+
+#include "snarf_bitset.cpp"
+
+// Encodings of a bit block. Every codec stores the sorted values of a block as a binary section of
+// low bits (num_keys*low_bits bits) followed by a unary section holding the high parts (value>>low_bits).
+//
+// SNARF_CODEC_GOLOMB     : low_bits=bit_size (Golomb coding with P=2^bit_size), decoded bit by bit
+// SNARF_CODEC_RICE_LUT   : same layout as SNARF_CODEC_GOLOMB, the unary section is decoded a byte at a time with a lookup table
+// SNARF_CODEC_ELIAS_FANO : low_bits is chosen per block to minimize the size of the block (Elias-Fano), decoded with the lookup table
+//
+// The default can be picked at build time, e.g. -DSNARF_DEFAULT_BLOCK_CODEC=SNARF_CODEC_ELIAS_FANO
+enum snarf_codec_type
+{
+  SNARF_CODEC_GOLOMB=0,
+  SNARF_CODEC_RICE_LUT=1,
+  SNARF_CODEC_ELIAS_FANO=2
+};
+
+#ifndef SNARF_DEFAULT_BLOCK_CODEC
+#define SNARF_DEFAULT_BLOCK_CODEC SNARF_CODEC_RICE_LUT
+#endif
+
+// Lookup table over a byte of the unary section:
+// the number of set bits, and for the k-th set bit the number of zeros before it in the byte
+struct snarf_rice_lut
+{
+  uint8_t num_ones[256];
+  uint8_t zeros_before[256][8];
+
+  snarf_rice_lut()
+  {
+    for(int b=0;b<256;b++)
+    {
+      int ones=0,zeros=0;
+      memset(zeros_before[b],0,sizeof(zeros_before[b]));
+      for(int j=0;j<8;j++)
+      {
+        if((b>>j)&1)
+        {
+          zeros_before[b][ones]=zeros;
+          ones++;
+        }
+        else
+        {
+          zeros++;
+        }
+      }
+      num_ones[b]=ones;
+    }
+  }
+};
+
+static const snarf_rice_lut rice_lut;
+
+
+struct snarf_block_codec
+{
+  int codec=SNARF_DEFAULT_BLOCK_CODEC;
+
+  //returns the number of bits used by a block of num_keys values whose largest value is last_val
+  uint64_t encoded_size(uint64_t num_keys,uint64_t low_bits,uint64_t last_val)
+  {
+    if(num_keys==0)
+    {
+      return 0;
+    }
+    return num_keys*(low_bits+1)+(last_val>>low_bits);
+  }
+
+  //returns the number of low bits to use for a block of sorted values(var vals)
+  uint64_t choose_low_bits(vector<uint64_t> &vals,uint64_t default_bits)
+  {
+    if(codec!=SNARF_CODEC_ELIAS_FANO || vals.size()==0)
+    {
+      return default_bits;
+    }
+
+    uint64_t best_bits=default_bits;
+    uint64_t best_size=encoded_size(vals.size(),default_bits,vals.back());
+    for(uint64_t l=0;l<=60;l++)
+    {
+      uint64_t temp_size=encoded_size(vals.size(),l,vals.back());
+      if(temp_size<best_size)
+      {
+        best_size=temp_size;
+        best_bits=l;
+      }
+    }
+
+    return best_bits;
+  }
+
+  //writes the sorted values(var vals) into a bit block(var bb_temp)
+  void encode(vector<uint64_t> &vals,uint64_t low_bits,snarf_bitset &bb_temp)
+  {
+    uint64_t num_keys=vals.size();
+    bb_temp.init(encoded_size(num_keys,low_bits,num_keys>0?vals.back():0));
+
+    uint64_t offset_bits=0;
+
+    //Write the binary code in the bit array
+    for(uint64_t i=0;i<num_keys;i++)
+    {
+      bb_temp.bitset_write_bits(offset_bits,vals[i],low_bits);
+      offset_bits+=low_bits;
+    }
+
+    //Write the unary code in the bit array, the bit array is zeroed so only the ones are written
+    uint64_t prev_high=0;
+    for(uint64_t i=0;i<num_keys;i++)
+    {
+      uint64_t high=vals[i]>>low_bits;
+      offset_bits+=high-prev_high;
+      bb_temp.bitset_write_bits(offset_bits,1,1);
+      offset_bits++;
+      prev_high=high;
+    }
+
+    return ;
+  }
+
+  //calls visit(high, index) for the values of a block in sorted order until visit returns false.
+  //The low bits of the value at an index are read with read_low
+  template <class B,class F>
+  void scan(B &bb_temp,uint64_t num_keys,uint64_t low_bits,F visit)
+  {
+    uint64_t offset_dense_itr=num_keys*low_bits;
+    uint64_t high=0,i=0;
+
+    if(codec==SNARF_CODEC_GOLOMB)
+    {
+      while(i<num_keys)
+      {
+        if(bb_temp.bitset_read_bit(offset_dense_itr,1))
+        {
+          if(!visit(high,i))
+          {
+            return ;
+          }
+          i++;
+        }
+        else
+        {
+          high++;
+        }
+        offset_dense_itr++;
+      }
+      return ;
+    }
+
+    //decode the unary section a byte at a time
+    while(i<num_keys)
+    {
+      uint64_t byte=bb_temp.bitset_read_word(offset_dense_itr,8);
+      int ones=rice_lut.num_ones[byte];
+      for(int k=0;k<ones && i<num_keys;k++)
+      {
+        if(!visit(high+rice_lut.zeros_before[byte][k],i))
+        {
+          return ;
+        }
+        i++;
+      }
+      high+=8-ones;
+      offset_dense_itr+=8;
+    }
+
+    return ;
+  }
+
+  //reads the low bits of the value at an index(var index)
+  template <class B>
+  uint64_t read_low(B &bb_temp,uint64_t index,uint64_t low_bits)
+  {
+    return bb_temp.bitset_read_bits(index*low_bits,low_bits);
+  }
+
+  //decodes all the values of a block into val_list
+  template <class B>
+  void decode(B &bb_temp,uint64_t num_keys,uint64_t low_bits,vector<uint64_t> &val_list)
+  {
+    val_list.resize(0);
+    scan(bb_temp,num_keys,low_bits,[&](uint64_t high,uint64_t i){
+      val_list.push_back((high<<low_bits)|read_low(bb_temp,i,low_bits));
+      return true;
+    });
+    return ;
+  }
+
+  //checks if there is a value in a block that is between low_val and upper_val
+  template <class B>
+  bool range_query(B &bb_temp,uint64_t num_keys,uint64_t low_bits,uint64_t low_val,uint64_t upper_val)
+  {
+    bool found=false;
+    scan(bb_temp,num_keys,low_bits,[&](uint64_t high,uint64_t i){
+      //values are sorted, nothing left in the range
+      if((high<<low_bits)>upper_val)
+      {
+        return false;
+      }
+      if(((high+1)<<low_bits)>low_val)
+      {
+        uint64_t temp=(high<<low_bits)|read_low(bb_temp,i,low_bits);
+        if(temp>=low_val && temp<=upper_val)
+        {
+          found=true;
+          return false;
+        }
+      }
+      return true;
+    });
+    return found;
+  }
+
+  //checks if a value(var val) is in a block. The unary section is read a word at a time: words holding only
+  //smaller high parts are skipped with a popcount, and only the values with the high part of val have their low bits read
+  template <class B>
+  bool contains(B &bb_temp,uint64_t num_keys,uint64_t low_bits,uint64_t val)
+  {
+    uint64_t target_high=val>>low_bits;
+    uint64_t target_low=val-(target_high<<low_bits);
+    uint64_t offset=num_keys*low_bits;
+    uint64_t high=0,i=0;
+
+    while(i<num_keys)
+    {
+      uint64_t word=bb_temp.bitset_read_word(offset,64);
+      uint64_t ones=__builtin_popcountll(word);
+
+      //every value of the word is below val
+      if(high+(64-ones)<target_high)
+      {
+        high+=64-ones;
+        i+=ones;
+        offset+=64;
+        continue;
+      }
+
+      uint64_t zeros_before=0,prev_pos=0;
+      while(word!=0 && i<num_keys)
+      {
+        uint64_t pos=__builtin_ctzll(word);
+        zeros_before+=pos-prev_pos;
+        prev_pos=pos+1;
+        word&=word-1;
+
+        uint64_t curr_high=high+zeros_before;
+        if(curr_high>target_high)
+        {
+          return false;
+        }
+        if(curr_high==target_high && read_low(bb_temp,i,low_bits)==target_low)
+        {
+          return true;
+        }
+        i++;
+      }
+      high+=64-ones;
+      offset+=64;
+    }
+    return false;
+  }
+
+  //counts the values in a block that are between low_val and upper_val
+  template <class B>
+  uint64_t count(B &bb_temp,uint64_t num_keys,uint64_t low_bits,uint64_t low_val,uint64_t upper_val)
+  {
+    uint64_t ans=0;
+    scan(bb_temp,num_keys,low_bits,[&](uint64_t high,uint64_t i){
+      if((high<<low_bits)>upper_val)
+      {
+        return false;
+      }
+      if(((high+1)<<low_bits)>low_val)
+      {
+        uint64_t temp=(high<<low_bits)|read_low(bb_temp,i,low_bits);
+        if(temp>=low_val && temp<=upper_val)
+        {
+          ans++;
+        }
+      }
+      return true;
+    });
+    return ans;
+  }
+
+};
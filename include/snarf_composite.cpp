@@ -0,0 +1,359 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include <deque>
+
+using namespace std;
+
+#include "snarf_hash.cpp"
+
+// Ways to linearize a two dimensional key (first, second) into a 64 bit key
+// SNARF_LAYOUT_PREFIX : first in the high bits, second in the low second_bits bits, e.g. (tenant_id, timestamp).
+//                       A query decomposes into one range per value of first
+// SNARF_LAYOUT_MORTON : both dimensions are interleaved (Z-order), first on the odd bits. Both parts of a key
+//                       must fit in 32 bits. A query decomposes into the Z-order intervals of the quadtree cells covering the box
+enum snarf_composite_layout
+{
+  SNARF_LAYOUT_PREFIX=0,
+  SNARF_LAYOUT_MORTON=1
+};
+
+//SNARF for composite keys (first, second), built as a single filter over the linearized keys.
+//Box queries [first_lo, first_hi] x [second_lo, second_hi] are decomposed into at most max_ranges one dimensional
+//range queries. When the exact decomposition needs more ranges, neighbouring ranges are merged into covering ranges,
+//which keeps the answer free of false negatives at the cost of more false positives.
+struct snarf_composite_hash
+{
+  snarf_updatable_gcs_hash<uint64_t> snarf_instance;
+
+  int layout;
+  //number of bits of the second dimension in SNARF_LAYOUT_PREFIX
+  int second_bits;
+  //cap on the number of one dimensional ranges per query
+  int max_ranges;
+
+  snarf_composite_hash(){
+    layout=SNARF_LAYOUT_PREFIX;
+    second_bits=32;
+    max_ranges=16;
+  }
+
+  //spreads the low 32 bits of a value onto the even bits
+  static uint64_t spread_bits(uint64_t x)
+  {
+    x&=0xFFFFFFFFULL;
+    x=(x|(x<<16))&0x0000FFFF0000FFFFULL;
+    x=(x|(x<<8))&0x00FF00FF00FF00FFULL;
+    x=(x|(x<<4))&0x0F0F0F0F0F0F0F0FULL;
+    x=(x|(x<<2))&0x3333333333333333ULL;
+    x=(x|(x<<1))&0x5555555555555555ULL;
+    return x;
+  }
+
+  //maps a composite key to its 64 bit key
+  uint64_t linearize(uint64_t first,uint64_t second)
+  {
+    if(layout==SNARF_LAYOUT_MORTON)
+    {
+      return (spread_bits(first)<<1)|spread_bits(second);
+    }
+
+    if(second_bits>=64)
+    {
+      return second;
+    }
+    return (first<<second_bits)|(second&(((uint64_t)1<<second_bits)-1));
+  }
+
+  //returns true if linearize keeps every bit of a composite key: 32 bits per part in SNARF_LAYOUT_MORTON,
+  //64-second_bits bits of first and second_bits bits of second in SNARF_LAYOUT_PREFIX
+  bool key_fits(uint64_t first,uint64_t second)
+  {
+    if(layout==SNARF_LAYOUT_MORTON)
+    {
+      return (first>>32)==0 && (second>>32)==0;
+    }
+    if(second_bits>=64)
+    {
+      return first==0;
+    }
+    if(second_bits<=0)
+    {
+      return second==0;
+    }
+    return (first>>(64-second_bits))==0 && (second>>second_bits)==0;
+  }
+
+  //a key that lost bits in linearize would be stored under another key, and missed by queries, which clip their
+  //bounds to the same widths
+  void check_key_fits(uint64_t first,uint64_t second)
+  {
+    bool testbool = key_fits(first,second);
+    assert(("The key does not fit the layout (32 bits per part in SNARF_LAYOUT_MORTON, second_bits bits of second and 64-second_bits bits of first in SNARF_LAYOUT_PREFIX)!", testbool));
+    return ;
+  }
+
+  //initialize snarf over composite keys, firsts[i] and seconds[i] are the two parts of the i-th key
+  void snarf_init(vector<uint64_t> &firsts,vector<uint64_t> &seconds,double bits_per_key,int num_ele_per_block,int num_hash_bits)
+  {
+    bool testbool = (firsts.size()==seconds.size());
+    assert(("Both parts of every key are needed!", testbool));
+
+    vector<uint64_t> keys(firsts.size());
+    for(int i=0;i<firsts.size();i++)
+    {
+      check_key_fits(firsts[i],seconds[i]);
+      keys[i]=linearize(firsts[i],seconds[i]);
+    }
+    snarf_instance.snarf_init(keys,bits_per_key,num_ele_per_block,num_hash_bits);
+    return ;
+  }
+
+  //merges a sorted list of ranges down to max_ranges covering ranges, closing the smallest gaps first
+  void cap_ranges(vector<pair<uint64_t,uint64_t>> &ranges)
+  {
+    while(ranges.size()>max_ranges && ranges.size()>1)
+    {
+      int best=0;
+      for(int i=1;i+1<ranges.size();i++)
+      {
+        if(ranges[i+1].first-ranges[i].second<ranges[best+1].first-ranges[best].second)
+        {
+          best=i;
+        }
+      }
+      ranges[best].second=ranges[best+1].second;
+      ranges.erase(ranges.begin()+best+1);
+    }
+    return ;
+  }
+
+  //decomposes the box into sorted, disjoint one dimensional ranges in SNARF_LAYOUT_PREFIX
+  void decompose_prefix(uint64_t first_lo,uint64_t first_hi,uint64_t second_lo,uint64_t second_hi,vector<pair<uint64_t,uint64_t>> &ranges)
+  {
+    //more values of first than ranges, split them in max_ranges groups
+    uint64_t num_firsts=first_hi-first_lo+1;
+    uint64_t group=1;
+    if(num_firsts==0 || num_firsts>max_ranges)
+    {
+      group=(num_firsts==0)?UINT64_MAX:(num_firsts+max_ranges-1)/max_ranges;
+    }
+
+    uint64_t curr=first_lo;
+    while(true)
+    {
+      uint64_t last=(first_hi-curr<group)?first_hi:curr+group-1;
+      uint64_t lower=linearize(curr,second_lo),upper=linearize(last,second_hi);
+
+      //ranges of consecutive values of first touch when the second dimension is not restricted
+      if(ranges.size()>0 && ranges.back().second+1==lower)
+      {
+        ranges.back().second=upper;
+      }
+      else
+      {
+        ranges.push_back(make_pair(lower,upper));
+      }
+
+      if(last==first_hi)
+      {
+        break;
+      }
+      curr=last+1;
+    }
+    return ;
+  }
+
+  //decomposes the box into sorted, disjoint one dimensional ranges in SNARF_LAYOUT_MORTON.
+  //Quadtree cells are split while the number of ranges stays under max_ranges,
+  //cells that are still partially covered after that are queried whole
+  void decompose_morton(uint64_t first_lo,uint64_t first_hi,uint64_t second_lo,uint64_t second_hi,vector<pair<uint64_t,uint64_t>> &ranges)
+  {
+    first_lo=min(first_lo,(uint64_t)0xFFFFFFFFULL);
+    first_hi=min(first_hi,(uint64_t)0xFFFFFFFFULL);
+    second_lo=min(second_lo,(uint64_t)0xFFFFFFFFULL);
+    second_hi=min(second_hi,(uint64_t)0xFFFFFFFFULL);
+
+    //a cell is its corner and its level, it covers 2^level values of each dimension and 4^level Z-order values
+    struct cell
+    {
+      uint64_t first,second;
+      int level;
+    };
+
+    auto z_interval=[&](cell &c){
+      uint64_t lower=linearize(c.first,c.second);
+      uint64_t size_mask=(c.level>=32)?UINT64_MAX:(((uint64_t)1<<(2*c.level))-1);
+      return make_pair(lower,lower|size_mask);
+    };
+
+    //cells are split largest first, a split is only done when the ranges still fit in max_ranges afterwards
+    deque<cell> partial;
+    partial.push_back({0,0,32});
+
+    while(partial.size()>0 && partial.front().level>0)
+    {
+      cell curr=partial.front();
+      int level=curr.level-1;
+      uint64_t side=(uint64_t)1<<level;
+
+      vector<cell> children_full,children_partial;
+      for(int j=0;j<4;j++)
+      {
+        cell child={curr.first+((j>>1)&1)*side,curr.second+(j&1)*side,level};
+        uint64_t child_first_hi=child.first+side-1,child_second_hi=child.second+side-1;
+
+        //disjoint from the box
+        if(child.first>first_hi || child_first_hi<first_lo || child.second>second_hi || child_second_hi<second_lo)
+        {
+          continue;
+        }
+
+        //inside the box
+        if(child.first>=first_lo && child_first_hi<=first_hi && child.second>=second_lo && child_second_hi<=second_hi)
+        {
+          children_full.push_back(child);
+        }
+        else
+        {
+          children_partial.push_back(child);
+        }
+      }
+
+      if(ranges.size()+partial.size()-1+children_full.size()+children_partial.size()>max_ranges)
+      {
+        break;
+      }
+
+      partial.pop_front();
+      for(int j=0;j<children_full.size();j++)
+      {
+        ranges.push_back(z_interval(children_full[j]));
+      }
+      for(int j=0;j<children_partial.size();j++)
+      {
+        partial.push_back(children_partial[j]);
+      }
+    }
+
+    for(int i=0;i<partial.size();i++)
+    {
+      ranges.push_back(z_interval(partial[i]));
+    }
+
+    //every key in the box is between the Z-order values of its corners
+    uint64_t z_lo=linearize(first_lo,second_lo),z_hi=linearize(first_hi,second_hi);
+    sort(ranges.begin(),ranges.end());
+
+    vector<pair<uint64_t,uint64_t>> merged;
+    for(int i=0;i<ranges.size();i++)
+    {
+      uint64_t lower=max(ranges[i].first,z_lo),upper=min(ranges[i].second,z_hi);
+      if(lower>upper)
+      {
+        continue;
+      }
+      if(merged.size()>0 && merged.back().second+1>=lower)
+      {
+        merged.back().second=max(merged.back().second,upper);
+      }
+      else
+      {
+        merged.push_back(make_pair(lower,upper));
+      }
+    }
+    ranges.swap(merged);
+    return ;
+  }
+
+  //decomposes the box into at most max_ranges sorted one dimensional ranges
+  void decompose(uint64_t first_lo,uint64_t first_hi,uint64_t second_lo,uint64_t second_hi,vector<pair<uint64_t,uint64_t>> &ranges)
+  {
+    ranges.resize(0);
+    if(first_lo>first_hi || second_lo>second_hi)
+    {
+      return ;
+    }
+
+    if(layout==SNARF_LAYOUT_MORTON)
+    {
+      decompose_morton(first_lo,first_hi,second_lo,second_hi,ranges);
+    }
+    else
+    {
+      //clip the box to the values each part can take
+      if(second_bits<64)
+      {
+        second_hi=min(second_hi,((uint64_t)1<<second_bits)-1);
+      }
+      if(second_bits>=64)
+      {
+        first_hi=0;
+      }
+      else if(second_bits>0)
+      {
+        first_hi=min(first_hi,UINT64_MAX>>second_bits);
+      }
+      if(first_lo>first_hi || second_lo>second_hi)
+      {
+        return ;
+      }
+      decompose_prefix(first_lo,first_hi,second_lo,second_hi,ranges);
+    }
+    cap_ranges(ranges);
+    return ;
+  }
+
+  //checks if there is a key in the box [first_lo, first_hi] x [second_lo, second_hi]
+  bool range_query(uint64_t first_lo,uint64_t first_hi,uint64_t second_lo,uint64_t second_hi)
+  {
+    vector<pair<uint64_t,uint64_t>> ranges;
+    decompose(first_lo,first_hi,second_lo,second_hi,ranges);
+
+    for(int i=0;i<ranges.size();i++)
+    {
+      if(snarf_instance.range_query(ranges[i].first,ranges[i].second))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //checks if there is a key with first part first and second part in [second_lo, second_hi]
+  bool prefix_range_query(uint64_t first,uint64_t second_lo,uint64_t second_hi)
+  {
+    return range_query(first,first,second_lo,second_hi);
+  }
+
+  //keys that do not fit the layout cannot be stored
+  bool contains(uint64_t first,uint64_t second)
+  {
+    if(!key_fits(first,second))
+    {
+      return false;
+    }
+    return snarf_instance.contains(linearize(first,second));
+  }
+
+  void insert_key(uint64_t first,uint64_t second)
+  {
+    check_key_fits(first,second);
+    snarf_instance.insert_key(linearize(first,second));
+    return ;
+  }
+
+  void delete_key(uint64_t first,uint64_t second)
+  {
+    check_key_fits(first,second);
+    snarf_instance.delete_key(linearize(first,second));
+    return ;
+  }
+
+  //returns the space used by the composite snarf in bytes
+  uint64_t return_size()
+  {
+    return snarf_instance.return_size()+sizeof(layout)+sizeof(second_bits)+sizeof(max_ranges);
+  }
+
+};
@@ -1,3 +1,6 @@
+#ifndef SNARF_HASH_CPP
+#define SNARF_HASH_CPP
+
 #include<iostream>
 #include<algorithm>
 #include<cmath>
@@ -9,14 +12,67 @@
 #include <cstring>
 
 #include <functional>
+#include <queue>
 
 
 using namespace std;
 using namespace std::chrono; 
 
 #include "snarf_model.cpp"
-#include "snarf_bitset.cpp"
+#include "snarf_codec.cpp"
 #include "bloom_filter.cpp"
+#include "cuckoo_filter.cpp"
+#include "snarf_cache.cpp"
+#include "snarf_image.cpp"
+#include "snarf_tuning.cpp"
+#include "snarf_stats.cpp"
+
+// Structure of the hash filter that verifies point queries
+// SNARF_VERIFY_BLOOM  : bloom filter, deleted keys stay in it
+// SNARF_VERIFY_CUCKOO : cuckoo filter, delete_key removes the key
+enum snarf_verification_mode
+{
+  SNARF_VERIFY_BLOOM=0,
+  SNARF_VERIFY_CUCKOO=1
+};
+
+//A class of queries in the expected query mix: the fraction of the queries in the class and the width of their range
+//(upper-lower, 0 for point queries)
+struct snarf_query_class
+{
+  double fraction;
+  double width;
+};
+
+//Split of a memory budget between the bit blocks and the hash filter, with the FPR predicted for the query mix
+struct snarf_budget_plan
+{
+  uint64_t bit_size;
+  double golomb_bits_per_key;
+  double hash_bits_per_key;
+  int num_hash_functions;
+  double predicted_fpr;
+};
+
+//Position of a merge pass in the bit blocks of one of the merged snarf instances
+struct snarf_merge_cursor
+{
+  int64_t block_index=-1;
+  vector<uint64_t> block_vals;
+  uint64_t pos=0;
+  bool started=false;
+
+  //entries of the merged snarf waiting to be written, smallest first
+  priority_queue<uint64_t,vector<uint64_t>,greater<uint64_t>> pending;
+
+  //locations in the merged snarf of the next entry of the source, and its fingerprint
+  bool has_next=false;
+  uint64_t next_lower=0,next_upper=0,next_fingerprint=0;
+
+  //last location read from the source, repeated locations map to the same locations
+  bool has_last=false;
+  uint64_t last_source_loc=0;
+};
 
 //SNARF implementation which is updatable(handles deletes and inserts) and uses Golomb Coding(GCS)
 template <class T>
@@ -24,18 +80,63 @@ struct snarf_updatable_gcs_hash
 {
   //Snarf model
   snarf_model<T> rmi;
+  //stores the model in its compact encoding(see snarf_model::compress)
+  bool compact_model=false;
 
-  //snarf bit array
-  vector< snarf_bitset > bb_bitset_vec;
+  //snarf bit array. The blocks are stored back to back in groups of blocks_per_group blocks, one bitset per group,
+  //and a block starts at a byte offset(block_offset) inside its group. Rewriting a block only moves the blocks after it
+  //in the same group, and a block costs 5 bytes of directory instead of a bitset object and its own heap allocation
+  vector< snarf_bitset > block_groups;
+  vector<uint16_t> block_offset;
+  uint64_t blocks_per_group=1;
 
   //Parameters used in snarf
   uint64_t N,P,block_size,bit_size,total_blocks;
   uint64_t gcs_size;
 
+  //number of keys currently stored, N is the number of keys the filter was built with
+  uint64_t num_stored_keys;
+  //smallest and largest key ever stored, deletes do not shrink the range
+  T min_stored_key,max_stored_key;
+
   unordered_map<uint64_t, uint64_t> map_hash;
 
-  //Stores the number of keys in each bit array block
-  vector<int> vec_num_keys;
+  //Stores the number of keys in each bit array block, spilled_block marks a block stored in spilled_blocks
+  vector<uint16_t> vec_num_keys;
+  //Blocks too large for their group with their number of keys, e.g. the last block after a run of inserts past the
+  //largest key. Their range in the group is empty
+  static const uint16_t spilled_block=UINT16_MAX;
+  unordered_map<uint64_t, pair<uint64_t,snarf_bitset>> spilled_blocks;
+
+  //Encoding of the bit array blocks, and the number of low bits used by each block
+  snarf_block_codec block_codec;
+  //bits of key fingerprint stored below the location in each entry, an entry is (location<<fingerprint_bits)|fingerprint.
+  //With fingerprints, point verification reads the block being searched instead of the hash filter, and deletes remove
+  //the fingerprint of the deleted key
+  uint64_t fingerprint_bits=0;
+  vector<uint8_t> block_low_bits;
+
+  //Optional cache of range query results, see enable_range_cache
+  snarf_range_cache range_cache;
+
+  //Optional samples of the range queries, see enable_query_sampling and retune
+  snarf_query_sampler query_sampler;
+
+  //Optional counts of positives and reported false positives, see enable_fpr_stats
+  snarf_fpr_stats fpr_stats;
+
+  //Blocks changed by inserts and deletes since the last take_dirty_blocks, tracked when track_dirty_blocks is set.
+  //Used by incremental checkpoints (see snarf_persist.cpp)
+  bool track_dirty_blocks=false;
+  vector<char> block_dirty;
+  vector<uint64_t> dirty_blocks;
+
+  //Fenwick tree over the number of keys of each run of count_tree_span blocks, kept up to date by set_encoded_block.
+  //With the key counts of vec_num_keys for the partial runs at the edges, gives the number of keys in any run of blocks
+  //in O(log blocks), used by range queries and range counts spanning more than two blocks. Costs 8 bytes per
+  //count_tree_span blocks
+  static const uint64_t count_tree_span=16;
+  vector<uint64_t> block_count_tree;
   
 
   //Used for Inference
@@ -50,8 +151,14 @@ struct snarf_updatable_gcs_hash
   double query_cdf1,query_cdf2=0.0;
 
 
-  hash<T> hasher; // new1
   BloomFilter bf; // For storing the hash values
+  bool use_hash_filter;
+  //hash filters of merged snarf instances that could not be folded into bf
+  vector<BloomFilter> bf_merged;
+  //the hash filter is cf instead of bf in SNARF_VERIFY_CUCKOO, with the filters of merged snarf instances in cf_merged
+  int verification_mode=SNARF_VERIFY_BLOOM;
+  CuckooFilter cf;
+  vector<CuckooFilter> cf_merged;
 
   //Name of snarf instance
   char name_curr;
@@ -63,13 +170,33 @@ struct snarf_updatable_gcs_hash
     bit_size=0;
     total_blocks=0;
     gcs_size=0;
+    num_stored_keys=0;
+    use_hash_filter=false;
     name_curr=' ';
   }
 
  
 
 
-  //Get the bit locations of the bits that need to be set to 1
+  //maps an estimated cdf to a bit location between 0 and N*P-1.
+  //The product is done in floating point and clamped, so it cannot wrap for any cdf
+  uint64_t location_from_cdf(double cdf)
+  {
+    uint64_t num_locations=N*P;
+    double temp_loc=floor(cdf*num_locations);
+
+    if(!(temp_loc>0.0))
+    {
+      return 0;
+    }
+    if(temp_loc>=(double)num_locations)
+    {
+      return num_locations-1;
+    }
+    return min(num_locations-1,(uint64_t)temp_loc);
+  }
+
+  //Get the bit locations of the bits that need to be set to 1, as entries with the fingerprints of the keys
   void get_locations(vector<T> &keys,vector<uint64_t> &temp_locations)
   {
     double cdf;
@@ -83,10 +210,8 @@ struct snarf_updatable_gcs_hash
     { 
       cdf=rmi.infer(keys[i]);
       
-      temp_loc=floor(cdf*N*P);
-      temp_loc=max((uint64_t)0,temp_loc);
-      temp_loc=min(N*P-1,temp_loc);
-      temp_locations.push_back(temp_loc);
+      temp_loc=location_from_cdf(cdf);
+      temp_locations.push_back(key_entry(keys[i],temp_loc));
       past_loc=temp_loc;
     }
 
@@ -96,46 +221,221 @@ struct snarf_updatable_gcs_hash
     return ;
   }
 
-  //Create a new bit block(var bb_temp) for a batch of values(curr_batch).
-  void create_new_gcs_block(vector<uint64_t> &curr_batch, snarf_bitset &bb_temp)
+  //selects the encoding of the bit blocks(SNARF_CODEC_GOLOMB, SNARF_CODEC_RICE_LUT or SNARF_CODEC_ELIAS_FANO). Call before snarf_init
+  void set_block_codec(int codec)
+  {
+    block_codec.codec=codec;
+    return ;
+  }
+
+  //stores the model in about 8 bytes per linear model instead of 24 (for 64 bit keys). Call before snarf_init
+  void set_compact_model(bool compact)
+  {
+    compact_model=compact;
+    return ;
+  }
+
+  //selects the structure of the hash filter(SNARF_VERIFY_BLOOM or SNARF_VERIFY_CUCKOO). Call before snarf_init
+  void set_verification_mode(int mode)
   {
-    // resize the bit array for this new batch
-    bb_temp.init((bit_size+1)*curr_batch.size()+block_size);
+    verification_mode=mode;
+    return ;
+  }
 
-    int offset_bits=0;
+  //sets the number of fingerprint bits stored in each entry, 0 stores locations only. Call before snarf_init
+  void set_fingerprint_bits(int num_bits)
+  {
+    bool testbool = (num_bits>=0 && num_bits<=32);
+    assert(("Fingerprints can use 0 to 32 bits!", testbool));
+    fingerprint_bits=num_bits;
+    return ;
+  }
 
-    //Write the binary code in the bit array
-    for(int i=0;i<curr_batch.size();i++)
+  //fingerprint of a key, independent of its location
+  uint64_t key_fingerprint(T key)
+  {
+    if(fingerprint_bits==0)
     {
-      bb_temp.bitset_write_bits(offset_bits,curr_batch[i]%P,bit_size);
-      offset_bits+=bit_size;
+      return 0;
     }
+    return BloomFilter::mix(snarf_key_fold(key)^0x9e3779b97f4a7c15ULL)>>(64-fingerprint_bits);
+  }
+
+  //entry of a key at a location(var loc) inside its block
+  uint64_t key_entry(T key,uint64_t loc)
+  {
+    return (loc<<fingerprint_bits)|key_fingerprint(key);
+  }
+
+  //Sets up an empty directory for a number of blocks(var num_blocks).
+  //Groups hold about 16KB of blocks, so a rewrite moves a few KB at most
+  void init_block_directory(uint64_t num_blocks)
+  {
+    uint64_t block_bytes=(block_size*(bit_size+fingerprint_bits+2)+7)/8;
+    blocks_per_group=max((uint64_t)1,min((uint64_t)64,16384/max((uint64_t)1,block_bytes)));
+
+    block_groups.resize(0);
+    block_groups.resize((num_blocks+blocks_per_group-1)/blocks_per_group);
+    block_offset.assign(num_blocks,0);
+    vec_num_keys.assign(num_blocks,0);
+    block_low_bits.assign(num_blocks,0);
+    block_count_tree.assign((num_blocks+count_tree_span-1)/count_tree_span+1,0);
+    spilled_blocks.clear();
+    range_cache.clear(num_blocks);
+    fpr_stats.set_num_blocks(num_blocks);
+    block_dirty.assign(track_dirty_blocks?num_blocks:0,0);
+    dirty_blocks.resize(0);
+    return ;
+  }
 
-    //Write the unary code in the bit array
-    int delta_zero_count=0,delta_one_count=0;
-    for(int i=0;i<curr_batch.size();i++)
+  //number of keys in a block(var bb_index)
+  uint64_t block_num_keys(uint64_t bb_index)
+  {
+    if(vec_num_keys[bb_index]==spilled_block)
     {
+      return spilled_blocks.find(bb_index)->second.first;
+    }
+    return vec_num_keys[bb_index];
+  }
 
-      uint64_t temp=curr_batch[i];
+  //bit offset of a block(var bb_index) in its group, and the bit offset where the next block starts
+  uint64_t block_begin(uint64_t bb_index)
+  {
+    return (uint64_t)block_offset[bb_index]*8;
+  }
 
-      temp=temp/P;
+  uint64_t block_end(uint64_t bb_index)
+  {
+    if((bb_index+1)%blocks_per_group==0 || bb_index+1==block_offset.size())
+    {
+      return block_groups[bb_index/blocks_per_group].bb_bitset.size();
+    }
+    return (uint64_t)block_offset[bb_index+1]*8;
+  }
 
+  //the bits of a block(var bb_index), as read by the block codec
+  snarf_bitset_view block_view(uint64_t bb_index)
+  {
+    snarf_bitset_view view;
+    if(vec_num_keys[bb_index]==spilled_block)
+    {
+      view.bits=&spilled_blocks.find(bb_index)->second.second;
+      view.base=0;
+      view.num_bits=view.bits->bb_bitset.size();
+      return view;
+    }
+    view.bits=&block_groups[bb_index/blocks_per_group];
+    view.base=block_begin(bb_index);
+    view.num_bits=block_end(bb_index)-view.base;
+    return view;
+  }
 
-      if(temp>delta_zero_count)
-      {
-        bb_temp.bitset_write_bits(offset_bits,0,1);
-        offset_bits++;
-        delta_zero_count++;
-        i--;
-      }
-      else
-      {
-        bb_temp.bitset_write_bits(offset_bits,1,1);
-        offset_bits++;
-      }
+  //Replaces the bits of a block(var bb_index) with an encoded block(var encoded), padded to whole bytes.
+  //The blocks after it in the group are moved and their offsets updated
+  void store_block(snarf_bitset &encoded,uint64_t bb_index)
+  {
+    snarf_bitset &group=block_groups[bb_index/blocks_per_group];
+    uint64_t begin=block_begin(bb_index),end=block_end(bb_index);
+    uint64_t group_bits=group.bb_bitset.size();
+    uint64_t new_bits=(encoded.bb_bitset.size()+7)/8*8;
+
+    if(new_bits>end-begin)
+    {
+      group.bb_bitset.resize(group_bits+new_bits-(end-begin));
+      group.bitset_move(end,begin+new_bits,group_bits-end);
+    }
+    else if(new_bits<end-begin)
+    {
+      group.bitset_move(end,begin+new_bits,group_bits-end);
+      group.bb_bitset.resize(group_bits-(end-begin-new_bits));
+    }
+
+    //bits past the end of the encoded block are read as 0, which fills the padding
+    for(uint64_t done=0;done<new_bits;done+=64)
+    {
+      uint64_t chunk=min((uint64_t)64,new_bits-done);
+      group.bitset_write_word(begin+done,encoded.bitset_read_word(done,chunk),chunk);
+    }
+
+    uint64_t group_end=min((uint64_t)block_offset.size(),(bb_index/blocks_per_group+1)*blocks_per_group);
+    for(uint64_t i=bb_index+1;i<group_end;i++)
+    {
+      uint64_t next_offset=(uint64_t)block_offset[i]+new_bits/8-(end-begin)/8;
+      bool testbool = (next_offset<=UINT16_MAX);
+      assert(("A group of blocks is too large for 16 bit block offsets!", testbool));
+      block_offset[i]=next_offset;
+    }
+    return ;
+  }
+
+  //Create a new bit block at certain index(var bb_index) for a batch of values(curr_batch).
+  void create_new_gcs_block(vector<uint64_t> &curr_batch, int bb_index)
+  {
+    uint64_t low_bits=block_codec.choose_low_bits(curr_batch,bit_size+fingerprint_bits);
+    snarf_bitset encoded;
+    block_codec.encode(curr_batch,low_bits,encoded);
+    set_encoded_block(encoded,low_bits,curr_batch.size(),bb_index);
+
+    return ;
+  }
+
+  //Replaces a block(var bb_index) with an encoded block of var num_keys values with var low_bits low bits.
+  //A block larger than its share of the 16 bit offsets of a group is spilled
+  void set_encoded_block(snarf_bitset &encoded,uint64_t low_bits,uint64_t num_keys,uint64_t bb_index)
+  {
+    block_low_bits[bb_index]=low_bits;
+    add_block_count(bb_index,num_keys-block_num_keys(bb_index));
+
+    if(num_keys>=spilled_block || encoded.return_size()>UINT16_MAX/blocks_per_group)
+    {
+      vec_num_keys[bb_index]=spilled_block;
+      pair<uint64_t,snarf_bitset> &spilled=spilled_blocks[bb_index];
+      spilled.first=num_keys;
+      spilled.second.bb_bitset.swap(encoded.bb_bitset);
+      encoded.bb_bitset.resize(0);
+      store_block(encoded,bb_index);
+      return ;
+    }
+
+    if(vec_num_keys[bb_index]==spilled_block)
+    {
+      spilled_blocks.erase(bb_index);
+    }
+    vec_num_keys[bb_index]=num_keys;
+    store_block(encoded,bb_index);
+
+    return ;
+  }
+
+  //starts tracking the blocks changed by inserts and deletes
+  void enable_dirty_tracking()
+  {
+    track_dirty_blocks=true;
+    block_dirty.assign(vec_num_keys.size(),0);
+    dirty_blocks.resize(0);
+    return ;
+  }
 
+  void mark_block_dirty(uint64_t bb_index)
+  {
+    if(track_dirty_blocks && !block_dirty[bb_index])
+    {
+      block_dirty[bb_index]=1;
+      dirty_blocks.push_back(bb_index);
     }
+    return ;
+  }
 
+  //moves the sorted list of blocks changed since the last call into var blocks
+  void take_dirty_blocks(vector<uint64_t> &blocks)
+  {
+    blocks.swap(dirty_blocks);
+    dirty_blocks.resize(0);
+    sort(blocks.begin(),blocks.end());
+    for(int i=0;i<blocks.size();i++)
+    {
+      block_dirty[blocks[i]]=0;
+    }
     return ;
   }
 
@@ -145,14 +445,16 @@ struct snarf_updatable_gcs_hash
   uint64_t build_bb(vector<uint64_t> &temp_locations)
   {
     vector<uint64_t> curr_batch;
-    uint64_t num_batches=ceil(temp_locations.size()*1.00/block_size);
+    //the blocks cover the N*P locations, the number of entries differs from N once keys are inserted or deleted
+    uint64_t num_batches=ceil(N*1.00/block_size);
 
     uint64_t curr_index=0;
     uint64_t total_bits_used=0;
     uint64_t curr_size=0;
 
+    init_block_directory(num_batches);
 
-    for(int i=0;i<num_batches;i++)
+    for(uint64_t i=0;i<num_batches;i++)
     {
       curr_batch.resize(0);
 
@@ -160,15 +462,13 @@ struct snarf_updatable_gcs_hash
       uint64_t lower=(i*block_size*P);
       uint64_t upper=((i+1)*block_size*P);
 
-      while(j<temp_locations.size() && lower<=temp_locations[j] && temp_locations[j]<upper )
+      while(j<temp_locations.size() && lower<=(temp_locations[j]>>fingerprint_bits) && (temp_locations[j]>>fingerprint_bits)<upper )
       {
-        curr_batch.push_back(temp_locations[j]-lower);
+        curr_batch.push_back(temp_locations[j]-(lower<<fingerprint_bits));
         j++;
       }
       curr_index=j;
-      create_new_gcs_block(curr_batch,bb_bitset_vec[i]);
-
-      vec_num_keys.push_back(curr_batch.size());
+      create_new_gcs_block(curr_batch,i);
 
     }
 
@@ -180,7 +480,8 @@ struct snarf_updatable_gcs_hash
 
   
   //initialize snarf 
-  void snarf_init(vector<T> &keys,double bits_per_key,int num_ele_per_block, int num_hash_bits)
+  //num_hash_functions is the number of hash functions of the hash filter
+  void snarf_init(vector<T> &keys,double bits_per_key,int num_ele_per_block, double num_hash_bits,int num_hash_functions=10)
   {
 
     bool testbool = (bits_per_key>3);
@@ -192,18 +493,25 @@ struct snarf_updatable_gcs_hash
     bit_size=ceil(log2(1.00/target_fpr));
     block_size=num_ele_per_block;
     total_blocks=ceil(N*1.00/block_size);
-    bb_bitset_vec.resize(total_blocks);
     
     //build snarf model
+    int keys_per_model=rmi.keys_per_model;
     rmi=snarf_model<T>();
+    rmi.keys_per_model=keys_per_model;
     rmi.snarf_model_builder(keys);
+    if(compact_model)
+    {
+      rmi.compress();
+    }
 
     N=keys.size();
     P=pow(2,ceil(log2(1.00/target_fpr)));
     bit_size=ceil(log2(1.00/target_fpr));
     block_size=num_ele_per_block;
     total_blocks=ceil(N*1.00/block_size);
-    bb_bitset_vec.resize(total_blocks);
+
+    testbool = (bit_size+fingerprint_bits<63 && N<=(UINT64_MAX>>(bit_size+fingerprint_bits)));
+    assert(("Too many keys for the number of bits per key, the bit locations do not fit in 64 bits!", testbool));
 
     //Get bit locations of set bits
     vector<uint64_t> temp_locations;
@@ -211,287 +519,1218 @@ struct snarf_updatable_gcs_hash
 
     //Build bit blocks using the set bit location values
     gcs_size=build_bb(temp_locations);
+    num_stored_keys=N;
+    if(N>0)
+    {
+      min_stored_key=*min_element(keys.begin(),keys.end());
+      max_stored_key=*max_element(keys.begin(),keys.end());
+    }
     
-    bf.BloomFilter_init(num_hash_bits * keys.size(), 10);
-    for(int i = 0; i < keys.size(); i++) {
-      bf.add(keys[i]);
+    //num_hash_bits=0 builds snarf without the hash filter
+    use_hash_filter = (num_hash_bits > 0);
+    cf_merged.resize(0);
+    bf_merged.resize(0);
+    if(use_hash_filter && verification_mode==SNARF_VERIFY_CUCKOO) {
+      //the cuckoo filter is 90% full, so num_hash_bits bits per key hold fingerprints of 0.9*num_hash_bits bits
+      cf.CuckooFilter_init(keys.size(), max(1, (int)floor(num_hash_bits * 0.9)));
+      for(int i = 0; i < keys.size(); i++) {
+        cf.add(snarf_key_fold(keys[i]));
+      }
+    }
+    else if(use_hash_filter) {
+      bf.BloomFilter_init(ceil(num_hash_bits * keys.size()), num_hash_functions);
+      for(int i = 0; i < keys.size(); i++) {
+        bf.add(snarf_key_fold(keys[i]));
+      }
     }
     return ;
   }
 
 
-  //Inserts a value(var val) into bit block at certain index(var bb_index)
-  //Current implementation is not performant.
-  // It simply read the block to get a list of values and adds the new value to this list. Then created a new value for this list
-  void  insert_in_block(uint64_t val,int bb_index)
+  //Decodes all the entries stored in the bit block at certain index(var bb_index) into val_list, in sorted order
+  void decode_block_entries(int bb_index,vector<uint64_t> &val_list)
   {
-    
-    int num_keys=vec_num_keys[bb_index];
-    int delta_zero_count=0,delta_one_count=0;
-    int offset_dense_itr=num_keys*bit_size,offset_sparse_itr=0;
+    snarf_bitset_view block=block_view(bb_index);
+    block_codec.decode(block,block_num_keys(bb_index),block_low_bits[bb_index],val_list);
+    return ;
+  }
 
-    int bit_val;
-    uint64_t temp;
-    vector<uint64_t> val_list;
-    for(int i=0;i<num_keys;i++)
+  //Decodes the locations stored in the bit block at certain index(var bb_index) into val_list, in sorted order
+  void decode_block(int bb_index,vector<uint64_t> &val_list)
+  {
+    decode_block_entries(bb_index,val_list);
+    if(fingerprint_bits>0)
     {
-      bit_val=bb_bitset_vec[bb_index].bitset_read_bit(offset_dense_itr,1);
-      
-      if(bit_val==0)
-      {
-        delta_zero_count++;
-        offset_dense_itr++;
-        i--;
-      }
-      else
+      for(int i=0;i<val_list.size();i++)
       {
-        temp=delta_zero_count*P+bb_bitset_vec[bb_index].bitset_read_bits(offset_sparse_itr,bit_size);
-        val_list.push_back(temp);
-        offset_dense_itr++;
-        offset_sparse_itr+=bit_size;
+        val_list[i]>>=fingerprint_bits;
       }
     }
-
-    val_list.push_back(val);
-    sort(val_list.begin(),val_list.end());
-
-    vec_num_keys[bb_index]++;
-    create_new_gcs_block(val_list,bb_bitset_vec[bb_index]);
-    
-
     return ;
+  }
 
+  //predicted FPR of an empty query of width(var width) over keys with local density(var density, keys per unit of the key domain),
+  //for bit locations of bit_size bits and a hash filter with false positive rate hash_fpr.
+  //An empty range only holds the locations of its neighbouring keys when they share an endpoint location, about 1/P of the time.
+  //The hash filter checks the keys of the range one by one while they map to the first location, so it only helps
+  //queries that span about one location (a query spans 1+width*density*P locations)
+  static double predict_query_fpr(double width,double density,uint64_t bit_size,double hash_fpr)
+  {
+    double num_locations=pow(2.0,bit_size);
+    double spanned=1.0+width*density*num_locations;
+    double golomb_fpr=min(1.0,1.0/num_locations);
+    if(spanned<2.0)
+    {
+      return golomb_fpr*min(1.0,(width+1.0)*hash_fpr);
+    }
+    return golomb_fpr;
   }
 
-  //Deletes a value(var val) from a bit block at certain index(var bb_index)
-  //Current implementation is not performant.
-  // It simply read the block to get a list of values and removes the value from this list. Then created a new value for this list
-  void  delete_from_block(uint64_t val,int bb_index)
+  //false positive rate of a bloom filter with var bits_per_key bits per key and var num_hash_functions hash functions
+  static double predict_hash_fpr(double bits_per_key,int num_hash_functions)
   {
-    int num_keys=vec_num_keys[bb_index];
-    int delta_zero_count=0,delta_one_count=0;
-    int offset_dense_itr=num_keys*bit_size,offset_sparse_itr=0;
+    if(bits_per_key<=0.0 || num_hash_functions<=0)
+    {
+      return 1.0;
+    }
+    return pow(1.0-exp(-num_hash_functions/bits_per_key),num_hash_functions);
+  }
 
-    int bit_val;
-    uint64_t temp;
-    int done=0;
-    vector<uint64_t> val_list;
-    for(int i=0;i<num_keys;i++)
+  //splits a budget of total_bits_per_key bits per key between the bit blocks and the hash filter, picking the
+  //bits per location and the number of hash functions that minimize the FPR predicted for the query mix(var query_mix).
+  //The local key density around the queries is measured on a sample of the keys.
+  //A block costs bit_size bits per key for the binary section, about 2 bits per key for the unary section,
+  //5 bytes for its directory entry and its share of the block count tree, as counted by return_size
+  snarf_budget_plan plan_bit_budget(vector<T> &keys,double total_bits_per_key,int num_ele_per_block,vector<snarf_query_class> &query_mix)
+  {
+    vector<T> sorted_keys=keys;
+    sort(sorted_keys.begin(),sorted_keys.end());
+
+    //density between the neighbours 8 keys away of sampled keys
+    vector<double> densities;
+    uint64_t num_keys=sorted_keys.size();
+    uint64_t num_samples=min((uint64_t)1000,num_keys);
+    for(uint64_t i=0;i<num_samples && num_keys>16;i++)
     {
-      bit_val=bb_bitset_vec[bb_index].bitset_read_bit(offset_dense_itr,1);
-      
-      if(bit_val==0)
+      uint64_t index=8+(num_keys-16)*i/num_samples;
+      double gap=(double)snarf_key_distance(sorted_keys[index+8],sorted_keys[index-8]);
+      densities.push_back(gap>0.0?16.0/gap:1.0);
+    }
+    if(densities.size()==0)
+    {
+      densities.push_back(1.0);
+    }
+
+    double block_bits=8.0*(2*sizeof(uint16_t)+sizeof(uint8_t))+8.0*sizeof(uint64_t)/count_tree_span;
+    double golomb_overhead=2.0+block_bits/num_ele_per_block;
+    snarf_budget_plan best={1,1.0+golomb_overhead,0.0,0,2.0};
+
+    for(uint64_t g=1;g<=40;g++)
+    {
+      double golomb_bits=g+golomb_overhead;
+      if(golomb_bits>total_bits_per_key && g>1)
       {
-        delta_zero_count++;
-        offset_dense_itr++;
-        i--;
+        break;
       }
-      else
+      double hash_bits=max(0.0,total_bits_per_key-golomb_bits);
+
+      for(int k=0;k<=(hash_bits>0.0?16:0);k++)
       {
-        
-        temp=delta_zero_count*P+bb_bitset_vec[bb_index].bitset_read_bits(offset_sparse_itr,bit_size);
-        
-        offset_dense_itr++;
-        if(done==0 && temp==val)
+        double hash_fpr=(k==0)?1.0:predict_hash_fpr(hash_bits,k);
+
+        double fpr=0.0,total_fraction=0.0;
+        for(int q=0;q<query_mix.size();q++)
         {
-          offset_sparse_itr+=bit_size;  
-          done=1;
+          double class_fpr=0.0;
+          for(int d=0;d<densities.size();d++)
+          {
+            class_fpr+=predict_query_fpr(query_mix[q].width,densities[d],g,hash_fpr);
+          }
+          fpr+=query_mix[q].fraction*class_fpr/densities.size();
+          total_fraction+=query_mix[q].fraction;
         }
-        else
+        fpr=(total_fraction>0.0)?fpr/total_fraction:fpr;
+
+        if(fpr<best.predicted_fpr)
         {
-          val_list.push_back(temp);
-          offset_sparse_itr+=bit_size;  
+          best={g,golomb_bits,(k==0)?0.0:hash_bits,k,fpr};
         }
-        
-        
       }
     }
-   
-    
-    sort(val_list.begin(),val_list.end());
-
-    bool testbool = (done==1);
-    assert(("The key to delete was not present!", testbool));
-
-
-    vec_num_keys[bb_index]-=done;
-    create_new_gcs_block(val_list,bb_bitset_vec[bb_index]);
-    
-
-    return ;
 
+    return best;
   }
 
-  //checks if there is a value in a certain block(var bb_temp) that is between low_val and upper_val
-  bool range_query_in_block(uint64_t low_val,uint64_t upper_val,snarf_bitset &bb_temp,int num_keys_read)
+  //initialize snarf within a memory budget(var total_bits_per_key) for an expected query mix(var query_mix),
+  //see plan_bit_budget. Returns the split that was used, with its predicted FPR
+  snarf_budget_plan snarf_init_budget(vector<T> &keys,double total_bits_per_key,int num_ele_per_block,vector<snarf_query_class> &query_mix)
   {
-    int num_keys=num_keys_read;
-    int delta_zero_count=0,delta_one_count=0;
-    int offset_dense_itr=num_keys*bit_size,offset_sparse_itr=0;
+    snarf_budget_plan plan=plan_bit_budget(keys,total_bits_per_key,num_ele_per_block,query_mix);
+    //snarf_init uses bits_per_key-3 bits per location
+    snarf_init(keys,plan.bit_size+3.0,num_ele_per_block,plan.hash_bits_per_key,plan.num_hash_functions);
+    return plan;
+  }
 
-    int bit_val;
-    uint64_t temp;
+  //returns the smallest key in [min_key, max_key] that another snarf instance(var source) maps to a location of at least target,
+  //or max_key when there is none. The key before it is returned in below, equal to the result when there is none.
+  //Starts from a guess, widens with doubling steps until the target is bracketed, then bisects the bracket
+  T merge_first_key_at(snarf_updatable_gcs_hash<T> &source,uint64_t target,T guess,T min_key,T max_key,T &below)
+  {
+    typedef typename snarf_key_traits<T>::distance_type distance_type;
+    T lo=guess,hi=guess;
+    distance_type step=1;
 
-    for(int i=0;i<num_keys;i++)
+    if(source.calculate_endpoints(guess)>=target)
     {
-      bit_val=bb_temp.bitset_read_bit(offset_dense_itr,1);
-      
-      if(bit_val==1 && ((delta_zero_count+1)*P>=low_val) && ((upper_val)>=delta_zero_count*P))
-      {
-        //calculate the value
-        temp=delta_zero_count*P+bb_temp.bitset_read_bits(offset_sparse_itr,bit_size);
-        
-        
-        //value is between the range
-        if(temp>=low_val && temp<=upper_val) // new1
+      while(source.calculate_endpoints(lo)>=target)
+      {
+        if(lo==min_key)
         {
-          return true;
+          below=min_key;
+          return min_key;
         }
-        
+        hi=lo;
+        distance_type dist=snarf_key_distance(lo,min_key);
+        lo=(dist<=step)?min_key:(T)(lo-step);
+        step=(step>dist/2)?step:step*2;
+      }
+    }
+    else
+    {
+      while(source.calculate_endpoints(hi)<target)
+      {
+        if(hi==max_key)
+        {
+          below=max_key;
+          return max_key;
+        }
+        lo=hi;
+        distance_type dist=snarf_key_distance(max_key,hi);
+        hi=(dist<=step)?max_key:(T)(hi+step);
+        step=(step>dist/2)?step:step*2;
       }
-      delta_zero_count+=(1-bit_val);
-      offset_dense_itr++;
-      i-=(1-bit_val);
-      offset_sparse_itr+=(bit_val*bit_size);
-
     }
 
+    //lo maps below target and hi does not
+    while(true)
+    {
+      T mid;
+      if constexpr (is_floating_point<T>::value)
+      {
+        mid=lo/2+hi/2;
+      }
+      else
+      {
+        mid=lo+(T)(snarf_key_distance(hi,lo)/2);
+      }
+      if(!(mid>lo && mid<hi))
+      {
+        break;
+      }
+      if(source.calculate_endpoints(mid)>=target)
+      {
+        hi=mid;
+      }
+      else
+      {
+        lo=mid;
+      }
+    }
 
-    return false;
-
-
+    below=lo;
+    return hi;
   }
 
-
-  //finds the bit location corresponding to the key and inserts it in the corresponding block
-  void insert_key(T key)
+  //finds the keys that a location(var source_loc) of another snarf instance(var source) can hold, and returns
+  //the locations of these keys in this snarf between merged_lower and merged_upper.
+  //The first key of the location and the first key of the next location are found by inverting the model of the source
+  void map_source_location(snarf_updatable_gcs_hash<T> &source,uint64_t source_loc,uint64_t &merged_lower,uint64_t &merged_upper)
   {
-    query_cdf1=rmi.infer(key);  
-
-    uint64_t temp_loc_upper=floor(query_cdf1*N*P);
-    temp_loc_upper=min(N*P-1,max((uint64_t)0,temp_loc_upper));
-
-    delta_query_index=floor(temp_loc_upper*1.00/(block_size*P));
-    delta_query_remainder=temp_loc_upper-delta_query_index*block_size*P;
-    bf.add(key);
-    insert_in_block(delta_query_remainder,delta_query_index);
-
-   
-    return;
+    uint64_t num_locations=source.N*source.P;
+    //no key of the source is outside of its stored range
+    T min_key=source.min_stored_key,max_key=source.max_stored_key;
+
+    T lower_guess=source.rmi.inverse_infer(source_loc*1.00/num_locations);
+    T upper_guess=source.rmi.inverse_infer((source_loc+1)*1.00/num_locations);
+    lower_guess=max(min(lower_guess,max_key),min_key);
+    upper_guess=max(min(upper_guess,max_key),min_key);
+
+    T below,lower_key,upper_key;
+    lower_key=merge_first_key_at(source,source_loc,lower_guess,min_key,max_key,below);
+    T next_key=merge_first_key_at(source,source_loc+1,upper_guess,min_key,max_key,upper_key);
+    //every key up to max_key maps to the location
+    if(source.calculate_endpoints(next_key)<=source_loc)
+    {
+      upper_key=max_key;
+    }
 
+    merged_lower=calculate_endpoints(lower_key);
+    merged_upper=calculate_endpoints(max(lower_key,upper_key));
+    return ;
   }
 
-  //finds the bit location corresponding to the key and deletes it from the corresponding block
-  void delete_key(T key)
+  //reads the next entry of a merge pass over another snarf instance(var source) and maps it to locations of this snarf
+  void merge_advance_source(snarf_updatable_gcs_hash<T> &source,snarf_merge_cursor &cursor)
   {
-    
-    query_cdf1=rmi.infer(key); 
-    
-    uint64_t temp_loc_upper=floor(query_cdf1*N*P);
-    temp_loc_upper=min(N*P-1,max((uint64_t)0,temp_loc_upper));
-
-    delta_query_index=floor(temp_loc_upper*1.00/(block_size*P));
-    delta_query_remainder=temp_loc_upper-delta_query_index*block_size*P;
-
-    delete_from_block(delta_query_remainder,delta_query_index);
-
-
-    return;
+    while(cursor.pos>=cursor.block_vals.size())
+    {
+      cursor.block_index++;
+      if(cursor.block_index>=source.vec_num_keys.size())
+      {
+        cursor.has_next=false;
+        return ;
+      }
+      source.decode_block_entries(cursor.block_index,cursor.block_vals);
+      cursor.pos=0;
+    }
 
-  }
+    //the fingerprint of the entry is kept in the merged entries
+    uint64_t source_entry=cursor.block_vals[cursor.pos];
+    uint64_t source_loc=cursor.block_index*source.block_size*source.P+(source_entry>>source.fingerprint_bits);
+    cursor.next_fingerprint=source_entry-((source_entry>>source.fingerprint_bits)<<source.fingerprint_bits);
+    cursor.pos++;
 
-  bool verify_key(T key) {
-    return bf.possiblyContains(key);
+    if(!cursor.has_last || source_loc!=cursor.last_source_loc)
+    {
+      map_source_location(source,source_loc,cursor.next_lower,cursor.next_upper);
+      cursor.last_source_loc=source_loc;
+      cursor.has_last=true;
+    }
+    cursor.has_next=true;
+    return ;
   }
 
+  //reads the next entry of a merge pass over another snarf instance(var source), mapped to an entry of this snarf.
+  //The locations of consecutive entries can overlap, an entry is expanded once no smaller entry can come from a later entry.
+  //Entries come out in non-decreasing order, returns false at the end of the source
+  bool merge_next_location(snarf_updatable_gcs_hash<T> &source,snarf_merge_cursor &cursor,uint64_t &loc)
+  {
+    if(!cursor.started)
+    {
+      merge_advance_source(source,cursor);
+      cursor.started=true;
+    }
 
-  uint64_t calculate_endpoints(T val) {
-    uint64_t tl123;
-    double ahahaha = rmi.infer(val);
-    tl123=floor(ahahaha*N*P);
-    tl123=min(N*P-1,max((uint64_t)0,tl123));
-    // return tl123-floor(tl123*1.00/(block_size*P))*block_size*P;
-    return tl123;
+    //the lower locations of the entries are non-decreasing
+    while(cursor.has_next && (cursor.pending.empty() || (cursor.next_lower<<fingerprint_bits)<=cursor.pending.top()))
+    {
+      for(uint64_t i=cursor.next_lower;i<=cursor.next_upper;i++)
+      {
+        cursor.pending.push((i<<fingerprint_bits)|cursor.next_fingerprint);
+      }
+      merge_advance_source(source,cursor);
+    }
 
+    if(cursor.pending.empty())
+    {
+      return false;
+    }
+    loc=cursor.pending.top();
+    cursor.pending.pop();
+    return true;
   }
 
- 
-  //finds the bit location corresponding to the query endpoints and checks the corresponding block or blocks for a value
-  bool range_query(T lower_val,T upper_val)
+  //initialize snarf as the union of two snarf instances(var a, var b) built with the same bits per key, without their keys.
+  //The model is merged from the two models, then the entries of both are mapped to the new locations and
+  //merged block by block in one streaming pass. Every key of a and b is found by the merged snarf.
+  //An entry holds the keys of one location of its source, which spread over about 1+(keys of the other source nearby)/(keys of its source nearby)
+  //locations of the merged snarf. When the key sets overlap, dropping bits(var drop_bits) from the merged locations keeps the size close to a rebuild
+  void snarf_merge(snarf_updatable_gcs_hash<T> &a,snarf_updatable_gcs_hash<T> &b,int drop_bits=0)
   {
-    uint64_t temp_loc_lower,temp_loc_upper,large_delta_query_index;
-    uint64_t bit_adjst = 1;
-   
-    query_cdf1=rmi.infer(upper_val);
-    query_cdf2=rmi.infer(lower_val);
+    bool testbool = (a.bit_size==b.bit_size && a.fingerprint_bits==b.fingerprint_bits && a.verification_mode==b.verification_mode);
+    assert(("Only snarf instances with the same bits per key, fingerprint bits and hash filter can be merged!", testbool));
+    testbool = (drop_bits>=0 && drop_bits<a.bit_size);
+    assert(("drop_bits should be less than the bits of a location!", testbool));
 
+    //Set parameter values
+    N=a.num_stored_keys+b.num_stored_keys;
+    bit_size=a.bit_size-drop_bits;
+    P=(uint64_t)1<<bit_size;
+    block_size=a.block_size;
+    total_blocks=ceil(N*1.00/block_size);
+    block_codec=a.block_codec;
+    fingerprint_bits=a.fingerprint_bits;
 
-    temp_loc_upper=floor(query_cdf1*N*P);
-    temp_loc_upper=min(N*P-1,max((uint64_t)0,temp_loc_upper));
+    //merge the models
+    rmi=snarf_model<T>();
+    rmi.keys_per_model=a.rmi.keys_per_model;
+    rmi.snarf_model_merge(a.rmi,a.num_stored_keys,b.rmi,b.num_stored_keys);
+    compact_model=a.compact_model;
+    if(compact_model)
+    {
+      rmi.compress();
+    }
 
-     
-    temp_loc_lower=floor(query_cdf2*N*P);
-    temp_loc_lower=min(N*P-1,max((uint64_t)0,temp_loc_lower));
+    init_block_directory(total_blocks);
 
-    delta_query_index=floor(temp_loc_lower*1.00/(block_size*P));
-    large_delta_query_index=floor(temp_loc_upper*1.00/(block_size*P));
+    //merge the two streams of entries, writing each block once it is complete
+    snarf_merge_cursor cursor_a,cursor_b;
+    uint64_t loc_a=0,loc_b=0,loc;
+    bool has_a=merge_next_location(a,cursor_a,loc_a);
+    bool has_b=merge_next_location(b,cursor_b,loc_b);
 
+    vector<uint64_t> curr_batch;
+    uint64_t curr_block=0;
+    while(has_a || has_b)
+    {
+      if(has_a && (!has_b || loc_a<=loc_b))
+      {
+        loc=loc_a;
+        has_a=merge_next_location(a,cursor_a,loc_a);
+      }
+      else
+      {
+        loc=loc_b;
+        has_b=merge_next_location(b,cursor_b,loc_b);
+      }
 
+      while((loc>>fingerprint_bits)>=(curr_block+1)*block_size*P)
+      {
+        create_new_gcs_block(curr_batch,curr_block);
+        curr_batch.resize(0);
+        curr_block++;
+      }
+      curr_batch.push_back(loc-((curr_block*block_size*P)<<fingerprint_bits));
+    }
+
+    for(;curr_block<total_blocks;curr_block++)
+    {
+      create_new_gcs_block(curr_batch,curr_block);
+      curr_batch.resize(0);
+    }
+
+    num_stored_keys=N;
+    if(a.num_stored_keys>0 && b.num_stored_keys>0)
+    {
+      min_stored_key=min(a.min_stored_key,b.min_stored_key);
+      max_stored_key=max(a.max_stored_key,b.max_stored_key);
+    }
+    else if(N>0)
+    {
+      min_stored_key=(a.num_stored_keys>0)?a.min_stored_key:b.min_stored_key;
+      max_stored_key=(a.num_stored_keys>0)?a.max_stored_key:b.max_stored_key;
+    }
+
+    //the hash filters are folded together when they have the same size, otherwise both are kept
+    use_hash_filter=(a.use_hash_filter && b.use_hash_filter);
+    verification_mode=a.verification_mode;
+    bf_merged.resize(0);
+    cf_merged.resize(0);
+    //cuckoo filters cannot be folded together, the filter of b is kept beside the filter of a
+    if(use_hash_filter && verification_mode==SNARF_VERIFY_CUCKOO)
+    {
+      cf=a.cf;
+      cf_merged.push_back(b.cf);
+      cf_merged.insert(cf_merged.end(),a.cf_merged.begin(),a.cf_merged.end());
+      cf_merged.insert(cf_merged.end(),b.cf_merged.begin(),b.cf_merged.end());
+    }
+    else if(use_hash_filter)
+    {
+      bf=a.bf;
+      if(!bf.merge(b.bf))
+      {
+        bf_merged.push_back(b.bf);
+      }
+      bf_merged.insert(bf_merged.end(),a.bf_merged.begin(),a.bf_merged.end());
+      bf_merged.insert(bf_merged.end(),b.bf_merged.begin(),b.bf_merged.end());
+    }
+
+    return ;
+  }
+
+  //Inserts an entry(var val) into bit block at certain index(var bb_index)
+  //Current implementation is not performant.
+  // It simply read the block to get a list of values and adds the new value to this list. Then created a new value for this list
+  void  insert_in_block(uint64_t val,int bb_index)
+  {
+    vector<uint64_t> val_list;
+    decode_block_entries(bb_index,val_list);
+
+    val_list.push_back(val);
+    sort(val_list.begin(),val_list.end());
+
+    range_cache.invalidate_block(bb_index);
+    mark_block_dirty(bb_index);
+    create_new_gcs_block(val_list,bb_index);
+    
+
+    return ;
+
+  }
+
+  //Deletes an entry(var val) from a bit block at certain index(var bb_index)
+  //Current implementation is not performant.
+  // It simply read the block to get a list of values and removes the value from this list. Then created a new value for this list
+  void  delete_from_block(uint64_t val,int bb_index)
+  {
+    vector<uint64_t> val_list;
+    decode_block_entries(bb_index,val_list);
+
+    auto itr=find(val_list.begin(),val_list.end(),val);
+
+    bool testbool = (itr!=val_list.end());
+    assert(("The key to delete was not present!", testbool));
+
+    if(itr!=val_list.end())
+    {
+      val_list.erase(itr);
+    }
+
+    range_cache.invalidate_block(bb_index);
+    mark_block_dirty(bb_index);
+    create_new_gcs_block(val_list,bb_index);
+    
+
+    return ;
+
+  }
+
+  //checks if there is a value in a certain block(var bb_index) that is between low_val and upper_val
+  //The locations are widened to the entries of all fingerprints
+  bool range_query_in_block(uint64_t low_val,uint64_t upper_val,int bb_index)
+  {
+    uint64_t fingerprint_mask=((uint64_t)1<<fingerprint_bits)-1;
+    snarf_bitset_view block=block_view(bb_index);
+    return block_codec.range_query(block,block_num_keys(bb_index),block_low_bits[bb_index],low_val<<fingerprint_bits,(upper_val<<fingerprint_bits)|fingerprint_mask);
+  }
+
+  //checks if a certain block(var bb_index) holds an entry(var val)
+  bool contains_in_block(uint64_t val,int bb_index)
+  {
+    snarf_bitset_view block=block_view(bb_index);
+    return block_codec.contains(block,block_num_keys(bb_index),block_low_bits[bb_index],val);
+  }
+
+  //counts the values in a certain block(var bb_index) whose locations are between low_val and upper_val
+  uint64_t count_in_block(uint64_t low_val,uint64_t upper_val,int bb_index)
+  {
+    uint64_t fingerprint_mask=((uint64_t)1<<fingerprint_bits)-1;
+    snarf_bitset_view block=block_view(bb_index);
+    return block_codec.count(block,block_num_keys(bb_index),block_low_bits[bb_index],low_val<<fingerprint_bits,(upper_val<<fingerprint_bits)|fingerprint_mask);
+  }
+
+  //rebuilds block_count_tree from vec_num_keys in linear time
+  void build_block_count_tree()
+  {
+    uint64_t num_blocks=vec_num_keys.size();
+    uint64_t num_runs=(num_blocks+count_tree_span-1)/count_tree_span;
+    block_count_tree.assign(num_runs+1,0);
+    for(uint64_t b=0;b<num_blocks;b++)
+    {
+      block_count_tree[b/count_tree_span+1]+=block_num_keys(b);
+    }
+    for(uint64_t i=1;i<=num_runs;i++)
+    {
+      uint64_t parent=i+(i&(-i));
+      if(parent<=num_runs)
+      {
+        block_count_tree[parent]+=block_count_tree[i];
+      }
+    }
+    return ;
+  }
+
+  //adds var delta (two's complement for removals) to the number of keys of a block(var bb_index) in block_count_tree
+  void add_block_count(uint64_t bb_index,uint64_t delta)
+  {
+    for(uint64_t i=bb_index/count_tree_span+1;i<block_count_tree.size();i+=i&(-i))
+    {
+      block_count_tree[i]+=delta;
+    }
+    return ;
+  }
+
+  //number of keys in the blocks before a block(var bb_index): the runs before its run from the tree, then the blocks
+  //of its run before it from vec_num_keys
+  uint64_t keys_before_block(uint64_t bb_index)
+  {
+    uint64_t count=0;
+    uint64_t run=bb_index/count_tree_span;
+    for(uint64_t i=run;i>0;i-=i&(-i))
+    {
+      count+=block_count_tree[i];
+    }
+    for(uint64_t b=run*count_tree_span;b<bb_index;b++)
+    {
+      count+=block_num_keys(b);
+    }
+    return count;
+  }
+
+  //number of keys in the blocks first_index to last_index-1
+  uint64_t keys_in_blocks(uint64_t first_index,uint64_t last_index)
+  {
+    if(last_index<=first_index)
+    {
+      return 0;
+    }
+    return keys_before_block(last_index)-keys_before_block(first_index);
+  }
+
+  //returns the number of stored entries whose bit locations fall between the locations of lower_val and upper_val.
+  //It is an upper bound on the number of keys in the range, with the same error as a range query: keys outside
+  //the range that map to the same locations are counted too.
+  //Only the two blocks at the edges of the range are decoded.
+  uint64_t range_count(T lower_val,T upper_val)
+  {
+    uint64_t temp_loc_lower=calculate_endpoints(lower_val);
+    uint64_t temp_loc_upper=calculate_endpoints(upper_val);
+
+    uint64_t lower_index=temp_loc_lower/(block_size*P);
+    uint64_t upper_index=temp_loc_upper/(block_size*P);
+
+    if(lower_index==upper_index)
+    {
+      return count_in_block(temp_loc_lower-lower_index*block_size*P,temp_loc_upper-lower_index*block_size*P,lower_index);
+    }
+
+    uint64_t count=0;
+    count+=count_in_block(temp_loc_lower-lower_index*block_size*P,block_size*P-1,lower_index);
+    count+=keys_in_blocks(lower_index+1,upper_index);
+    count+=count_in_block(0,temp_loc_upper-upper_index*block_size*P,upper_index);
+
+    return count;
+  }
+
+  //estimates the fraction of keys in [lower_val, upper_val] from the model alone, without reading any bit block
+  double estimate_selectivity(T lower_val,T upper_val)
+  {
+    if(upper_val<lower_val)
+    {
+      return 0.0;
+    }
+    return max(0.0,rmi.infer(upper_val)-rmi.infer(lower_val));
+  }
+
+  //estimates the number of keys in [lower_val, upper_val] from the model alone, without reading any bit block
+  uint64_t estimate_count(T lower_val,T upper_val)
+  {
+    return llround(estimate_selectivity(lower_val,upper_val)*num_stored_keys);
+  }
+
+  //finds the bit location corresponding to the key and inserts it in the corresponding block
+  void insert_key(T key)
+  {
+    query_cdf1=rmi.infer(key);  
+
+    uint64_t temp_loc_upper=location_from_cdf(query_cdf1);
+
+    delta_query_index=temp_loc_upper/(block_size*P);
+    delta_query_remainder=temp_loc_upper-delta_query_index*block_size*P;
+    hash_insert(snarf_key_fold(key));
+    insert_in_block(key_entry(key,delta_query_remainder),delta_query_index);
+    if(num_stored_keys==0 || key<min_stored_key)
+    {
+      min_stored_key=key;
+    }
+    if(num_stored_keys==0 || key>max_stored_key)
+    {
+      max_stored_key=key;
+    }
+    num_stored_keys++;
+
+   
+    return;
+
+  }
+
+  //finds the bit location corresponding to the key and deletes it from the corresponding block
+  void delete_key(T key)
+  {
+    
+    query_cdf1=rmi.infer(key); 
+    
+    uint64_t temp_loc_upper=location_from_cdf(query_cdf1);
+
+    delta_query_index=temp_loc_upper/(block_size*P);
+    delta_query_remainder=temp_loc_upper-delta_query_index*block_size*P;
+
+    delete_from_block(key_entry(key,delta_query_remainder),delta_query_index);
+    num_stored_keys--;
+
+    hash_delete(snarf_key_fold(key));
+
+
+    return;
+
+  }
+
+  //adds a folded key to the hash filter
+  void hash_insert(uint64_t folded)
+  {
+    if(use_hash_filter && verification_mode==SNARF_VERIFY_CUCKOO) {
+      cf.add(folded);
+    }
+    else if(use_hash_filter) {
+      bf.add(folded);
+    }
+    return ;
+  }
+
+  //removes a folded key from the hash filter, only the cuckoo filter supports it.
+  //The key may come from a merged snarf instance
+  void hash_delete(uint64_t folded)
+  {
+    if(use_hash_filter && verification_mode==SNARF_VERIFY_CUCKOO) {
+      bool removed = cf.remove(folded);
+      for(int i = 0; i < cf_merged.size() && !removed; i++) {
+        removed = cf_merged[i].remove(folded);
+      }
+    }
+    return ;
+  }
+
+  bool verify_key(T key) {
+    return verify_key_at(key,(fingerprint_bits>0)?calculate_endpoints(key):0);
+  }
+
+  //verify_key for a key whose location(var temp_loc) is already known
+  bool verify_key_at(T key,uint64_t temp_loc) {
+    //the entry of the key, in the block that is being searched
+    if(fingerprint_bits>0) {
+      uint64_t bb_index=temp_loc/(block_size*P);
+      if(!contains_in_block(key_entry(key,temp_loc-bb_index*block_size*P),bb_index)) {
+        return false;
+      }
+    }
+    return verify_hash(key);
+  }
+
+  //checks the key against the hash filters only
+  bool verify_hash(T key) {
+    if(!use_hash_filter) {
+      return true;
+    }
+    uint64_t folded = snarf_key_fold(key);
+    if(verification_mode==SNARF_VERIFY_CUCKOO) {
+      if(cf.possiblyContains(folded)) {
+        return true;
+      }
+      for(int i = 0; i < cf_merged.size(); i++) {
+        if(cf_merged[i].possiblyContains(folded)) {
+          return true;
+        }
+      }
+      return false;
+    }
+    if(bf.possiblyContains(folded)) {
+      return true;
+    }
+    for(int i = 0; i < bf_merged.size(); i++) {
+      if(bf_merged[i].possiblyContains(folded)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  //called after a block(var bb_index) reported a value between low_val1 and up_val1 for the range [lower_val, upper_val].
+  //Uses the hash values to walk past the part of the range that only maps onto false positives
+  bool verify_in_block(T lower_val,T upper_val,uint64_t low_val1,uint64_t up_val1,int bb_index)
+  {
+    if(verify_key(lower_val)) {
+      return true;
+    }
+
+    uint64_t tempnew1 = calculate_endpoints(lower_val);
+    uint64_t tempnew_val1 = tempnew1 % (block_size * P);
+
+    while(tempnew_val1 <= low_val1) {
+      if(lower_val >= upper_val) {
+        return false;
+      }
+      lower_val+=1;
+      tempnew1 = calculate_endpoints(lower_val);
+      tempnew_val1 = tempnew1 % (block_size * P);
+      if(verify_key(lower_val)) {
+        break;
+      }
+      if(tempnew_val1 > up_val1) {
+        return false;
+        // return range_query_in_block(tempnew_val1 - 1, up_val1 ,bb_index);
+      }
+    }
+    return range_query_in_block(tempnew_val1, up_val1 ,bb_index);
+  }
+
+  uint64_t calculate_endpoints(T val) {
+    return location_from_cdf(rmi.infer(val));
+
+  }
+
+  //checks if a key is present. The hash filter is checked first as the cheap negative, then one inference
+  //gives the location of the key and only the block holding it is searched for the location.
+  //With fingerprints the block is searched for the entry of the key, which also verifies it
+  bool contains(T key)
+  {
+    if(fingerprint_bits==0 && !verify_hash(key)) {
+      return false;
+    }
+    return contains_at(key,calculate_endpoints(key),true);
+  }
+
+  //contains for a key whose location(var temp_loc) is already known, hash_checked tells that verify_hash passed
+  bool contains_at(T key,uint64_t temp_loc,bool hash_checked=false)
+  {
+    if(fingerprint_bits>0) {
+      return verify_key_at(key,temp_loc);
+    }
+    if(!hash_checked && !verify_hash(key)) {
+      return false;
+    }
+    uint64_t bb_index=temp_loc/(block_size*P);
+    return contains_in_block(temp_loc-bb_index*block_size*P,bb_index);
+  }
+
+ 
+  //finds the bit location corresponding to the query endpoints and checks the corresponding block or blocks for a value
+  bool range_query(T lower_val,T upper_val)
+  {
+    bool ans;
+    if(query_sampler.should_sample())
+    {
+      ans=sampled_range_query(lower_val,upper_val);
+    }
+    else
+    {
+      ans=unsampled_range_query(lower_val,upper_val);
+    }
+
+    if(fpr_stats.should_sample())
+    {
+      uint64_t width,bb_index;
+      fpr_stats_position(lower_val,upper_val,width,bb_index);
+      fpr_stats.record_query(width,bb_index,ans);
+    }
+    return ans;
+  }
+
+  //range_query that records its width and latency in query_sampler
+  bool sampled_range_query(T lower_val,T upper_val)
+  {
+    auto start=steady_clock::now();
+    bool ans=unsampled_range_query(lower_val,upper_val);
+    uint64_t latency_ns=duration_cast<nanoseconds>(steady_clock::now()-start).count();
+
+    //point queries have width 0, ranges the number of locations they span
+    uint64_t width=0;
+    if(lower_val!=upper_val)
+    {
+      width=calculate_endpoints(upper_val)-calculate_endpoints(lower_val)+1;
+    }
+    query_sampler.record(width,latency_ns);
+    return ans;
+  }
+
+  bool unsampled_range_query(T lower_val,T upper_val)
+  {
+    //point queries take the fast path
+    if(lower_val==upper_val)
+    {
+      return contains(lower_val);
+    }
+
+    uint64_t temp_loc_lower=calculate_endpoints(lower_val),temp_loc_upper=calculate_endpoints(upper_val);
+    if(!range_cache.enabled())
+    {
+      return range_query_at(lower_val,upper_val,temp_loc_lower,temp_loc_upper);
+    }
+
+    bool ans;
+    uint64_t folded_lower=snarf_key_fold(lower_val),folded_upper=snarf_key_fold(upper_val);
+    if(range_cache.lookup(folded_lower,folded_upper,temp_loc_lower,temp_loc_upper,block_size*P,ans))
+    {
+      return ans;
+    }
+    ans=range_query_at(lower_val,upper_val,temp_loc_lower,temp_loc_upper);
+    range_cache.store(folded_lower,folded_upper,temp_loc_lower,temp_loc_upper,block_size*P,ans);
+    return ans;
+  }
+
+  //Times one range query out of var interval on each thread (0 disables sampling) and keeps the width and latency
+  //of the last var capacity sampled queries, for retune
+  void enable_query_sampling(uint64_t interval=64,uint64_t capacity=4096)
+  {
+    query_sampler.init(interval,capacity);
+    return ;
+  }
+
+  //Counts one range query out of var interval on each thread (0 disables the statistics) with its answer, by width and by
+  //region of blocks (var num_regions regions), in per thread shards (var num_shards). Callers that check positives against
+  //their data report them with report_positive, and fpr_stats gives the measured false positive rate
+  void enable_fpr_stats(uint64_t interval=16,uint64_t num_regions=64,uint64_t num_shards=32)
+  {
+    fpr_stats.init(interval,num_regions,num_shards,vec_num_keys.size());
+    return ;
+  }
+
+  //width in bit locations (0 for point queries) and first block of a range query, as counted by fpr_stats
+  void fpr_stats_position(T lower_val,T upper_val,uint64_t &width,uint64_t &bb_index)
+  {
+    uint64_t temp_loc_lower=calculate_endpoints(lower_val);
+    width=0;
+    if(lower_val!=upper_val)
+    {
+      width=calculate_endpoints(upper_val)-temp_loc_lower+1;
+    }
+    bb_index=temp_loc_lower/(block_size*P);
+    return ;
+  }
+
+  //reports a positive answer to range_query(lower_val, upper_val) checked against the data, var is_false tells that the
+  //range holds no key. Callers can check every positive or only some of them
+  void report_positive(T lower_val,T upper_val,bool is_false)
+  {
+    if(!fpr_stats.enabled())
+    {
+      return ;
+    }
+    uint64_t width,bb_index;
+    fpr_stats_position(lower_val,upper_val,width,bb_index);
+    fpr_stats.record_check(width,bb_index,is_false);
+    return ;
+  }
+
+  //measured false positive rate over all widths, -1 until a positive is reported
+  double measured_fpr()
+  {
+    return fpr_stats.total().false_positive_rate();
+  }
+
+  //Bytes of directory per block in return_size. The block count tree and the range cache add 8 and 4 bytes per block to memory_report
+  uint64_t directory_bytes_per_block()
+  {
+    return sizeof(vec_num_keys[0])+sizeof(block_offset[0])+sizeof(block_low_bits[0]);
+  }
+
+  //Average time of the block part of the sampled queries (var widths, see snarf_query_sampler) if the entries(var entries, between locations
+  //var region_lower and var region_upper) were stored in blocks of var new_block_size keys.
+  //The entries are encoded into scratch blocks of that size with the codec of the filter, and queries at random
+  //positions of the region search the blocks holding their endpoints the way range_query does.
+  //The bytes of the encoded blocks are added to var encoded_bytes
+  double time_block_probes(vector<uint64_t> &entries,uint64_t region_lower,uint64_t region_upper,uint64_t new_block_size,vector<uint64_t> &widths,uint64_t &encoded_bytes)
+  {
+    uint64_t block_range=new_block_size*P;
+    uint64_t first_block=region_lower/block_range,last_block=(region_upper-1)/block_range;
+    vector<snarf_bitset> blocks(last_block-first_block+1);
+    vector<uint64_t> num_keys(blocks.size(),0),low_bits(blocks.size(),0);
+
+    vector<uint64_t> curr_batch;
+    uint64_t j=0;
+    for(uint64_t i=0;i<blocks.size();i++)
+    {
+      uint64_t lower=(first_block+i)*block_range;
+      curr_batch.resize(0);
+      while(j<entries.size() && (entries[j]>>fingerprint_bits)<lower+block_range)
+      {
+        curr_batch.push_back(entries[j]-(lower<<fingerprint_bits));
+        j++;
+      }
+      low_bits[i]=block_codec.choose_low_bits(curr_batch,bit_size+fingerprint_bits);
+      block_codec.encode(curr_batch,low_bits[i],blocks[i]);
+      num_keys[i]=curr_batch.size();
+      encoded_bytes+=blocks[i].return_size();
+    }
+
+    uint64_t fingerprint_mask=((uint64_t)1<<fingerprint_bits)-1;
+    mt19937_64 gen(block_range);
+    uint64_t num_probes=16384,hits=0;
+    auto start=steady_clock::now();
+    for(uint64_t i=0;i<num_probes;i++)
+    {
+      uint64_t width=widths[i%widths.size()];
+      uint64_t lower=region_lower+gen()%(region_upper-region_lower);
+      uint64_t upper=min(region_upper-1,lower+max(width,(uint64_t)1)-1);
+      uint64_t lower_index=lower/block_range-first_block,upper_index=upper/block_range-first_block;
+      uint64_t lower_offset=lower%block_range;
+      uint64_t upper_offset=(lower_index==upper_index)?upper%block_range:block_range-1;
+      //point queries without fingerprints search their entry, like contains_at
+      if(width==0 && fingerprint_bits==0)
+      {
+        hits+=block_codec.contains(blocks[lower_index],num_keys[lower_index],low_bits[lower_index],lower_offset);
+        continue;
+      }
+      hits+=block_codec.range_query(blocks[lower_index],num_keys[lower_index],low_bits[lower_index],lower_offset<<fingerprint_bits,(upper_offset<<fingerprint_bits)|fingerprint_mask);
+      if(upper_index!=lower_index)
+      {
+        hits+=block_codec.range_query(blocks[upper_index],num_keys[upper_index],low_bits[upper_index],0,((upper%block_range)<<fingerprint_bits)|fingerprint_mask);
+      }
+    }
+    double ns=duration_cast<nanoseconds>(steady_clock::now()-start).count()*1.00/num_probes;
+    //keeps the probes from being optimized away
+    return ns+(hits>num_probes*2);
+  }
 
+  //Cost of reading a cache line of a block that is not in the cache. Random blocks are searched to their end twice,
+  //the first time from memory and the second time from the cache, and the difference is spread over their lines.
+  //Close to 0 when the filter fits in the cache
+  double time_block_line_miss()
+  {
+    uint64_t num_blocks=vec_num_keys.size();
+    uint64_t num_timed=min((uint64_t)4096,num_blocks);
+    mt19937_64 gen(num_blocks);
+    vector<uint64_t> blocks(num_timed);
+    uint64_t num_lines=0;
+    for(uint64_t i=0;i<num_timed;i++)
+    {
+      blocks[i]=gen()%num_blocks;
+      num_lines+=(block_end(blocks[i])-block_begin(blocks[i]))/512+1;
+    }
 
-    //in case the query endpoints are in two different blocks we need to query multiple times
-    if(delta_query_index==large_delta_query_index)
-    {
-      uint64_t low_val1 = temp_loc_lower-delta_query_index*block_size*P;
-      uint64_t up_val1 =  temp_loc_upper-delta_query_index*block_size*P;
-
-      if (range_query_in_block(low_val1, up_val1, bb_bitset_vec[delta_query_index], vec_num_keys[delta_query_index])) {
-
-        if(!verify_key(lower_val)) {
-          uint64_t tempnew1 = calculate_endpoints(lower_val);
-          uint64_t tempnew_val1 = tempnew1 -  (floor(tempnew1*1.00/(block_size*P)) * block_size * P);
-
-          while(tempnew_val1 <= low_val1) {
-            lower_val+=1;
-            tempnew1 = calculate_endpoints(lower_val);
-            tempnew_val1 = tempnew1 - (floor(tempnew1*1.00/(block_size*P)) * block_size * P);
-            if(verify_key(lower_val)) {
-              break;
-            }
-            if(tempnew_val1 >= up_val1) {
-              return false;
-              // return range_query_in_block(tempnew_val1 - 1, up_val1 ,bb_bitset_vec[delta_query_index], vec_num_keys[delta_query_index]);
-            }
-          }
-          return range_query_in_block(tempnew_val1, up_val1 ,bb_bitset_vec[delta_query_index], vec_num_keys[delta_query_index]);
-        } else {
-            return true;
+    uint64_t found=0;
+    double ns[2];
+    for(int pass=0;pass<2;pass++)
+    {
+      auto start=steady_clock::now();
+      for(uint64_t i=0;i<num_timed;i++)
+      {
+        found+=count_in_block(block_size*P-1,block_size*P-1,blocks[i]);
+      }
+      ns[pass]=duration_cast<nanoseconds>(steady_clock::now()-start).count();
+    }
+    return max(0.0,ns[0]-ns[1])/max((uint64_t)1,num_lines)+(found>num_timed*block_size);
+  }
+
+  //Expected latency of the sampled queries and return_size of the filter for each block size in var block_sizes.
+  //A query costs a fixed part (model, directory, hash filter), the search of the blocks holding its endpoints, and
+  //the cache misses on the lines of these blocks:
+  //  - the search is timed for each block size on the entries of a run of blocks re-encoded at that size (see time_block_probes)
+  //  - a search reads about half of the lines of a block, each costing time_block_line_miss
+  //  - the fixed part is what is left of the sampled latencies at the current block size
+  //Returns false if there are too few samples (see enable_query_sampling)
+  bool estimate_block_sizes(vector<uint64_t> &block_sizes,vector<snarf_block_size_estimate> &estimates)
+  {
+    vector<uint64_t> widths,latencies;
+    query_sampler.collect(widths,latencies);
+    if(widths.size()<64 || vec_num_keys.size()==0)
+    {
+      return false;
+    }
+
+    //a run of blocks from the middle of the filter holding at least 16 of the largest blocks
+    uint64_t num_blocks=vec_num_keys.size();
+    uint64_t wanted=16*(*max_element(block_sizes.begin(),block_sizes.end()));
+    uint64_t first=num_blocks/2,last=first;
+    uint64_t blocks_bytes=0;
+    vector<uint64_t> entries,block_entries;
+    while(last<num_blocks && entries.size()<wanted)
+    {
+      decode_block_entries(last,block_entries);
+      for(int i=0;i<block_entries.size();i++)
+      {
+        entries.push_back(block_entries[i]+((last*block_size*P)<<fingerprint_bits));
+      }
+      last++;
+    }
+    while(first>0 && entries.size()<wanted)
+    {
+      first--;
+      decode_block_entries(first,block_entries);
+      for(int i=0;i<block_entries.size();i++)
+      {
+        block_entries[i]+=(first*block_size*P)<<fingerprint_bits;
+      }
+      entries.insert(entries.begin(),block_entries.begin(),block_entries.end());
+    }
+    uint64_t region_lower=first*block_size*P,region_upper=last*block_size*P;
+    double line_miss_ns=time_block_line_miss();
+
+    double mean_latency=0;
+    for(uint64_t i=0;i<latencies.size();i++)
+    {
+      mean_latency+=latencies[i];
+    }
+    mean_latency/=latencies.size();
+
+    //bytes of the blocks now, the run re-encoded at each block size gives their bytes at that size
+    for(int i=0;i<block_groups.size();i++)
+    {
+      blocks_bytes+=block_groups[i].return_size();
+    }
+    for(auto itr=spilled_blocks.begin();itr!=spilled_blocks.end();itr++)
+    {
+      blocks_bytes+=sizeof(itr->first)+sizeof(itr->second.first)+itr->second.second.return_size();
+    }
+    double other_bytes=(double)return_size()-blocks_bytes-num_blocks*directory_bytes_per_block();
+
+    //block search and misses at each size, the first entry is the current size
+    vector<double> block_ns,bytes_per_entry;
+    for(int i=-1;i<(int)block_sizes.size();i++)
+    {
+      uint64_t size=(i<0)?block_size:block_sizes[i];
+      uint64_t encoded_bytes=0;
+      double probe_ns=time_block_probes(entries,region_lower,region_upper,size,widths,encoded_bytes);
+      bytes_per_entry.push_back(encoded_bytes*1.00/max((uint64_t)1,(uint64_t)entries.size()));
+
+      double lines_per_block=1.0+size*bytes_per_entry.back()/64.0/2.0;
+      double blocks_searched=0;
+      for(uint64_t j=0;j<widths.size();j++)
+      {
+        blocks_searched+=snarf_expected_blocks_searched(widths[j],size,P);
+      }
+      blocks_searched/=widths.size();
+      block_ns.push_back(probe_ns+blocks_searched*lines_per_block*line_miss_ns);
+    }
+    double fixed_ns=max(0.0,mean_latency-block_ns[0]);
+
+    //the blocks of the run stand for all the blocks, scaled by the number of entries
+    uint64_t num_keys=max((uint64_t)1,num_stored_keys);
+    double block_scale=blocks_bytes/max(1.0,bytes_per_entry[0]*num_keys);
+
+    estimates.resize(0);
+    for(int i=0;i<block_sizes.size();i++)
+    {
+      snarf_block_size_estimate estimate;
+      estimate.block_size=block_sizes[i];
+      estimate.latency_ns=fixed_ns+block_ns[i+1];
+      double new_blocks=ceil(N*1.00/block_sizes[i]);
+      double new_bytes=other_bytes+new_blocks*directory_bytes_per_block()+bytes_per_entry[i+1]*num_keys*block_scale;
+      estimate.bits_per_key=new_bytes*8.00/num_keys;
+      estimates.push_back(estimate);
+    }
+    return true;
+  }
+
+  //Picks the block size with the lowest expected latency for the sampled queries (see estimate_block_sizes) among
+  //the sizes that keep the filter under var max_bits_per_key bits per key (0 for no cap), preferring the smallest
+  //filter among sizes within 5% of it, or the smallest filter if no size fits. The blocks are re-encoded if the
+  //new size is expected to be more than 5% faster than the current one, or the current one does not fit.
+  //Returns the block size in use. Not safe with concurrent queries or updates
+  uint64_t retune(double max_bits_per_key=0)
+  {
+    vector<uint64_t> block_sizes({16,24,32,48,64,96,128,192,256,384,512,768,1024});
+    if(find(block_sizes.begin(),block_sizes.end(),block_size)==block_sizes.end())
+    {
+      block_sizes.push_back(block_size);
+    }
+
+    vector<snarf_block_size_estimate> estimates;
+    if(!estimate_block_sizes(block_sizes,estimates))
+    {
+      return block_size;
+    }
+
+    //the fastest size under the cap, then the smallest size within 5% of it
+    int fastest=-1,smallest=0,current=0;
+    for(int i=0;i<estimates.size();i++)
+    {
+      if(estimates[i].block_size==block_size)
+      {
+        current=i;
+      }
+      if(estimates[i].bits_per_key<estimates[smallest].bits_per_key)
+      {
+        smallest=i;
+      }
+      bool fits=(max_bits_per_key<=0 || estimates[i].bits_per_key<=max_bits_per_key);
+      if(fits && (fastest<0 || estimates[i].latency_ns<estimates[fastest].latency_ns))
+      {
+        fastest=i;
+      }
+    }
+    int best=smallest;
+    if(fastest>=0)
+    {
+      best=fastest;
+      for(int i=0;i<estimates.size();i++)
+      {
+        if(estimates[i].latency_ns<=1.05*estimates[fastest].latency_ns && estimates[i].bits_per_key<estimates[best].bits_per_key)
+        {
+          best=i;
         }
+      }
+    }
+
+    bool current_fits=(max_bits_per_key<=0 || estimates[current].bits_per_key<=max_bits_per_key);
+    if(best!=current && (!current_fits || estimates[best].latency_ns<0.95*estimates[current].latency_ns))
+    {
+      reblock(estimates[best].block_size);
+    }
+    return block_size;
+  }
+
+  //Re-encodes the bit blocks with var new_block_size keys per block. The blocks are rebuilt from the stored entries,
+  //the keys are not needed and the answers do not change. Takes 8 bytes per stored entry of temporary memory.
+  //Clears the range cache and the query samples, and marks no block dirty: the block indexes change, so a
+  //persistent filter needs a new base image (see snarf_persistent_hash::retune)
+  void reblock(uint64_t new_block_size)
+  {
+    bool testbool = (new_block_size>0 && new_block_size<spilled_block);
+    assert(("The block size should be between 1 and 65534!", testbool));
+
+    vector<uint64_t> entries,block_entries;
+    entries.reserve(num_stored_keys);
+    uint64_t block_range=block_size*P;
+    for(uint64_t i=0;i<vec_num_keys.size();i++)
+    {
+      decode_block_entries(i,block_entries);
+      for(int j=0;j<block_entries.size();j++)
+      {
+        entries.push_back(block_entries[j]+((i*block_range)<<fingerprint_bits));
+      }
+    }
+
+    block_size=new_block_size;
+    total_blocks=ceil(N*1.00/block_size);
+    gcs_size=build_bb(entries);
+    query_sampler.clear();
+    return ;
+  }
+
+  //Enables a cache of var num_entries range query results (0 disables it). Hot ranges are answered from the cache
+  //until an insert or delete touches one of their blocks. The cache is lock-free, so concurrent range queries stay safe
+  void enable_range_cache(uint64_t num_entries)
+  {
+    bool testbool = (sizeof(T)<=sizeof(uint64_t));
+    assert(("The range cache needs keys of at most 64 bits!", testbool));
+    range_cache.init(num_entries,vec_num_keys.size());
+    return ;
+  }
+
+  //range_query for endpoints whose locations(var temp_loc_lower, var temp_loc_upper) are already known.
+  //Only locals are written, so concurrent range queries on a filter that is not being updated are safe
+  bool range_query_at(T lower_val,T upper_val,uint64_t temp_loc_lower,uint64_t temp_loc_upper)
+  {
+    uint64_t small_delta_query_index,large_delta_query_index;
+
+    small_delta_query_index=temp_loc_lower/(block_size*P);
+    large_delta_query_index=temp_loc_upper/(block_size*P);
 
+
+
+
+    //in case the query endpoints are in two different blocks we need to query multiple times
+    if(small_delta_query_index==large_delta_query_index)
+    {
+      uint64_t low_val1 = temp_loc_lower-small_delta_query_index*block_size*P;
+      uint64_t up_val1 =  temp_loc_upper-small_delta_query_index*block_size*P;
+
+      if (range_query_in_block(low_val1, up_val1,small_delta_query_index)) {
+        return verify_in_block(lower_val, upper_val, low_val1, up_val1, small_delta_query_index);
       }
       return false;
   }
     
     else
     {
-      if(range_query_in_block(temp_loc_lower-delta_query_index*block_size*P-1,block_size*P+1,bb_bitset_vec[delta_query_index],vec_num_keys[delta_query_index]))
+      //every entry of the blocks between the two edge blocks is in the range, so the range is not empty as soon as
+      //these blocks hold a key. This is checked first, from the block counts, without decoding any block
+      if(keys_in_blocks(small_delta_query_index+1,large_delta_query_index)>0)
       {
-
         return true;
       }
 
-      if(range_query_in_block(0,temp_loc_upper-large_delta_query_index*block_size*P,bb_bitset_vec[large_delta_query_index],vec_num_keys[large_delta_query_index]))
+      if(range_query_in_block(temp_loc_lower-small_delta_query_index*block_size*P,block_size*P-1,small_delta_query_index))
       {
+
         return true;
-      } 
+      }
 
-      for(int i=delta_query_index+1;i<large_delta_query_index;i++)
+      if(range_query_in_block(0,temp_loc_upper-large_delta_query_index*block_size*P,large_delta_query_index))
       {
-        if(range_query_in_block(0,block_size*P-1,bb_bitset_vec[i],vec_num_keys[i]))
-        {
-          return true;
-        }
-      }
+        return true;
+      } 
 
       return false;
 
@@ -505,9 +1744,9 @@ struct snarf_updatable_gcs_hash
   }
 
   //returns the space used by snarf overall
-  int return_size()
+  uint64_t return_size()
   {
-    int total_size=0;
+    uint64_t total_size=0;
     total_size+=sizeof(name_curr);
     total_size+=rmi.return_size();
     total_size+=7*sizeof(N);
@@ -517,17 +1756,418 @@ struct snarf_updatable_gcs_hash
       total_size+=sizeof(vec_num_keys[i]);
     }
 
-    for(int i=0;i<bb_bitset_vec.size();i++)
+    for(int i=0;i<block_groups.size();i++)
     {
-      total_size+=bb_bitset_vec[i].return_size();
+      total_size+=block_groups[i].return_size();
     }
+    total_size+=block_offset.size()*sizeof(uint16_t);
+    for(auto itr=spilled_blocks.begin();itr!=spilled_blocks.end();itr++)
+    {
+      total_size+=sizeof(itr->first)+sizeof(itr->second.first)+itr->second.second.return_size();
+    }
+    total_size+=block_low_bits.size()*sizeof(uint8_t);
+    total_size+=block_count_tree.size()*sizeof(uint64_t);
 
-    total_size += bf.return_size(); // for hashing storage
+    if(verification_mode==SNARF_VERIFY_CUCKOO) {
+      total_size += cf.return_size();
+      for(int i = 0; i < cf_merged.size(); i++) {
+        total_size += cf_merged[i].return_size();
+      }
+    }
+    else {
+      total_size += bf.return_size(); // for hashing storage
+      for(int i = 0; i < bf_merged.size(); i++) {
+        total_size += bf_merged[i].return_size();
+      }
+    }
 
     return total_size;
   }
 
+  //returns the logical and allocated bytes of each component of snarf.
+  //Allocated bytes include container capacity, object headers and malloc chunk overhead, or the size classes and
+  //huge page rounding of the arena for the arrays built in one (see snarf_alloc.cpp)
+  snarf_memory_report memory_report()
+  {
+    snarf_memory_report report;
+
+    //the bit blocks are built in the arena of the snarf instance, if any
+    snarf_arena *arena=(block_groups.size()>0)?block_groups[0].bb_bitset.m_bits.get_allocator().arena:NULL;
+    if(arena!=NULL)
+    {
+      report.arena_used_bytes=arena->used_bytes;
+      report.arena_mapped_bytes=arena->mapped_bytes;
+    }
+
+    report.add("model",rmi.return_size(),sizeof(rmi)+rmi.allocated_size());
+
+    uint64_t block_logical=0,block_allocated=0;
+    for(int i=0;i<block_groups.size();i++)
+    {
+      block_logical+=block_groups[i].return_size();
+      block_allocated+=block_groups[i].allocated_size();
+    }
+    for(auto itr=spilled_blocks.begin();itr!=spilled_blocks.end();itr++)
+    {
+      block_logical+=itr->second.second.return_size();
+      block_allocated+=itr->second.second.allocated_size();
+    }
+    report.add("bit blocks",block_logical,block_allocated);
+
+    uint64_t directory_logical=vec_num_keys.size()*sizeof(uint16_t)+block_offset.size()*sizeof(uint16_t)+block_low_bits.size()*sizeof(uint8_t);
+    uint64_t directory_allocated=snarf_vector_heap_bytes(block_groups)+snarf_vector_heap_bytes(vec_num_keys)+snarf_vector_heap_bytes(block_offset)+snarf_vector_heap_bytes(block_low_bits);
+    directory_logical+=spilled_blocks.size()*2*sizeof(uint64_t);
+    directory_allocated+=spilled_blocks.size()*snarf_heap_bytes(sizeof(void*)+sizeof(pair<const uint64_t,pair<uint64_t,snarf_bitset>>));
+    if(spilled_blocks.bucket_count()>1)
+    {
+      directory_allocated+=snarf_heap_bytes(spilled_blocks.bucket_count()*sizeof(void*));
+    }
+    report.add("block directory",directory_logical,directory_allocated);
+
+    if(range_cache.enabled())
+    {
+      report.add("range cache",range_cache.return_size(),range_cache.allocated_size());
+    }
+    if(query_sampler.enabled())
+    {
+      report.add("query samples",query_sampler.return_size(),query_sampler.allocated_size());
+    }
+    if(fpr_stats.enabled())
+    {
+      report.add("fpr stats",fpr_stats.return_size(),fpr_stats.allocated_size());
+    }
+
+    report.add("block count tree",block_count_tree.size()*sizeof(uint64_t),snarf_vector_heap_bytes(block_count_tree));
+
+    uint64_t hash_logical=bf.return_size(),hash_allocated=sizeof(bf)+bf.allocated_size();
+    for(int i=0;i<bf_merged.size();i++)
+    {
+      hash_logical+=bf_merged[i].return_size();
+      hash_allocated+=sizeof(bf_merged[i])+bf_merged[i].allocated_size();
+    }
+    hash_allocated+=snarf_vector_heap_bytes(bf_merged);
+    if(verification_mode==SNARF_VERIFY_CUCKOO)
+    {
+      hash_logical=cf.return_size();
+      hash_allocated=sizeof(cf)+cf.allocated_size();
+      for(int i=0;i<cf_merged.size();i++)
+      {
+        hash_logical+=cf_merged[i].return_size();
+        hash_allocated+=sizeof(cf_merged[i])+cf_merged[i].allocated_size();
+      }
+      hash_allocated+=snarf_vector_heap_bytes(cf_merged);
+    }
+    report.add("hash filter",hash_logical,hash_allocated);
+
+    //libstdc++ nodes hold a next pointer and the pair, the bucket array is inline while there is a single bucket
+    uint64_t map_allocated=map_hash.size()*snarf_heap_bytes(sizeof(void*)+sizeof(pair<const uint64_t,uint64_t>));
+    if(map_hash.bucket_count()>1)
+    {
+      map_allocated+=snarf_heap_bytes(map_hash.bucket_count()*sizeof(void*));
+    }
+    report.add("hash map",map_hash.size()*2*sizeof(uint64_t),map_allocated);
+
+    report.add("parameters",sizeof(name_curr)+7*sizeof(N),sizeof(*this)-sizeof(rmi)-sizeof(bf)-sizeof(cf));
+
+    return report;
+  }
+
+  //releases unused capacity left behind by deletes, inserts and the build, returns the number of bytes released
+  uint64_t shrink_to_fit()
+  {
+    uint64_t before=memory_report().total_allocated_bytes();
+
+    for(int i=0;i<block_groups.size();i++)
+    {
+      block_groups[i].shrink_to_fit();
+    }
+    block_groups.shrink_to_fit();
+    for(auto itr=spilled_blocks.begin();itr!=spilled_blocks.end();itr++)
+    {
+      itr->second.second.shrink_to_fit();
+    }
+    block_offset.shrink_to_fit();
+    vec_num_keys.shrink_to_fit();
+    block_low_bits.shrink_to_fit();
+    block_count_tree.shrink_to_fit();
+    rmi.shrink_to_fit();
+    bf.shrink_to_fit();
+    cf.shrink_to_fit();
+
+    if(map_hash.empty())
+    {
+      unordered_map<uint64_t, uint64_t>().swap(map_hash);
+    }
+    else
+    {
+      map_hash.rehash(0);
+    }
+
+    return before-memory_report().total_allocated_bytes();
+  }
+
+  //writes the whole filter into an image: parameters, model, block directory, blocks and hash filters
+  void save_image(snarf_image_writer &image)
+  {
+    image.put(N);
+    image.put(P);
+    image.put(block_size);
+    image.put(bit_size);
+    image.put(total_blocks);
+    image.put(gcs_size);
+    image.put(num_stored_keys);
+    image.put(min_stored_key);
+    image.put(max_stored_key);
+    image.put(fingerprint_bits);
+    image.put(block_codec.codec);
+    image.put(verification_mode);
+    image.put(use_hash_filter);
+    image.put(blocks_per_group);
+
+    image.put_serialized(rmi);
+
+    image.put_vector(vec_num_keys);
+    image.put_vector(block_offset);
+    image.put_vector(block_low_bits);
+    image.put((uint64_t)block_groups.size());
+    for(int i=0;i<block_groups.size();i++)
+    {
+      image.put_serialized(block_groups[i]);
+    }
+    image.put((uint64_t)spilled_blocks.size());
+    for(auto itr=spilled_blocks.begin();itr!=spilled_blocks.end();itr++)
+    {
+      image.put(itr->first);
+      image.put(itr->second.first);
+      image.put_serialized(itr->second.second);
+    }
+
+    image.put_serialized(bf);
+    image.put((uint64_t)bf_merged.size());
+    for(int i=0;i<bf_merged.size();i++)
+    {
+      image.put_serialized(bf_merged[i]);
+    }
+    image.put_serialized(cf);
+    image.put((uint64_t)cf_merged.size());
+    for(int i=0;i<cf_merged.size();i++)
+    {
+      image.put_serialized(cf_merged[i]);
+    }
+    return ;
+  }
+
+  //reads a filter written by save_image, replacing the contents of this one
+  void load_image(snarf_image_reader &image)
+  {
+    N=image.get<uint64_t>();
+    P=image.get<uint64_t>();
+    block_size=image.get<uint64_t>();
+    bit_size=image.get<uint64_t>();
+    total_blocks=image.get<uint64_t>();
+    gcs_size=image.get<uint64_t>();
+    num_stored_keys=image.get<uint64_t>();
+    min_stored_key=image.get<T>();
+    max_stored_key=image.get<T>();
+    fingerprint_bits=image.get<uint64_t>();
+    block_codec.codec=image.get<int>();
+    verification_mode=image.get<int>();
+    use_hash_filter=image.get<bool>();
+    uint64_t num_per_group=image.get<uint64_t>();
+
+    image.get_serialized(rmi);
+    compact_model=rmi.compact;
+
+    vector<uint16_t> num_keys,offsets;
+    vector<uint8_t> low_bits;
+    image.get_vector(num_keys);
+    image.get_vector(offsets);
+    image.get_vector(low_bits);
+    init_block_directory(num_keys.size());
+    blocks_per_group=num_per_group;
+    vec_num_keys.swap(num_keys);
+    block_offset.swap(offsets);
+    block_low_bits.swap(low_bits);
+
+    block_groups.resize(image.get<uint64_t>());
+    for(int i=0;i<block_groups.size();i++)
+    {
+      image.get_serialized(block_groups[i]);
+    }
+    uint64_t num_spilled=image.get<uint64_t>();
+    for(uint64_t i=0;i<num_spilled;i++)
+    {
+      uint64_t bb_index=image.get<uint64_t>();
+      pair<uint64_t,snarf_bitset> &spilled=spilled_blocks[bb_index];
+      spilled.first=image.get<uint64_t>();
+      image.get_serialized(spilled.second);
+    }
+
+    image.get_serialized(bf);
+    bf_merged.resize(image.get<uint64_t>());
+    for(int i=0;i<bf_merged.size();i++)
+    {
+      image.get_serialized(bf_merged[i]);
+    }
+    image.get_serialized(cf);
+    cf_merged.resize(image.get<uint64_t>());
+    for(int i=0;i<cf_merged.size();i++)
+    {
+      image.get_serialized(cf_merged[i]);
+    }
+
+    build_block_count_tree();
+    return ;
+  }
+
+  //writes a block(var bb_index) into an image, see load_block
+  void save_block(snarf_image_writer &image,uint64_t bb_index)
+  {
+    snarf_bitset_view block=block_view(bb_index);
+    snarf_bitset encoded;
+    encoded.init(block.num_bits);
+    for(uint64_t done=0;done<block.num_bits;done+=64)
+    {
+      uint64_t chunk=min((uint64_t)64,block.num_bits-done);
+      encoded.bitset_write_word(done,block.bitset_read_word(done,chunk),chunk);
+    }
+
+    image.put(bb_index);
+    image.put(block_num_keys(bb_index));
+    image.put(block_low_bits[bb_index]);
+    image.put_serialized(encoded);
+    return ;
+  }
+
+  //reads a block written by save_block and puts it in place of the block with the same index
+  void load_block(snarf_image_reader &image)
+  {
+    uint64_t bb_index=image.get<uint64_t>();
+    uint64_t num_keys=image.get<uint64_t>();
+    uint8_t low_bits=image.get<uint8_t>();
+    snarf_bitset encoded;
+    image.get_serialized(encoded);
+
+    set_encoded_block(encoded,low_bits,num_keys,bb_index);
+    range_cache.invalidate_block(bb_index);
+    return ;
+  }
+
 
 };
 
 
+
+
+//Cursor over a snarf instance for sorted probe streams (merge joins, sorted scans).
+//Consecutive range queries are expected to have non-decreasing lower endpoints.
+//The cursor keeps the current level 1 model and the decoded values of the current bit block,
+//so a sorted sequence of queries makes roughly one pass over the filter instead of one search and one block decode per query.
+//A query with a smaller lower endpoint than the previous one resets the cursor.
+template <class T>
+struct snarf_sorted_cursor
+{
+  snarf_updatable_gcs_hash<T>* filter;
+
+  //index of the level 1 model of the previous lower endpoint
+  int model_index;
+
+  //block currently decoded into block_vals, and the position of the first value not below the previous lower endpoint
+  int64_t block_index;
+  vector<uint64_t> block_vals;
+  uint64_t block_pos;
+
+  T last_lower_val;
+  bool started;
+
+  snarf_sorted_cursor<T>() {
+    filter=NULL;
+    reset();
+  }
+
+  void init(snarf_updatable_gcs_hash<T>* snarf_instance)
+  {
+    filter=snarf_instance;
+    reset();
+    return ;
+  }
+
+  //forget the position, the next query starts from the beginning of the filter
+  void reset()
+  {
+    model_index=0;
+    block_index=-1;
+    block_vals.resize(0);
+    block_pos=0;
+    started=false;
+    return ;
+  }
+
+  //bit location of a key, searching the model forward from var model_hint
+  uint64_t get_location(T key,int &model_hint)
+  {
+    model_hint=filter->rmi.search_from(key,model_hint);
+    return filter->location_from_cdf(filter->rmi.infer_at(key,model_hint));
+  }
+
+  //same answer as range_query on the filter, lower_val should not decrease between calls.
+  //Blocks are not re-decoded until the stream moves past them, so the filter should not be updated while the cursor is in use.
+  bool range_query(T lower_val,T upper_val)
+  {
+    if(started && lower_val<last_lower_val)
+    {
+      reset();
+    }
+    started=true;
+    last_lower_val=lower_val;
+
+    uint64_t block_range=filter->block_size*filter->P;
+
+    uint64_t temp_loc_lower=get_location(lower_val,model_index);
+    int upper_model_index=model_index;
+    uint64_t temp_loc_upper=get_location(upper_val,upper_model_index);
+
+    uint64_t lower_index=temp_loc_lower/block_range;
+    uint64_t upper_index=temp_loc_upper/block_range;
+
+    //move the decoded block forward
+    if(block_index!=(int64_t)lower_index)
+    {
+      block_index=lower_index;
+      filter->decode_block(block_index,block_vals);
+      block_pos=0;
+    }
+
+    uint64_t low_val1=temp_loc_lower-lower_index*block_range;
+    while(block_pos<block_vals.size() && block_vals[block_pos]<low_val1)
+    {
+      block_pos++;
+    }
+
+    if(lower_index==upper_index)
+    {
+      uint64_t up_val1=temp_loc_upper-lower_index*block_range;
+      if(block_pos<block_vals.size() && block_vals[block_pos]<=up_val1)
+      {
+        return filter->verify_in_block(lower_val,upper_val,low_val1,up_val1,lower_index);
+      }
+      return false;
+    }
+
+    //the query spans multiple blocks
+    if(block_pos<block_vals.size())
+    {
+      return true;
+    }
+
+    if(filter->keys_in_blocks(lower_index+1,upper_index)>0)
+    {
+      return true;
+    }
+
+    return filter->range_query_in_block(0,temp_loc_upper-upper_index*block_range,upper_index);
+  }
+
+};
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef SNARF_IMAGE_CPP
+#define SNARF_IMAGE_CPP
+
+#include<iostream>
+#include<string>
+#include<vector>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// Helpers to write snarf structures into binary images and read them back, see snarf_persist.cpp.
+// Values are stored in the byte order of the machine, images are not meant to move between architectures.
+
+//checksum of a byte range, used to find torn writes at the end of append only files
+inline uint64_t snarf_image_checksum(const unsigned char *data,uint64_t num_bytes)
+{
+  uint64_t h=num_bytes^0x243F6A8885A308D3ULL;
+  uint64_t i=0;
+  for(;i+8<=num_bytes;i+=8)
+  {
+    uint64_t chunk;
+    memcpy(&chunk,data+i,sizeof(chunk));
+    h=(h^chunk)*0x9E3779B97F4A7C15ULL;
+    h^=h>>32;
+  }
+  for(;i<num_bytes;i++)
+  {
+    h=(h^data[i])*0x9E3779B97F4A7C15ULL;
+    h^=h>>32;
+  }
+  return h;
+}
+
+//makes a rename or a new file in the directory of var path durable
+inline void snarf_sync_parent_dir(const string &path)
+{
+  size_t slash=path.find_last_of('/');
+  string dir=(slash==string::npos)?".":(slash==0?"/":path.substr(0,slash));
+  int fd=open(dir.c_str(),O_RDONLY);
+  if(fd>=0)
+  {
+    fsync(fd);
+    close(fd);
+  }
+  return ;
+}
+
+//appends values, arrays and serialized structures to a byte buffer
+struct snarf_image_writer
+{
+  vector<unsigned char> data;
+
+  void put_bytes(const void *src,uint64_t num_bytes)
+  {
+    const unsigned char *bytes=(const unsigned char*)src;
+    data.insert(data.end(),bytes,bytes+num_bytes);
+    return ;
+  }
+
+  template <class V>
+  void put(const V &val)
+  {
+    put_bytes(&val,sizeof(val));
+    return ;
+  }
+
+  //the size of the vector, then its elements
+  template <class V,class A>
+  void put_vector(const vector<V,A> &vec)
+  {
+    put((uint64_t)vec.size());
+    put_bytes(vec.data(),vec.size()*sizeof(V));
+    return ;
+  }
+
+  //a structure with serialized_size and serialize(unsigned char*), preceded by its size
+  template <class S>
+  void put_serialized(S &structure)
+  {
+    uint64_t num_bytes=structure.serialized_size();
+    put(num_bytes);
+    data.resize(data.size()+num_bytes);
+    structure.serialize(data.data()+data.size()-num_bytes);
+    return ;
+  }
+
+  //appends the buffer to a file opened for writing(var fd) and waits until it is on disk, returns false on failure
+  bool append_to(int fd)
+  {
+    uint64_t done=0;
+    while(done<data.size())
+    {
+      ssize_t written=write(fd,data.data()+done,data.size()-done);
+      if(written<=0)
+      {
+        return false;
+      }
+      done+=written;
+    }
+    return fdatasync(fd)==0;
+  }
+
+  //writes the buffer to a file through a temporary file, so the file holds either its old or its new contents.
+  //Returns false if the file could not be written
+  bool write_file(const string &path)
+  {
+    string temp_path=path+".tmp";
+    int fd=open(temp_path.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd<0)
+    {
+      return false;
+    }
+    bool ok=append_to(fd);
+    close(fd);
+    if(!ok || rename(temp_path.c_str(),path.c_str())!=0)
+    {
+      return false;
+    }
+    snarf_sync_parent_dir(path);
+    return true;
+  }
+};
+
+//reads values written by snarf_image_writer from a byte range, running past the end fails an assert
+struct snarf_image_reader
+{
+  unsigned char *data=NULL;
+  uint64_t size=0,offset=0;
+
+  bool at_end()
+  {
+    return offset>=size;
+  }
+
+  unsigned char* get_bytes(uint64_t num_bytes)
+  {
+    bool testbool = (num_bytes<=size-offset);
+    assert(("The image is truncated!", testbool));
+    unsigned char *ans=data+offset;
+    offset+=num_bytes;
+    return ans;
+  }
+
+  template <class V>
+  V get()
+  {
+    V val;
+    memcpy(&val,get_bytes(sizeof(val)),sizeof(val));
+    return val;
+  }
+
+  template <class V,class A>
+  void get_vector(vector<V,A> &vec)
+  {
+    uint64_t num=get<uint64_t>();
+    vec.resize(num);
+    memcpy(vec.data(),get_bytes(num*sizeof(V)),num*sizeof(V));
+    return ;
+  }
+
+  template <class S>
+  void get_serialized(S &structure)
+  {
+    uint64_t num_bytes=get<uint64_t>();
+    structure.deserialize(get_bytes(num_bytes));
+    return ;
+  }
+};
+
+//read only mapping of a whole file
+struct snarf_mapped_file
+{
+  unsigned char *data=NULL;
+  uint64_t size=0;
+
+  snarf_mapped_file() {}
+  snarf_mapped_file(const snarf_mapped_file&)=delete;
+  snarf_mapped_file& operator=(const snarf_mapped_file&)=delete;
+
+  //returns false if the file does not exist or cannot be mapped
+  bool map(const string &path)
+  {
+    unmap();
+    int fd=open(path.c_str(),O_RDONLY);
+    if(fd<0)
+    {
+      return false;
+    }
+    struct stat st;
+    if(fstat(fd,&st)!=0)
+    {
+      close(fd);
+      return false;
+    }
+    size=st.st_size;
+    if(size>0)
+    {
+      void *ptr=mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+      if(ptr==MAP_FAILED)
+      {
+        close(fd);
+        size=0;
+        return false;
+      }
+      data=(unsigned char*)ptr;
+      //the image is read once front to back
+      madvise(data,size,MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return true;
+  }
+
+  void unmap()
+  {
+    if(data!=NULL)
+    {
+      munmap(data,size);
+    }
+    data=NULL;
+    size=0;
+    return ;
+  }
+
+  snarf_image_reader reader()
+  {
+    snarf_image_reader ans;
+    ans.data=data;
+    ans.size=size;
+    return ans;
+  }
+
+  ~snarf_mapped_file()
+  {
+    unmap();
+  }
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SNARF_MEMORY_CPP
+#define SNARF_MEMORY_CPP
+
+#include<iostream>
+#include<string>
+#include<vector>
+#include <iomanip>
+using namespace std;
+
+// Helpers to account for the memory actually held by the snarf structures.
+// "logical" bytes are the bytes needed by the encoded data, "allocated" bytes are what the process holds for it:
+// container capacity, block rounding, object headers and the malloc chunk overhead.
+
+//returns the bytes the allocator holds for a heap request of var requested bytes.
+//Follows the glibc malloc chunk layout: 8 bytes of header, 16 byte alignment and a 32 byte minimum chunk
+inline uint64_t snarf_heap_bytes(uint64_t requested)
+{
+  if(requested==0)
+  {
+    return 0;
+  }
+  uint64_t chunk=(requested+8+15)&~(uint64_t)15;
+  return max((uint64_t)32,chunk);
+}
+
+//returns the bytes an allocator holds for a request of var requested bytes. Allocators other than snarf_allocator
+//take them from the heap, snarf_allocator has its own overload in snarf_alloc.cpp that follows its arena
+template <class A>
+uint64_t snarf_allocator_bytes(const A &,uint64_t requested)
+{
+  return snarf_heap_bytes(requested);
+}
+
+//returns the bytes held by the buffer of a vector
+template <class V>
+uint64_t snarf_vector_heap_bytes(const V &vec)
+{
+  return snarf_allocator_bytes(vec.get_allocator(),vec.capacity()*sizeof(typename V::value_type));
+}
+
+struct snarf_memory_component
+{
+  string name;
+  uint64_t logical_bytes;
+  uint64_t allocated_bytes;
+};
+
+// Memory used by a snarf instance, split per component
+struct snarf_memory_report
+{
+  vector<snarf_memory_component> components;
+  //bytes handed out and bytes mapped by the arena holding the arrays, if any (see snarf_alloc.cpp). The arena may
+  //hold arrays of other instances too, so these are not part of the totals
+  uint64_t arena_used_bytes=0,arena_mapped_bytes=0;
+
+  void add(string name,uint64_t logical_bytes,uint64_t allocated_bytes)
+  {
+    components.push_back({name,logical_bytes,allocated_bytes});
+    return ;
+  }
+
+  uint64_t total_logical_bytes()
+  {
+    uint64_t total=0;
+    for(int i=0;i<components.size();i++)
+    {
+      total+=components[i].logical_bytes;
+    }
+    return total;
+  }
+
+  uint64_t total_allocated_bytes()
+  {
+    uint64_t total=0;
+    for(int i=0;i<components.size();i++)
+    {
+      total+=components[i].allocated_bytes;
+    }
+    return total;
+  }
+
+  //prints one line per component, with bits per key when the number of keys(var num_keys) is given
+  void print(ostream &out,uint64_t num_keys=0)
+  {
+    out<<left<<setw(20)<<"component"<<right<<setw(16)<<"logical B"<<setw(16)<<"allocated B";
+    if(num_keys>0)
+    {
+      out<<setw(16)<<"alloc bits/key";
+    }
+    out<<endl;
+
+    for(int i=0;i<=components.size();i++)
+    {
+      string name=(i<components.size())?components[i].name:"total";
+      uint64_t logical_bytes=(i<components.size())?components[i].logical_bytes:total_logical_bytes();
+      uint64_t allocated_bytes=(i<components.size())?components[i].allocated_bytes:total_allocated_bytes();
+
+      out<<left<<setw(20)<<name<<right<<setw(16)<<logical_bytes<<setw(16)<<allocated_bytes;
+      if(num_keys>0)
+      {
+        streamsize precision=out.precision();
+        out<<setw(16)<<fixed<<setprecision(3)<<allocated_bytes*8.00/num_keys<<defaultfloat<<setprecision(precision);
+      }
+      out<<endl;
+    }
+    if(arena_mapped_bytes>0)
+    {
+      out<<left<<setw(20)<<"arena used"<<right<<setw(16)<<""<<setw(16)<<arena_used_bytes<<endl;
+      out<<left<<setw(20)<<"arena mapped"<<right<<setw(16)<<""<<setw(16)<<arena_mapped_bytes<<endl;
+    }
+    return ;
+  }
+};
+
+#endif
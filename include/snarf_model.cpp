@@ -11,15 +11,101 @@
 using namespace std;
 using namespace std::chrono; 
 
+#include "snarf_memory.cpp"
+
+// Type used for the distance between two keys. It is the unsigned version of an integer key type, so that the
+// difference of any two keys (including signed and 128 bit keys) is exact. Floating point keys use the key type itself.
+template <class T, bool is_integer=is_integral<T>::value>
+struct snarf_key_traits
+{
+  typedef T distance_type;
+};
+
+template <class T>
+struct snarf_key_traits<T,true>
+{
+  typedef typename make_unsigned<T>::type distance_type;
+};
+
+// 128 bit integers are not is_integral in strict ISO mode
+template <>
+struct snarf_key_traits<__int128,false>
+{
+  typedef unsigned __int128 distance_type;
+};
+
+template <>
+struct snarf_key_traits<unsigned __int128,false>
+{
+  typedef unsigned __int128 distance_type;
+};
+
+//folds a key into 64 bits for hashing, the high half of 128 bit keys is mixed in instead of dropped
+template <class T>
+uint64_t snarf_key_fold(T key)
+{
+  if constexpr (is_floating_point<T>::value)
+  {
+    double temp=key;
+    uint64_t ans;
+    memcpy(&ans,&temp,sizeof(ans));
+    return ans;
+  }
+  else if constexpr (sizeof(T)>sizeof(uint64_t))
+  {
+    return (uint64_t)key^((uint64_t)(key>>64)*0x9E3779B97F4A7C15ULL);
+  }
+  else
+  {
+    return (uint64_t)key;
+  }
+}
+
+//returns larger-smaller without overflow, larger should not be less than smaller
+template <class T>
+typename snarf_key_traits<T>::distance_type snarf_key_distance(T larger,T smaller)
+{
+  typedef typename snarf_key_traits<T>::distance_type distance_type;
+  return (distance_type)larger-(distance_type)smaller;
+}
+
 //Implementation of the model used in SNARF
 template <class T>
 struct snarf_model
 {
+  typedef typename snarf_key_traits<T>::distance_type distance_type;
+
   double level_0_slope,level_0_bias;
   int num_models=1000000;
+  //number of keys covered by each linear model in level 1
+  int keys_per_model=10000;
+  //smallest key the model was built with, the left end of the first linear model
+  T first_key=T(0);
   vector<T> first_level;
   vector<double> level_1_slope,level_1_bias;
 
+  //Compact encoding of the model, see compress. When compact is set the three vectors above are empty and
+  //boundary(i), bias(i) and slope(i) decode the values in place
+  static constexpr int compact_group_size=128;
+  //biases are stored in fixed point with 48 fractional bits
+  static constexpr double compact_bias_scale=281474976710656.0;
+  struct compact_group
+  {
+    //boundary before the first model of the group (first_key for the first group) and its fixed point bias
+    T anchor;
+    uint64_t bias_base;
+    uint8_t boundary_shift,bias_shift;
+  };
+  bool compact=false;
+  vector<compact_group> compact_groups;
+  //boundary of each model as (boundary-anchor)>>boundary_shift
+  vector<uint32_t> boundary_delta;
+  //bias of each model as a correction of bias_base+(position in the group)*bias_step, in units of 1<<bias_shift
+  vector<int16_t> bias_residual;
+  uint64_t bias_step=0;
+  //slope of each model as a fraction(out of 65535) of the slope of the chord between the biases of the model and of the previous model
+  vector<uint16_t> slope_ratio;
+
   // Generates Slopes and Biases of linear models in level 1
   void generate_slope_bias_level_1(vector<T> &keys,vector<double> &ecdf)
   {
@@ -29,7 +115,7 @@ struct snarf_model
     level_1_bias.resize(num_models,0.0);
     level_1_slope.resize(num_models,0.0);
 
-    vector<T> max_val_vec(num_models,0),min_val_vec(num_models,0);
+    vector<distance_type> max_val_vec(num_models,0),min_val_vec(num_models,0);
     vector<int> count_items_model(num_models,0);
     vector<double> max_cdf_vec(num_models,0.0),min_cdf_vec(num_models,0.0);
 
@@ -37,17 +123,17 @@ struct snarf_model
     for(int i=0;i<N;i++)
     {
       double est_cdf;
-      T consider;
+      distance_type consider;
       int bin_index=binary_search(keys[i]);
 
-      if(keys[i]>=first_level[bin_index])
+      if(keys[i]>first_level[bin_index])
       {
         consider=0;
         est_cdf=num_models-1; 
       }
       else
       {
-        consider=first_level[bin_index]-keys[i];
+        consider=snarf_key_distance(first_level[bin_index],keys[i]);
         est_cdf=bin_index;
       }
 
@@ -74,17 +160,17 @@ struct snarf_model
     }
     
 
-    vector<T> new_max_val_vec(num_models,0),new_min_val_vec(num_models,0);
+    vector<distance_type> new_max_val_vec(num_models,0),new_min_val_vec(num_models,0);
     //needed to handle empty models 
     for(int i=0;i<num_models;i++)
     {
       if(i==0)
       {
-        new_max_val_vec[i]=first_level[i]-keys[0];
+        new_max_val_vec[i]=snarf_key_distance(first_level[i],keys[0]);
       }
       else
       {
-        new_max_val_vec[i]=first_level[i]-first_level[i-1];
+        new_max_val_vec[i]=snarf_key_distance(first_level[i],first_level[i-1]);
       }
     }
 
@@ -92,10 +178,18 @@ struct snarf_model
     double temp_slope,temp_bias;
     for(int i=0;i<num_models;i++)
     {
-      uint64_t diff=(new_max_val_vec[i]-new_min_val_vec[i]);
-      temp_slope=(max_cdf_vec[i]-min_cdf_vec[i])*1.00/((diff)*1.00);
+      distance_type diff=(new_max_val_vec[i]-new_min_val_vec[i]);
+      //a model over a single distinct key has no slope
+      if(diff==0)
+      {
+        temp_slope=0.0;
+      }
+      else
+      {
+        temp_slope=(max_cdf_vec[i]-min_cdf_vec[i])*1.00/((double)diff);
+      }
 
-      temp_bias=max_cdf_vec[i]-(new_min_val_vec[i]*temp_slope);
+      temp_bias=max_cdf_vec[i]-((double)new_min_val_vec[i]*temp_slope);
       level_1_slope[i]=temp_slope;
       level_1_bias[i]=temp_bias;
      
@@ -112,8 +206,8 @@ struct snarf_model
     bool testbool = (N>10000);
     assert(("The number of keys are smaller than 10000, difficult to build a model for this!", testbool));
 
-    //Number of models used is num_keys/10000.0. VARY THIS PARAMETER TO GET BETTER PRECISION
-    num_models=ceil(N/10000.0);
+    //Number of models used is num_keys/keys_per_model. VARY THIS PARAMETER TO GET BETTER PRECISION
+    num_models=ceil(N*1.00/keys_per_model);
 
     sort(keys.begin(),keys.end());
 
@@ -125,7 +219,7 @@ struct snarf_model
       ecdf[i]=i*1.00/N;
     }
 
-    first_level.resize(num_models,0.0);
+    first_level.resize(num_models,T(0));
 
     for(int i=0;i<num_models;i++)
     {
@@ -133,6 +227,7 @@ struct snarf_model
     }
 
     first_level[num_models-1]=keys[N-1];
+    first_key=keys[0];
 
     //build level 1
     generate_slope_bias_level_1(keys,ecdf);
@@ -140,9 +235,284 @@ struct snarf_model
     return ;
   }
 
+  //boundary of the level 1 model at var index, the largest key it covers
+  T boundary(int index)
+  {
+    if(!compact)
+    {
+      return first_level[index];
+    }
+    compact_group &group=compact_groups[index/compact_group_size];
+    if constexpr (is_floating_point<T>::value)
+    {
+      float offset;
+      memcpy(&offset,&boundary_delta[index],sizeof(offset));
+      return group.anchor+(T)offset;
+    }
+    else
+    {
+      return (T)((distance_type)group.anchor+((distance_type)boundary_delta[index]<<group.boundary_shift));
+    }
+  }
+
+  //estimated cdf at the boundary of the level 1 model at var index, 0 before the first model
+  double bias(int index)
+  {
+    if(index<0)
+    {
+      return 0.0;
+    }
+    if(!compact)
+    {
+      return level_1_bias[index];
+    }
+    return compact_bias_fixed(index)/compact_bias_scale;
+  }
+
+  uint64_t compact_bias_fixed(int index)
+  {
+    compact_group &group=compact_groups[index/compact_group_size];
+    uint64_t position=index%compact_group_size+1;
+    int64_t units=(int64_t)(position*(bias_step>>group.bias_shift))+bias_residual[index];
+    return group.bias_base+((uint64_t)units<<group.bias_shift);
+  }
+
+  //slope of the level 1 model at var index
+  double slope(int index)
+  {
+    if(!compact)
+    {
+      return level_1_slope[index];
+    }
+    T left=(index==0)?first_key:boundary(index-1);
+    distance_type width=snarf_key_distance(boundary(index),left);
+    if(width==0)
+    {
+      return 0.0;
+    }
+    return (slope_ratio[index]/65535.0)*(bias(index)-bias(index-1))/((double)width);
+  }
+
+  //Converts the model to its compact encoding, about 8 bytes per level 1 model instead of 2 doubles and a key.
+  //Models are stored in groups of compact_group_size:
+  //  - boundaries are offsets from the first boundary before the group, shifted right so the largest fits in 32 bits
+  //    (integer keys) or rounded down to a float (floating point keys)
+  //  - biases are implicit, position in the model array times bias_step, plus a 16 bit correction scaled per group
+  //  - slopes are stored relative to the chord between the two biases of the model
+  //Every value is rounded down, so boundaries and biases stay in order and a model never rises above the next one:
+  //the encoded model is monotonic like the original. Boundaries move by at most 1<<boundary_shift, a fraction 2^-32 of
+  //the keys spanned by the group. The filter must compute its locations with the compact model, call before inserting keys
+  void compress()
+  {
+    if(compact || num_models==0)
+    {
+      return ;
+    }
+
+    int num_groups=(num_models+compact_group_size-1)/compact_group_size;
+    compact_groups.resize(num_groups);
+    boundary_delta.resize(num_models);
+    bias_residual.resize(num_models);
+    slope_ratio.resize(num_models);
+    bias_step=(uint64_t)(compact_bias_scale/num_models);
+
+    vector<T> old_boundary=first_level;
+    vector<uint64_t> old_bias(num_models);
+    uint64_t running=0;
+    for(int i=0;i<num_models;i++)
+    {
+      double clamped=max(0.0,min(1.0,level_1_bias[i]));
+      running=max(running,(uint64_t)(clamped*compact_bias_scale));
+      old_bias[i]=running;
+    }
+
+    uint64_t prev_bias=0;
+    for(int g=0;g<num_groups;g++)
+    {
+      int begin=g*compact_group_size,end=min(num_models,begin+compact_group_size);
+      compact_group &group=compact_groups[g];
+      group.anchor=(g==0)?first_key:old_boundary[begin-1];
+      group.bias_base=prev_bias;
+
+      //boundaries
+      group.boundary_shift=0;
+      for(int i=begin;i<end;i++)
+      {
+        distance_type offset=(old_boundary[i]>group.anchor)?snarf_key_distance(old_boundary[i],group.anchor):0;
+        if constexpr (is_floating_point<T>::value)
+        {
+          float rounded=(float)offset;
+          while(rounded>0.0f && group.anchor+(T)rounded>old_boundary[i])
+          {
+            rounded=nextafterf(rounded,0.0f);
+          }
+          memcpy(&boundary_delta[i],&rounded,sizeof(rounded));
+        }
+        else
+        {
+          while((offset>>group.boundary_shift)>UINT32_MAX)
+          {
+            group.boundary_shift++;
+          }
+        }
+      }
+      if constexpr (!is_floating_point<T>::value)
+      {
+        for(int i=begin;i<end;i++)
+        {
+          distance_type offset=(old_boundary[i]>group.anchor)?snarf_key_distance(old_boundary[i],group.anchor):0;
+          boundary_delta[i]=(uint32_t)(offset>>group.boundary_shift);
+        }
+      }
+
+      //biases, the smallest shift whose corrections fit in 16 bits
+      group.bias_shift=0;
+      while(true)
+      {
+        bool fits=true;
+        uint64_t step_units=bias_step>>group.bias_shift;
+        for(int i=begin;i<end && fits;i++)
+        {
+          int64_t units=(int64_t)((old_bias[i]-group.bias_base)>>group.bias_shift);
+          int64_t residual=units-(int64_t)((i-begin+1)*step_units);
+          fits=(residual>=INT16_MIN && residual<=INT16_MAX);
+        }
+        if(fits)
+        {
+          break;
+        }
+        group.bias_shift++;
+      }
+      uint64_t step_units=bias_step>>group.bias_shift;
+      for(int i=begin;i<end;i++)
+      {
+        int64_t units=(int64_t)((old_bias[i]-group.bias_base)>>group.bias_shift);
+        bias_residual[i]=(int16_t)(units-(int64_t)((i-begin+1)*step_units));
+      }
+      prev_bias=compact_bias_fixed(end-1);
+    }
+
+    //slopes, relative to the chord of the encoded boundaries and biases
+    compact=true;
+    for(int i=0;i<num_models;i++)
+    {
+      T left=(i==0)?first_key:boundary(i-1);
+      distance_type width=snarf_key_distance(boundary(i),left);
+      double gap=bias(i)-bias(i-1);
+      double ratio=(width==0 || gap<=0.0)?0.0:level_1_slope[i]*((double)width)/gap;
+      ratio=max(0.0,min(1.0,ratio));
+      slope_ratio[i]=(uint16_t)floor(ratio*65535.0);
+    }
+
+    first_level=vector<T>();
+    level_1_slope=vector<double>();
+    level_1_bias=vector<double>();
+    return ;
+  }
+
+  //returns the slope of a model(var source) between two keys(var left, var right) with no boundary of the model between them.
+  //This is the slope of its linear model, or the slope of the chord where the model is clamped
+  static double merge_slope(snarf_model<T> &source,T left,T right)
+  {
+    distance_type width=snarf_key_distance(right,left);
+    if(width==0 || right>source.boundary(source.num_models-1))
+    {
+      return 0.0;
+    }
+
+    int index=source.binary_search(right);
+    double left_cdf=source.bias(index)-source.slope(index)*(double)snarf_key_distance(source.boundary(index),left);
+    if(left_cdf<0.0)
+    {
+      return (source.infer(right)-source.infer(left))/((double)width);
+    }
+    return source.slope(index);
+  }
+
+  //Builds the model of the union of the key sets of two models(var a, var b) holding num_keys_a and num_keys_b keys,
+  //without the keys. The cdf of the union is the weighted sum of the two cdfs. The boundaries are the union of their
+  //boundaries, so both models are linear inside each linear model of the union and the sum is exact
+  void snarf_model_merge(snarf_model<T> &a,uint64_t num_keys_a,snarf_model<T> &b,uint64_t num_keys_b)
+  {
+    vector<T> boundaries_a(a.num_models),boundaries_b(b.num_models);
+    for(int i=0;i<a.num_models;i++)
+    {
+      boundaries_a[i]=a.boundary(i);
+    }
+    for(int i=0;i<b.num_models;i++)
+    {
+      boundaries_b[i]=b.boundary(i);
+    }
+    first_level.resize(0);
+    merge(boundaries_a.begin(),boundaries_a.end(),boundaries_b.begin(),boundaries_b.end(),back_inserter(first_level));
+    first_level.erase(unique(first_level.begin(),first_level.end()),first_level.end());
+
+    num_models=first_level.size();
+    first_key=min(a.first_key,b.first_key);
+    level_1_slope.resize(num_models,0.0);
+    level_1_bias.resize(num_models,0.0);
+
+    double weight_a=num_keys_a*1.00/(num_keys_a+num_keys_b);
+    double weight_b=1.00-weight_a;
+
+    for(int i=0;i<num_models;i++)
+    {
+      T left=(i==0)?first_key:first_level[i-1];
+      level_1_bias[i]=weight_a*a.infer(first_level[i])+weight_b*b.infer(first_level[i]);
+      level_1_slope[i]=weight_a*merge_slope(a,left,first_level[i])+weight_b*merge_slope(b,left,first_level[i]);
+    }
+
+    return ;
+  }
+
+  //returns a key whose estimated cdf is close to var cdf, the inverse of infer up to rounding.
+  //The right end of each linear model has cdf level_1_bias, so the model holding the cdf is found by a search over the biases
+  T inverse_infer(double cdf)
+  {
+    int start=0,end=num_models;
+    while(start<end)
+    {
+      int mid=(start+end)/2;
+      if(bias(mid)<cdf)
+      {
+        start=mid+1;
+      }
+      else
+      {
+        end=mid;
+      }
+    }
+    int index=start;
+    if(index>=num_models)
+    {
+      return boundary(num_models-1);
+    }
+    double model_slope=slope(index);
+    T right=boundary(index);
+    if(model_slope<=0.0)
+    {
+      return right;
+    }
+
+    //distance to the left of the right end of the model, clamped to the left end of the model
+    T left=(index==0)?first_key:boundary(index-1);
+    double dist=(bias(index)-cdf)/model_slope;
+    distance_type width=snarf_key_distance(right,left);
+    if(!(dist<(double)width))
+    {
+      return left;
+    }
+    return right-(distance_type)dist;
+  }
+
   //binary searching the first level to obtain the index of the linear model in level 1.
   int binary_search(T key)
   {
+    if(compact)
+    {
+      return compact_search(key);
+    }
+
     int start=0,end=first_level.size()-1;
     int mid=(start+end)/2;
 
@@ -173,24 +543,105 @@ struct snarf_model
 
   }
 
-  //get the estimated cdf for a key
-  double infer(T key)
+  //binary_search on the compact encoding: the group is found from the anchors, then the model inside the group.
+  //The anchor of a group is at least the encoded boundaries before it, so a key above the anchor of a group is above every earlier model
+  int compact_search(T key)
   {
+    int start=0,end=compact_groups.size();
+    while(start<end)
+    {
+      int mid=(start+end)/2;
+      if(compact_groups[mid].anchor<key)
+      {
+        start=mid+1;
+      }
+      else
+      {
+        end=mid;
+      }
+    }
+    if(start==0)
+    {
+      return 0;
+    }
 
-    double est_cdf;
-    T consider;
+    int group_index=start-1;
+    int first=group_index*compact_group_size;
+    int last=min(num_models,first+compact_group_size);
+    while(first<last)
+    {
+      int mid=(first+last)/2;
+      if(boundary(mid)<key)
+      {
+        first=mid+1;
+      }
+      else
+      {
+        last=mid;
+      }
+    }
+    return min(first,num_models-1);
+  }
 
-    // Get the index of the level 1 model
-    int index=binary_search(key);
+  //searches forward from a previously returned index(var hint) for the index of the linear model in level 1.
+  //Used by sorted probe streams, where consecutive keys mostly stay in the same or a nearby model.
+  //Returns the same index as binary_search.
+  int search_from(T key,int hint)
+  {
+    int last=num_models-1;
+    hint=max(0,min(last,hint));
+
+    //the key is before the hint, do a regular search
+    if(hint>0 && boundary(hint-1)>=key)
+    {
+      return binary_search(key);
+    }
 
-    if(key>=first_level[index])
+    if(boundary(hint)>=key || hint==last)
+    {
+      return hint;
+    }
+
+    //gallop forward until the model boundary reaches the key
+    int step=1;
+    while(hint+step<last && boundary(hint+step)<key)
+    {
+      step*=2;
+    }
+
+    int start=hint+step/2+1,end=min(last,hint+step);
+    while(start<end)
+    {
+      int mid=(start+end)/2;
+      if(boundary(mid)<key)
+      {
+        start=mid+1;
+      }
+      else
+      {
+        end=mid;
+      }
+    }
+
+    return start;
+  }
+
+  //get the estimated cdf for a key using the level 1 model at a given index(var index)
+  double infer_at(T key,int index)
+  {
+
+    double est_cdf;
+    distance_type consider;
+
+    T right=boundary(index);
+    if(key>right)
     {
       consider=0;
       est_cdf=num_models-1; 
     }
     else
     {
-      consider=first_level[index]-key;
+      consider=snarf_key_distance(right,key);
       est_cdf=index;
     }
 
@@ -200,7 +651,7 @@ struct snarf_model
     est_pos=min(num_models-1,est_pos);
 
     // Use the level 1 model
-    double ans=level_1_bias[est_pos]-level_1_slope[est_pos]*consider;
+    double ans=(consider==0)?bias(est_pos):bias(est_pos)-slope(est_pos)*(double)consider;
    
     ans=max(0.0,ans);
     ans=min(1.0,ans);
@@ -208,103 +659,164 @@ struct snarf_model
     return ans;
   }
 
+  //get the estimated cdf for a key
+  double infer(T key)
+  {
+    // Get the index of the level 1 model
+    return infer_at(key,binary_search(key));
+  }
+
   // Returns the size used by the snarf_model in bytes
-  int return_size()
+  uint64_t return_size()
   {
     double a=10.09,b;
 
-    int size_of_template=sizeof(first_level[0]);
-    int total_size=0;
+    int size_of_template=sizeof(T);
+    uint64_t total_size=0;
     total_size+=sizeof(num_models);
     total_size+=sizeof(size_of_template);
-    total_size+=num_models*sizeof(first_level[0]);
+    if(compact)
+    {
+      total_size+=compact_groups.size()*sizeof(compact_group)+sizeof(bias_step);
+      total_size+=num_models*(sizeof(boundary_delta[0])+sizeof(bias_residual[0])+sizeof(slope_ratio[0]));
+      return total_size;
+    }
+    total_size+=num_models*sizeof(T);
     total_size+=2*num_models*sizeof(a);
     
     return total_size; 
   }
 
-  // writes the model contents into a char array
-  void serialize(unsigned char* arr)
+  // Returns the heap bytes held by the model vectors, including unused capacity
+  uint64_t allocated_size()
   {
+    return snarf_vector_heap_bytes(first_level)+snarf_vector_heap_bytes(level_1_slope)+snarf_vector_heap_bytes(level_1_bias)
+           +snarf_vector_heap_bytes(compact_groups)+snarf_vector_heap_bytes(boundary_delta)+snarf_vector_heap_bytes(bias_residual)
+           +snarf_vector_heap_bytes(slope_ratio);
+  }
 
-    double a=0.0;
-    int size_of_template=sizeof(first_level[0]);
+  // releases the unused capacity of the model vectors
+  void shrink_to_fit()
+  {
+    first_level.shrink_to_fit();
+    level_1_slope.shrink_to_fit();
+    level_1_bias.shrink_to_fit();
+    compact_groups.shrink_to_fit();
+    boundary_delta.shrink_to_fit();
+    bias_residual.shrink_to_fit();
+    slope_ratio.shrink_to_fit();
+    return ;
+  }
 
-    int total_size=0;
-    total_size+=sizeof(num_models);
-    total_size+=sizeof(size_of_template);
-    total_size+=num_models*sizeof(first_level[0]);
-    total_size+=2*num_models*sizeof(a);
+  // Returns the number of bytes written by serialize
+  uint64_t serialized_size()
+  {
+    uint64_t total_size=3*sizeof(int)+sizeof(first_key)+sizeof(keys_per_model);
+    if(compact)
+    {
+      total_size+=sizeof(bias_step)+compact_groups.size()*(sizeof(T)+sizeof(uint64_t)+2*sizeof(uint8_t));
+      total_size+=num_models*(sizeof(boundary_delta[0])+sizeof(bias_residual[0])+sizeof(slope_ratio[0]));
+      return total_size;
+    }
+    return total_size+num_models*(sizeof(T)+2*sizeof(double));
+  }
+
+  //copies var num_bytes bytes at var src to var arr at var offset and advances the offset
+  static void write_bytes(unsigned char* arr,uint64_t &offset,const void *src,uint64_t num_bytes)
+  {
+    memcpy(arr+offset,src,num_bytes);
+    offset+=num_bytes;
+    return ;
+  }
 
-    int offset=0;
-    memcpy(arr+offset,&num_models,sizeof(num_models));
-    offset+=sizeof(num_models);
+  static void read_bytes(unsigned char* arr,uint64_t &offset,void *dest,uint64_t num_bytes)
+  {
+    memcpy(dest,arr+offset,num_bytes);
+    offset+=num_bytes;
+    return ;
+  }
 
-    memcpy(arr+offset,&size_of_template,sizeof(num_models));
-    offset+=sizeof(size_of_template);
+  // writes the model contents into a char array: the number of models, the size of a key, whether the model is compact,
+  // the first key, the keys per model, then the vectors of the full or of the compact encoding
+  void serialize(unsigned char* arr)
+  {
+    int size_of_template=sizeof(T);
+    int is_compact=compact;
 
-    for(int i=0;i<num_models;i++)
-    {
-      memcpy(arr+offset,&first_level[i],sizeof(first_level[0]));
-      offset+=sizeof(first_level[0]);
-    }
+    uint64_t offset=0;
+    write_bytes(arr,offset,&num_models,sizeof(num_models));
+    write_bytes(arr,offset,&size_of_template,sizeof(size_of_template));
+    write_bytes(arr,offset,&is_compact,sizeof(is_compact));
+    write_bytes(arr,offset,&first_key,sizeof(first_key));
+    write_bytes(arr,offset,&keys_per_model,sizeof(keys_per_model));
 
-    for(int i=0;i<num_models;i++)
+    if(!compact)
     {
-      memcpy(arr+offset,&level_1_slope[i],sizeof(level_1_slope[0]));
-      offset+=sizeof(level_1_slope[0]);
+      write_bytes(arr,offset,first_level.data(),num_models*sizeof(T));
+      write_bytes(arr,offset,level_1_slope.data(),num_models*sizeof(double));
+      write_bytes(arr,offset,level_1_bias.data(),num_models*sizeof(double));
+      return ;
     }
 
-    for(int i=0;i<num_models;i++)
+    write_bytes(arr,offset,&bias_step,sizeof(bias_step));
+    //field by field, the padding of compact_group is not written
+    for(int i=0;i<compact_groups.size();i++)
     {
-      memcpy(arr+offset,&level_1_bias[i],sizeof(level_1_bias[0]));
-      offset+=sizeof(level_1_bias[0]);
+      write_bytes(arr,offset,&compact_groups[i].anchor,sizeof(T));
+      write_bytes(arr,offset,&compact_groups[i].bias_base,sizeof(uint64_t));
+      write_bytes(arr,offset,&compact_groups[i].boundary_shift,sizeof(uint8_t));
+      write_bytes(arr,offset,&compact_groups[i].bias_shift,sizeof(uint8_t));
     }
-
-
+    write_bytes(arr,offset,boundary_delta.data(),num_models*sizeof(boundary_delta[0]));
+    write_bytes(arr,offset,bias_residual.data(),num_models*sizeof(bias_residual[0]));
+    write_bytes(arr,offset,slope_ratio.data(),num_models*sizeof(slope_ratio[0]));
     return ;
   }
 
   // reads the model contents from a char array
   void deserialize(unsigned char* arr)
   {
-    double a=10.09,b;
-    int temp_int=0;
-    int offset=0;
     int size_of_template=0;
-
-    memcpy(&num_models,arr+offset,sizeof(temp_int));
-    offset+=sizeof(temp_int);
-
-    memcpy(&size_of_template,arr+offset,sizeof(temp_int));
-    offset+=sizeof(temp_int);
-
-    first_level.resize(num_models,0);
-    level_1_slope.resize(num_models,0);
-    level_1_bias.resize(num_models,0);
-
-
-
-    for(int i=0;i<num_models;i++)
+    int is_compact=0;
+
+    uint64_t offset=0;
+    read_bytes(arr,offset,&num_models,sizeof(num_models));
+    read_bytes(arr,offset,&size_of_template,sizeof(size_of_template));
+    read_bytes(arr,offset,&is_compact,sizeof(is_compact));
+    read_bytes(arr,offset,&first_key,sizeof(first_key));
+    read_bytes(arr,offset,&keys_per_model,sizeof(keys_per_model));
+
+    bool testbool = (size_of_template==sizeof(T));
+    assert(("The model was written with a different key type!", testbool));
+
+    compact=is_compact;
+    first_level.resize(compact?0:num_models);
+    level_1_slope.resize(compact?0:num_models);
+    level_1_bias.resize(compact?0:num_models);
+    compact_groups.resize(compact?(num_models+compact_group_size-1)/compact_group_size:0);
+    boundary_delta.resize(compact?num_models:0);
+    bias_residual.resize(compact?num_models:0);
+    slope_ratio.resize(compact?num_models:0);
+
+    if(!compact)
     {
-      memcpy(&first_level[i],arr+offset,sizeof(first_level[0]));
-      offset+=sizeof(first_level[0]);
+      read_bytes(arr,offset,first_level.data(),num_models*sizeof(T));
+      read_bytes(arr,offset,level_1_slope.data(),num_models*sizeof(double));
+      read_bytes(arr,offset,level_1_bias.data(),num_models*sizeof(double));
+      return ;
     }
 
-    first_level.resize(1,0);
-
-    for(int i=0;i<num_models;i++)
+    read_bytes(arr,offset,&bias_step,sizeof(bias_step));
+    for(int i=0;i<compact_groups.size();i++)
     {
-      memcpy(&level_1_slope[i],arr+offset,sizeof(level_1_slope[0]));
-      offset+=sizeof(level_1_slope[0]);
+      read_bytes(arr,offset,&compact_groups[i].anchor,sizeof(T));
+      read_bytes(arr,offset,&compact_groups[i].bias_base,sizeof(uint64_t));
+      read_bytes(arr,offset,&compact_groups[i].boundary_shift,sizeof(uint8_t));
+      read_bytes(arr,offset,&compact_groups[i].bias_shift,sizeof(uint8_t));
     }
-
-    for(int i=0;i<num_models;i++)
-    {
-      memcpy(&level_1_bias[i],arr+offset,sizeof(level_1_bias[0]));
-      offset+=sizeof(level_1_bias[0]);
-    }
-
+    read_bytes(arr,offset,boundary_delta.data(),num_models*sizeof(boundary_delta[0]));
+    read_bytes(arr,offset,bias_residual.data(),num_models*sizeof(bias_residual[0]));
+    read_bytes(arr,offset,slope_ratio.data(),num_models*sizeof(slope_ratio[0]));
     return ;
   }
 
@@ -0,0 +1,434 @@
+#include<iostream>
+#include<algorithm>
+#include<string>
+#include<vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "snarf_hash.cpp"
+
+// Operations recorded in the operation log and in the hash filter part of checkpoint segments
+enum snarf_log_op
+{
+  SNARF_LOG_INSERT=1,
+  SNARF_LOG_DELETE=2
+};
+
+//SNARF whose inserts and deletes survive restarts. The state lives in three files next to each other:
+//  path.base  : image of the whole filter (see save_image), mapped and loaded on recovery
+//  path.delta : checkpoint segments appended after the base image. A segment holds the blocks changed since the
+//               previous checkpoint and the hash filter operations since then, so a checkpoint writes only what changed
+//  path.log   : operations since the last checkpoint, appended as they happen
+//Every operation gets a sequence number. The base image and each segment record the last operation they include,
+//and recovery skips what is already included, so a crash between two steps of a checkpoint never applies an
+//operation twice. Torn writes at the end of the delta or the log (a crash while appending) are detected with
+//checksums and dropped.
+//When the segments grow past compact_ratio of the base image, the checkpoint writes a new base image instead.
+//Recovery copies the mapped base image into the heap arrays of snarf_instance and replays the segments and the log onto
+//that copy, instead of querying the mapped image in place under an overlay of the changes: the block accessors of
+//snarf_updatable_gcs_hash read only their own arrays. While the image loads, the mapped pages and the copy coexist,
+//so peak memory is up to twice the image. The mapped pages are clean file pages the kernel can drop at any time,
+//read front to back (MADV_SEQUENTIAL), and unmapped as soon as the image is loaded, before the segments are applied.
+template <class T>
+struct snarf_persistent_hash
+{
+  //"SNARFIM1" and "SNARFSG1"
+  static constexpr uint64_t image_magic=0x314D494652414E53ULL;
+  static constexpr uint64_t segment_magic=0x3147534652414E53ULL;
+
+  snarf_updatable_gcs_hash<T> snarf_instance;
+
+  string path;
+  //last operation applied, and last operation included in the base image and in the checkpoints
+  uint64_t last_seq=0,base_seq=0,checkpoint_seq=0;
+  //hash filter operations since the last checkpoint, (op, folded key)
+  vector<pair<uint8_t,uint64_t>> pending_hash_ops;
+
+  int log_fd=-1,delta_fd=-1;
+  uint64_t base_bytes=0,delta_bytes=0;
+
+  //waits for each log record to reach the disk before the operation returns. Without it a record survives
+  //a crash of the process but not of the machine
+  bool sync_log=false;
+  double compact_ratio=0.5;
+
+  snarf_persistent_hash() {}
+  snarf_persistent_hash(const snarf_persistent_hash&)=delete;
+  snarf_persistent_hash& operator=(const snarf_persistent_hash&)=delete;
+
+  ~snarf_persistent_hash()
+  {
+    close_files();
+  }
+
+  string base_path() { return path+".base"; }
+  string delta_path() { return path+".delta"; }
+  string log_path() { return path+".log"; }
+
+  void close_files()
+  {
+    if(log_fd>=0)
+    {
+      close(log_fd);
+    }
+    if(delta_fd>=0)
+    {
+      close(delta_fd);
+    }
+    log_fd=-1;
+    delta_fd=-1;
+    return ;
+  }
+
+  //opens the delta and the log for appending, keeping only their first var delta_size and var log_size bytes
+  bool open_append_files(uint64_t delta_size,uint64_t log_size)
+  {
+    close_files();
+    delta_fd=open(delta_path().c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+    log_fd=open(log_path().c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+    if(delta_fd<0 || log_fd<0 || ftruncate(delta_fd,delta_size)!=0 || ftruncate(log_fd,log_size)!=0)
+    {
+      close_files();
+      return false;
+    }
+    delta_bytes=delta_size;
+    snarf_sync_parent_dir(path);
+    return true;
+  }
+
+  //builds the filter over var keys (see snarf_updatable_gcs_hash::snarf_init) and writes its first base image,
+  //replacing any filter stored at var file_path. Set the codec, fingerprints and hash filter on snarf_instance first
+  bool create(const string &file_path,vector<T> &keys,double bits_per_key,int num_ele_per_block,double num_hash_bits,int num_hash_functions=10)
+  {
+    path=file_path;
+    snarf_instance.snarf_init(keys,bits_per_key,num_ele_per_block,num_hash_bits,num_hash_functions);
+    snarf_instance.enable_dirty_tracking();
+    last_seq=0;
+    pending_hash_ops.resize(0);
+    return write_base() && open_append_files(0,0);
+  }
+
+  //----------------------------------------
+  //UPDATES AND QUERIES
+  //----------------------------------------
+
+  //an operation is applied before it is logged: an operation that fails (e.g. deleting a missing key) is never replayed
+  void insert_key(T key)
+  {
+    snarf_instance.insert_key(key);
+    log_operation(SNARF_LOG_INSERT,key);
+    return ;
+  }
+
+  void delete_key(T key)
+  {
+    snarf_instance.delete_key(key);
+    log_operation(SNARF_LOG_DELETE,key);
+    return ;
+  }
+
+  bool range_query(T lower_val,T upper_val)
+  {
+    return snarf_instance.range_query(lower_val,upper_val);
+  }
+
+  bool contains(T key)
+  {
+    return snarf_instance.contains(key);
+  }
+
+  //a log record is the sequence number, the operation, the key and a checksum of the three
+  static uint64_t log_record_size()
+  {
+    return 2*sizeof(uint64_t)+sizeof(uint8_t)+sizeof(T);
+  }
+
+  void log_operation(uint8_t op,T key)
+  {
+    last_seq++;
+    pending_hash_ops.push_back(make_pair(op,snarf_key_fold(key)));
+
+    unsigned char record[2*sizeof(uint64_t)+sizeof(uint8_t)+sizeof(T)];
+    memcpy(record,&last_seq,sizeof(last_seq));
+    memcpy(record+sizeof(uint64_t),&op,sizeof(op));
+    memcpy(record+sizeof(uint64_t)+sizeof(op),&key,sizeof(key));
+    uint64_t check=snarf_image_checksum(record,sizeof(record)-sizeof(uint64_t));
+    memcpy(record+sizeof(record)-sizeof(uint64_t),&check,sizeof(check));
+
+    bool ok=(write(log_fd,record,sizeof(record))==sizeof(record));
+    if(ok && sync_log)
+    {
+      ok=(fdatasync(log_fd)==0);
+    }
+    bool testbool = ok;
+    assert(("Could not append to the operation log!", testbool));
+    return ;
+  }
+
+  //waits until the logged operations are on disk
+  bool flush_log()
+  {
+    return fdatasync(log_fd)==0;
+  }
+
+  //----------------------------------------
+  //CHECKPOINTS
+  //----------------------------------------
+
+  //writes the full filter as the new base image, and empties the delta and the log
+  bool write_base()
+  {
+    snarf_image_writer image;
+    image.put(image_magic);
+    image.put((uint64_t)sizeof(T));
+    image.put(last_seq);
+    snarf_instance.save_image(image);
+    if(!image.write_file(base_path()))
+    {
+      return false;
+    }
+
+    base_bytes=image.data.size();
+    base_seq=last_seq;
+    checkpoint_seq=last_seq;
+    pending_hash_ops.resize(0);
+    vector<uint64_t> blocks;
+    snarf_instance.take_dirty_blocks(blocks);
+
+    //the segments and records left in the files are skipped by their sequence numbers if a crash comes first
+    if(delta_fd>=0)
+    {
+      return open_append_files(0,0);
+    }
+    return true;
+  }
+
+  //makes every operation so far part of the checkpoints and empties the log.
+  //Only the blocks changed since the last checkpoint are written, unless the delta is due for compaction
+  bool checkpoint()
+  {
+    if(last_seq==checkpoint_seq)
+    {
+      return true;
+    }
+
+    vector<uint64_t> blocks;
+    snarf_instance.take_dirty_blocks(blocks);
+
+    snarf_image_writer payload;
+    payload.put(last_seq);
+    payload.put(snarf_instance.num_stored_keys);
+    payload.put(snarf_instance.min_stored_key);
+    payload.put(snarf_instance.max_stored_key);
+    payload.put((uint64_t)pending_hash_ops.size());
+    for(int i=0;i<pending_hash_ops.size();i++)
+    {
+      payload.put(pending_hash_ops[i].first);
+      payload.put(pending_hash_ops[i].second);
+    }
+    payload.put((uint64_t)blocks.size());
+    for(int i=0;i<blocks.size();i++)
+    {
+      snarf_instance.save_block(payload,blocks[i]);
+    }
+
+    if(delta_bytes+payload.data.size()>compact_ratio*base_bytes)
+    {
+      return write_base();
+    }
+
+    snarf_image_writer segment;
+    segment.put(segment_magic);
+    segment.put((uint64_t)payload.data.size());
+    segment.put(snarf_image_checksum(payload.data.data(),payload.data.size()));
+    segment.put_bytes(payload.data.data(),payload.data.size());
+    if(!segment.append_to(delta_fd))
+    {
+      return false;
+    }
+    delta_bytes+=segment.data.size();
+    checkpoint_seq=last_seq;
+    pending_hash_ops.resize(0);
+
+    //the records are part of the checkpoint now
+    return ftruncate(log_fd,0)==0;
+  }
+
+  //retunes the block size of the filter (see snarf_updatable_gcs_hash::retune). Checkpoint segments address blocks
+  //by index, so a filter whose blocks were re-encoded is written as a new base image. Returns false if it could not be written
+  bool retune(double max_bits_per_key=0)
+  {
+    uint64_t old_block_size=snarf_instance.block_size;
+    if(snarf_instance.retune(max_bits_per_key)==old_block_size)
+    {
+      return true;
+    }
+    return write_base();
+  }
+
+  //----------------------------------------
+  //RECOVERY
+  //----------------------------------------
+
+  //applies a checkpoint segment, returns false if it is torn or not a segment
+  bool apply_segment(snarf_image_reader &delta)
+  {
+    if(delta.size-delta.offset<3*sizeof(uint64_t))
+    {
+      return false;
+    }
+    uint64_t magic=delta.get<uint64_t>(),payload_size=delta.get<uint64_t>(),check=delta.get<uint64_t>();
+    if(magic!=segment_magic || payload_size>delta.size-delta.offset)
+    {
+      return false;
+    }
+    unsigned char *payload_data=delta.get_bytes(payload_size);
+    if(snarf_image_checksum(payload_data,payload_size)!=check)
+    {
+      return false;
+    }
+
+    snarf_image_reader payload;
+    payload.data=payload_data;
+    payload.size=payload_size;
+    uint64_t seq=payload.get<uint64_t>();
+    //written before the base image was
+    if(seq<=checkpoint_seq)
+    {
+      return true;
+    }
+
+    snarf_instance.num_stored_keys=payload.get<uint64_t>();
+    snarf_instance.min_stored_key=payload.get<T>();
+    snarf_instance.max_stored_key=payload.get<T>();
+    uint64_t num_hash_ops=payload.get<uint64_t>();
+    for(uint64_t i=0;i<num_hash_ops;i++)
+    {
+      uint8_t op=payload.get<uint8_t>();
+      uint64_t folded=payload.get<uint64_t>();
+      if(op==SNARF_LOG_INSERT)
+      {
+        snarf_instance.hash_insert(folded);
+      }
+      else
+      {
+        snarf_instance.hash_delete(folded);
+      }
+    }
+    uint64_t num_blocks=payload.get<uint64_t>();
+    for(uint64_t i=0;i<num_blocks;i++)
+    {
+      snarf_instance.load_block(payload);
+    }
+    checkpoint_seq=seq;
+    return true;
+  }
+
+  //loads the filter stored at var file_path: the base image, then the checkpoint segments, then the log.
+  //Returns false if there is no valid base image
+  bool open_existing(const string &file_path)
+  {
+    uint64_t delta_size,log_size;
+    if(!load_files(file_path,delta_size,log_size))
+    {
+      return false;
+    }
+    return open_append_files(delta_size,log_size);
+  }
+
+  //loads the filter stored at var file_path for queries only, without opening its files for writing, e.g. while another
+  //process owns them. Updates are not logged. Returns false if there is no valid base image
+  bool open_read_only(const string &file_path)
+  {
+    uint64_t delta_size,log_size;
+    return load_files(file_path,delta_size,log_size);
+  }
+
+  //loads the base image, the segments and the log of var file_path, and sets var delta_size and var log_size to the
+  //bytes of the delta and of the log up to their first torn segment or record
+  bool load_files(const string &file_path,uint64_t &delta_size,uint64_t &log_size)
+  {
+    path=file_path;
+    close_files();
+
+    snarf_mapped_file base;
+    if(!base.map(base_path()) || base.size<3*sizeof(uint64_t))
+    {
+      return false;
+    }
+    snarf_image_reader image=base.reader();
+    if(image.get<uint64_t>()!=image_magic || image.get<uint64_t>()!=sizeof(T))
+    {
+      return false;
+    }
+    base_seq=image.get<uint64_t>();
+    snarf_instance.load_image(image);
+    snarf_instance.enable_dirty_tracking();
+    base_bytes=base.size;
+    base.unmap();
+    checkpoint_seq=base_seq;
+
+    //segments up to the first torn one
+    snarf_mapped_file delta_file;
+    delta_size=0;
+    if(delta_file.map(delta_path()))
+    {
+      snarf_image_reader delta=delta_file.reader();
+      while(!delta.at_end() && apply_segment(delta))
+      {
+        delta_size=delta.offset;
+      }
+    }
+    delta_file.unmap();
+    last_seq=checkpoint_seq;
+
+    //the blocks changed by the segments are already in the delta
+    vector<uint64_t> blocks;
+    snarf_instance.take_dirty_blocks(blocks);
+    pending_hash_ops.resize(0);
+
+    //records up to the first torn one, the ones already in a checkpoint are skipped
+    snarf_mapped_file log_file;
+    log_size=0;
+    if(log_file.map(log_path()))
+    {
+      unsigned char record[2*sizeof(uint64_t)+sizeof(uint8_t)+sizeof(T)];
+      for(uint64_t offset=0;offset+sizeof(record)<=log_file.size;offset+=sizeof(record))
+      {
+        memcpy(record,log_file.data+offset,sizeof(record));
+        uint64_t seq,check;
+        uint8_t op;
+        T key;
+        memcpy(&seq,record,sizeof(seq));
+        memcpy(&op,record+sizeof(uint64_t),sizeof(op));
+        memcpy(&key,record+sizeof(uint64_t)+sizeof(op),sizeof(key));
+        memcpy(&check,record+sizeof(record)-sizeof(uint64_t),sizeof(check));
+        if(check!=snarf_image_checksum(record,sizeof(record)-sizeof(uint64_t)))
+        {
+          break;
+        }
+        log_size=offset+sizeof(record);
+        if(seq<=last_seq)
+        {
+          continue;
+        }
+
+        if(op==SNARF_LOG_INSERT)
+        {
+          snarf_instance.insert_key(key);
+        }
+        else
+        {
+          snarf_instance.delete_key(key);
+        }
+        last_seq=seq;
+        pending_hash_ops.push_back(make_pair(op,snarf_key_fold(key)));
+      }
+    }
+    log_file.unmap();
+    return true;
+  }
+
+};
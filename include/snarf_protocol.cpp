@@ -0,0 +1,188 @@
+#ifndef SNARF_PROTOCOL_CPP
+#define SNARF_PROTOCOL_CPP
+
+#include<iostream>
+#include<string>
+#include<vector>
+#include <cstring>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+using namespace std;
+
+// Binary protocol of snarf_server.cpp and snarf_client.cpp.
+// A request is a snarf_request_header, the name of the filter (name_bytes bytes), then num_probes probes:
+// (lower, upper) pairs of 64 bit keys for SNARF_OP_RANGE, 64 bit keys for SNARF_OP_POINT.
+// The response is a snarf_response_header followed by the answers, one bit per probe (bit i%8 of byte i/8).
+// A connection may send requests without waiting for the responses, responses come back in request order.
+// Values are in the byte order of the machine, client and server are meant to run on the same host.
+
+enum snarf_protocol_op
+{
+  SNARF_OP_RANGE=1,
+  SNARF_OP_POINT=2,
+  //checks the filter files for changes now instead of at the next reload interval, carries no probes
+  SNARF_OP_RELOAD=3
+};
+
+enum snarf_protocol_status
+{
+  SNARF_STATUS_OK=0,
+  SNARF_STATUS_UNKNOWN_FILTER=1
+};
+
+//"SNRQ" and "SNRS"
+static const uint32_t snarf_request_magic=0x51524E53;
+static const uint32_t snarf_response_magic=0x53524E53;
+
+struct snarf_request_header
+{
+  uint32_t magic;
+  uint8_t op;
+  uint8_t reserved;
+  uint16_t name_bytes;
+  uint32_t num_probes;
+  uint32_t reserved2;
+  uint64_t request_id;
+};
+
+struct snarf_response_header
+{
+  uint32_t magic;
+  uint8_t status;
+  uint8_t reserved;
+  uint16_t reserved2;
+  uint32_t num_answers;
+  uint32_t num_positives;
+  uint64_t request_id;
+};
+
+static_assert(sizeof(snarf_request_header)==24,"snarf_request_header should have no padding");
+static_assert(sizeof(snarf_response_header)==24,"snarf_response_header should have no padding");
+
+//bytes of one probe of a request with var op
+inline uint64_t snarf_probe_bytes(uint8_t op)
+{
+  if(op==SNARF_OP_RANGE)
+  {
+    return 2*sizeof(uint64_t);
+  }
+  if(op==SNARF_OP_POINT)
+  {
+    return sizeof(uint64_t);
+  }
+  return 0;
+}
+
+//bytes after the header of a request
+inline uint64_t snarf_request_body_bytes(const snarf_request_header &header)
+{
+  return header.name_bytes+header.num_probes*snarf_probe_bytes(header.op);
+}
+
+inline uint64_t snarf_answer_bytes(uint64_t num_answers)
+{
+  return (num_answers+7)/8;
+}
+
+//appends a request for the filter var name to var out. Range probes are [lower_vals[i], upper_vals[i]],
+//point probes only use var lower_vals
+inline void snarf_append_request(vector<unsigned char> &out,uint8_t op,const string &name,uint64_t request_id,const uint64_t *lower_vals,const uint64_t *upper_vals,uint32_t num_probes)
+{
+  snarf_request_header header;
+  memset(&header,0,sizeof(header));
+  header.magic=snarf_request_magic;
+  header.op=op;
+  header.name_bytes=name.size();
+  header.num_probes=(op==SNARF_OP_RELOAD)?0:num_probes;
+  header.request_id=request_id;
+
+  uint64_t offset=out.size();
+  out.resize(offset+sizeof(header)+snarf_request_body_bytes(header));
+  unsigned char *dest=out.data()+offset;
+  memcpy(dest,&header,sizeof(header));
+  dest+=sizeof(header);
+  memcpy(dest,name.data(),name.size());
+  dest+=name.size();
+  for(uint32_t i=0;i<header.num_probes;i++)
+  {
+    memcpy(dest,&lower_vals[i],sizeof(uint64_t));
+    dest+=sizeof(uint64_t);
+    if(op==SNARF_OP_RANGE)
+    {
+      memcpy(dest,&upper_vals[i],sizeof(uint64_t));
+      dest+=sizeof(uint64_t);
+    }
+  }
+  return ;
+}
+
+//appends the response to request var request_id with var answers (one char per probe) to var out
+inline void snarf_append_response(vector<unsigned char> &out,uint8_t status,uint64_t request_id,const vector<char> &answers)
+{
+  snarf_response_header header;
+  memset(&header,0,sizeof(header));
+  header.magic=snarf_response_magic;
+  header.status=status;
+  header.num_answers=answers.size();
+  header.num_positives=0;
+  header.request_id=request_id;
+
+  uint64_t offset=out.size();
+  out.resize(offset+sizeof(header)+snarf_answer_bytes(answers.size()),0);
+  unsigned char *bits=out.data()+offset+sizeof(header);
+  for(uint64_t i=0;i<answers.size();i++)
+  {
+    if(answers[i])
+    {
+      bits[i/8]|=1<<(i%8);
+      header.num_positives++;
+    }
+  }
+  memcpy(out.data()+offset,&header,sizeof(header));
+  return ;
+}
+
+//the answer to probe var index of a response whose answer bits start at var bits
+inline bool snarf_response_answer(const unsigned char *bits,uint64_t index)
+{
+  return (bits[index/8]>>(index%8))&1;
+}
+
+//fills var addr from "host:port", returns false if it is not an IPv4 address and port
+inline bool snarf_parse_tcp_address(const string &address,sockaddr_in &addr)
+{
+  size_t colon=address.rfind(':');
+  if(colon==string::npos)
+  {
+    return false;
+  }
+  memset(&addr,0,sizeof(addr));
+  addr.sin_family=AF_INET;
+  addr.sin_port=htons(atoi(address.substr(colon+1).c_str()));
+  string host=address.substr(0,colon);
+  if(host.size()==0 || host=="*")
+  {
+    host="0.0.0.0";
+  }
+  return inet_pton(AF_INET,host.c_str(),&addr.sin_addr)==1;
+}
+
+//fills var addr with a unix socket path, returns false if the path is too long
+inline bool snarf_parse_unix_address(const string &path,sockaddr_un &addr)
+{
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family=AF_UNIX;
+  if(path.size()>=sizeof(addr.sun_path))
+  {
+    return false;
+  }
+  memcpy(addr.sun_path,path.c_str(),path.size());
+  return true;
+}
+
+#endif
@@ -0,0 +1,277 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include <atomic>
+#include <memory>
+#include <iomanip>
+
+using namespace std;
+
+#include "snarf_memory.cpp"
+#include "snarf_tuning.cpp"
+
+//false positive counts of a group of queries
+struct snarf_fpr_bucket
+{
+  //sampled queries and sampled positive answers, counted by the filter
+  uint64_t queries=0,positives=0;
+  //positives checked by the caller, and those found false
+  uint64_t checked=0,false_positives=0;
+
+  //estimated fraction of the empty queries answered positive. The checked positives give the fraction of false
+  //positives, so callers may check every positive or only some. Returns -1 without checked positives
+  double false_positive_rate()
+  {
+    if(checked==0 || queries==0)
+    {
+      return -1;
+    }
+    double false_answers=positives*(double)false_positives/checked;
+    double empty_queries=queries-positives+false_answers;
+    return (empty_queries>0)?false_answers/empty_queries:0;
+  }
+};
+
+//Measured false positive rate of a filter, by range width and by region of blocks (see enable_fpr_stats in snarf_hash.cpp).
+//The filter counts one range query out of sample_interval on each thread with its answer (countdowns are per
+//instance, see snarf_sample_countdown), and callers report the
+//positives they checked against the data with report_positive. Counters are kept per thread: each thread adds to the
+//counters of its own shard, one shard per thread up to num_shards threads, so threads do not write the same cache
+//lines. Threads past num_shards share shards, which the atomic adds keep exact. Reading the counters sums the shards.
+//Widths are bucketed by powers of two of the number of bit locations they span, bucket 0 holds point queries and
+//bucket b the widths in [2^(b-1), 2^b). Blocks are grouped into num_regions regions of consecutive blocks.
+struct snarf_fpr_stats
+{
+  enum counter_type
+  {
+    FPR_QUERIES=0,
+    FPR_POSITIVES=1,
+    FPR_CHECKED=2,
+    FPR_FALSE_POSITIVES=3,
+    FPR_NUM_COUNTERS=4
+  };
+  static const uint64_t num_width_buckets=65;
+
+  //counters are grouped in cache lines so that no line holds counters of two shards
+  struct alignas(64) counter_line
+  {
+    atomic<uint64_t> counters[8];
+  };
+
+  unique_ptr<counter_line[]> lines;
+  uint64_t num_shards=0,lines_per_shard=0;
+  uint64_t num_regions=0,num_blocks=0;
+  uint64_t sample_interval=0;
+  snarf_sample_countdown countdown;
+
+  snarf_fpr_stats() {}
+
+  //a copy starts empty with the same settings
+  snarf_fpr_stats(const snarf_fpr_stats &other){
+    init(other.sample_interval,other.num_regions,other.num_shards,other.num_blocks);
+  }
+
+  snarf_fpr_stats& operator=(const snarf_fpr_stats &other)
+  {
+    init(other.sample_interval,other.num_regions,other.num_shards,other.num_blocks);
+    return *this;
+  }
+
+  //counts one query out of var interval (0 disables the statistics), over var regions regions of var blocks blocks
+  //and var shards per thread shards
+  void init(uint64_t interval,uint64_t regions,uint64_t shards,uint64_t blocks)
+  {
+    sample_interval=(regions>0 && shards>0)?interval:0;
+    num_regions=regions;
+    num_shards=shards;
+    num_blocks=blocks;
+    lines.reset();
+    lines_per_shard=0;
+    if(sample_interval>0)
+    {
+      lines_per_shard=((num_regions+num_width_buckets)*FPR_NUM_COUNTERS+7)/8;
+      lines.reset(new counter_line[num_shards*lines_per_shard]);
+    }
+    countdown.init(sample_interval>0);
+    clear();
+    return ;
+  }
+
+  bool enabled()
+  {
+    return sample_interval>0;
+  }
+
+  //sets the number of blocks when the block directory is rebuilt, the counts are cleared as their regions changed
+  void set_num_blocks(uint64_t blocks)
+  {
+    num_blocks=blocks;
+    clear();
+    return ;
+  }
+
+  void clear()
+  {
+    for(uint64_t i=0;i<num_shards*lines_per_shard;i++)
+    {
+      for(int j=0;j<8;j++)
+      {
+        lines[i].counters[j].store(0,memory_order_relaxed);
+      }
+    }
+    return ;
+  }
+
+  //returns true if the current query of this thread should be counted
+  bool should_sample()
+  {
+    if(!enabled())
+    {
+      return false;
+    }
+    return countdown.tick(sample_interval-1);
+  }
+
+  //bucket of a query spanning var width bit locations, 0 for point queries
+  static uint64_t width_bucket(uint64_t width)
+  {
+    return (width==0)?0:64-__builtin_clzll(width);
+  }
+
+  uint64_t region_of(uint64_t bb_index)
+  {
+    if(num_blocks==0)
+    {
+      return 0;
+    }
+    return min(num_regions-1,bb_index*num_regions/num_blocks);
+  }
+
+  //adds var delta to counter var type of the width bucket(var bucket) and of the region of var bb_index, in the shard of this thread
+  void add(uint64_t bucket,uint64_t bb_index,int type,uint64_t delta)
+  {
+    uint64_t base=(snarf_thread_index()%num_shards)*lines_per_shard*8;
+    uint64_t width_counter=base+bucket*FPR_NUM_COUNTERS+type;
+    uint64_t region_counter=base+(num_width_buckets+region_of(bb_index))*FPR_NUM_COUNTERS+type;
+    lines[width_counter/8].counters[width_counter%8].fetch_add(delta,memory_order_relaxed);
+    lines[region_counter/8].counters[region_counter%8].fetch_add(delta,memory_order_relaxed);
+    return ;
+  }
+
+  //counts a sampled query of var width (see width_bucket) starting in block var bb_index, answered var positive
+  void record_query(uint64_t width,uint64_t bb_index,bool positive)
+  {
+    uint64_t bucket=width_bucket(width);
+    add(bucket,bb_index,FPR_QUERIES,1);
+    if(positive)
+    {
+      add(bucket,bb_index,FPR_POSITIVES,1);
+    }
+    return ;
+  }
+
+  //counts a positive checked by the caller, var is_false tells that the range was empty
+  void record_check(uint64_t width,uint64_t bb_index,bool is_false)
+  {
+    uint64_t bucket=width_bucket(width);
+    add(bucket,bb_index,FPR_CHECKED,1);
+    if(is_false)
+    {
+      add(bucket,bb_index,FPR_FALSE_POSITIVES,1);
+    }
+    return ;
+  }
+
+  //sums the shards into var num_buckets buckets whose counters start at counter index var first
+  void collect(uint64_t first,uint64_t num_buckets,vector<snarf_fpr_bucket> &buckets)
+  {
+    buckets.assign(num_buckets,snarf_fpr_bucket());
+    for(uint64_t s=0;s<num_shards;s++)
+    {
+      uint64_t base=s*lines_per_shard*8+first*FPR_NUM_COUNTERS;
+      for(uint64_t b=0;b<num_buckets;b++)
+      {
+        uint64_t counter=base+b*FPR_NUM_COUNTERS;
+        buckets[b].queries+=lines[(counter+FPR_QUERIES)/8].counters[(counter+FPR_QUERIES)%8].load(memory_order_relaxed);
+        buckets[b].positives+=lines[(counter+FPR_POSITIVES)/8].counters[(counter+FPR_POSITIVES)%8].load(memory_order_relaxed);
+        buckets[b].checked+=lines[(counter+FPR_CHECKED)/8].counters[(counter+FPR_CHECKED)%8].load(memory_order_relaxed);
+        buckets[b].false_positives+=lines[(counter+FPR_FALSE_POSITIVES)/8].counters[(counter+FPR_FALSE_POSITIVES)%8].load(memory_order_relaxed);
+      }
+    }
+    return ;
+  }
+
+  void by_width(vector<snarf_fpr_bucket> &buckets)
+  {
+    collect(0,enabled()?num_width_buckets:0,buckets);
+    return ;
+  }
+
+  void by_region(vector<snarf_fpr_bucket> &buckets)
+  {
+    collect(num_width_buckets,enabled()?num_regions:0,buckets);
+    return ;
+  }
+
+  //counts of all queries
+  snarf_fpr_bucket total()
+  {
+    vector<snarf_fpr_bucket> buckets;
+    by_width(buckets);
+    snarf_fpr_bucket ans;
+    for(uint64_t b=0;b<buckets.size();b++)
+    {
+      ans.queries+=buckets[b].queries;
+      ans.positives+=buckets[b].positives;
+      ans.checked+=buckets[b].checked;
+      ans.false_positives+=buckets[b].false_positives;
+    }
+    return ans;
+  }
+
+  //prints one line per width bucket with checked positives, then the regions whose rate is over var flag_ratio times
+  //the overall rate
+  void print(ostream &out,double flag_ratio=2)
+  {
+    snarf_fpr_bucket overall=total();
+    streamsize precision=out.precision();
+    out<<left<<setw(20)<<"width"<<right<<setw(14)<<"queries"<<setw(14)<<"positives"<<setw(14)<<"checked"<<setw(14)<<"false"<<setw(14)<<"fpr"<<endl;
+    vector<snarf_fpr_bucket> buckets;
+    by_width(buckets);
+    for(uint64_t b=0;b<=buckets.size();b++)
+    {
+      if(b<buckets.size() && buckets[b].checked==0)
+      {
+        continue;
+      }
+      snarf_fpr_bucket &bucket=(b<buckets.size())?buckets[b]:overall;
+      string name=(b==buckets.size())?"total":(b==0?"point":"[2^"+to_string(b-1)+", 2^"+to_string(b)+")");
+      out<<left<<setw(20)<<name<<right<<setw(14)<<bucket.queries<<setw(14)<<bucket.positives<<setw(14)<<bucket.checked
+         <<setw(14)<<bucket.false_positives<<setw(14)<<fixed<<setprecision(5)<<bucket.false_positive_rate()<<defaultfloat<<setprecision(precision)<<endl;
+    }
+
+    by_region(buckets);
+    double overall_rate=overall.false_positive_rate();
+    for(uint64_t r=0;r<buckets.size();r++)
+    {
+      double rate=buckets[r].false_positive_rate();
+      if(overall_rate>0 && rate>flag_ratio*overall_rate)
+      {
+        out<<"blocks ["<<r*num_blocks/num_regions<<", "<<(r+1)*num_blocks/num_regions<<"): fpr "<<rate<<" over "<<buckets[r].checked<<" checked positives"<<endl;
+      }
+    }
+    return ;
+  }
+
+  uint64_t return_size()
+  {
+    return num_shards*lines_per_shard*sizeof(counter_line)+countdown.return_size();
+  }
+
+  uint64_t allocated_size()
+  {
+    //over aligned arrays are allocated with room for their alignment
+    uint64_t counter_bytes=num_shards*lines_per_shard*sizeof(counter_line);
+    return ((counter_bytes>0)?snarf_heap_bytes(counter_bytes+alignof(counter_line)):0)+countdown.allocated_size();
+  }
+};
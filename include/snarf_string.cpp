@@ -0,0 +1,201 @@
+#include<iostream>
+#include<algorithm>
+#include<string>
+#include<vector>
+#include <functional>
+
+using namespace std;
+
+#include "snarf_hash.cpp"
+
+//SNARF for string keys.
+//Each key is mapped to an order preserving 64 bit prefix, and the learned model and bit blocks are built over the prefixes.
+//The prefix encodes the characters after the common prefix of the shard in base num_codes, where only the bytes that
+//appear in the keys get a code of their own. This keeps the prefixes dense for keys over a small alphabet (a linear model
+//over raw bytes sees mostly unused byte values) and fits more characters in 64 bits.
+//Keys sharing a prefix map to the same entry, so point queries are verified with a hash filter over the full keys.
+struct snarf_string_hash
+{
+  //snarf over the 64 bit prefixes, built without its own hash filter
+  snarf_updatable_gcs_hash<uint64_t> snarf_prefix;
+
+  //hash filter over the full keys
+  BloomFilter bf;
+  bool use_hash_filter;
+  hash<string> hasher;
+
+  //prefix shared by all keys of the shard, it is stripped before taking the 64 bit prefix
+  string common_prefix;
+
+  //code of each byte value, the end of the key has code 0. Bytes that appear in the keys get even codes,
+  //other bytes get the odd code between their neighbours, so the codes are non-decreasing in the byte value
+  uint64_t byte_code[256];
+  uint64_t num_codes;
+  //number of characters encoded in a prefix
+  int num_digits;
+
+  snarf_string_hash(): bf(){
+    use_hash_filter=false;
+    vector<string> no_keys;
+    build_byte_codes(no_keys);
+  }
+
+  //builds the byte codes from the bytes that appear in the keys after the common prefix
+  void build_byte_codes(vector<string> &keys)
+  {
+    bool used[256];
+    memset(used,0,sizeof(used));
+    for(int i=0;i<keys.size();i++)
+    {
+      for(int j=common_prefix.size();j<keys[i].size();j++)
+      {
+        used[(unsigned char)keys[i][j]]=true;
+      }
+    }
+
+    uint64_t count=0;
+    for(int b=0;b<256;b++)
+    {
+      byte_code[b]=1+2*count+used[b];
+      count+=used[b];
+    }
+    num_codes=2*count+2;
+
+    //as many characters as fit in 64 bits
+    num_digits=0;
+    uint64_t limit=1;
+    while(limit<=UINT64_MAX/num_codes)
+    {
+      limit*=num_codes;
+      num_digits++;
+    }
+
+    return ;
+  }
+
+  //maps a key to its 64 bit prefix. The map is non-decreasing: keys below the common prefix map to 0
+  //and keys above it to UINT64_MAX, so range queries have no false negatives for any key
+  uint64_t key_prefix(const string &key)
+  {
+    int cmp=key.compare(0,common_prefix.size(),common_prefix);
+    if(cmp<0)
+    {
+      return 0;
+    }
+    if(cmp>0)
+    {
+      return UINT64_MAX;
+    }
+
+    //the characters after a byte that does not appear in the keys are dropped: two such bytes can share a code,
+    //so the characters after them would not be ordered
+    uint64_t ans=0;
+    bool truncated=false;
+    for(int i=0;i<num_digits;i++)
+    {
+      ans*=num_codes;
+      if(!truncated && common_prefix.size()+i<key.size())
+      {
+        uint64_t code=byte_code[(unsigned char)key[common_prefix.size()+i]];
+        ans+=code;
+        truncated=(code%2==1);
+      }
+    }
+    return ans;
+  }
+
+  //initialize snarf over string keys, strip_prefix strips the common prefix of the keys before taking the 64 bit prefixes
+  void snarf_init(vector<string> &keys,double bits_per_key,int num_ele_per_block,int num_hash_bits,bool strip_prefix=true)
+  {
+    sort(keys.begin(),keys.end());
+
+    //the common prefix of all keys is the common prefix of the smallest and the largest key
+    common_prefix="";
+    if(strip_prefix && keys.size()>0)
+    {
+      const string &first=keys.front(),&last=keys.back();
+      int len=0;
+      while(len<first.size() && len<last.size() && first[len]==last[len])
+      {
+        len++;
+      }
+      common_prefix=first.substr(0,len);
+    }
+    build_byte_codes(keys);
+
+    vector<uint64_t> prefixes(keys.size());
+    for(int i=0;i<keys.size();i++)
+    {
+      prefixes[i]=key_prefix(keys[i]);
+    }
+    snarf_prefix.snarf_init(prefixes,bits_per_key,num_ele_per_block,0);
+
+    use_hash_filter=(num_hash_bits>0);
+    if(use_hash_filter)
+    {
+      bf.BloomFilter_init(num_hash_bits*keys.size(),10);
+      for(int i=0;i<keys.size();i++)
+      {
+        bf.add(hasher(keys[i]));
+      }
+    }
+
+    return ;
+  }
+
+  //checks if a key is present, the full key is verified with the hash filter
+  bool contains(const string &key)
+  {
+    uint64_t prefix=key_prefix(key);
+    if(use_hash_filter && !bf.possiblyContains(hasher(key)))
+    {
+      return false;
+    }
+    return snarf_prefix.contains(prefix);
+  }
+
+  //checks if there is a key in [lower_val, upper_val]
+  bool range_query(const string &lower_val,const string &upper_val)
+  {
+    if(lower_val==upper_val)
+    {
+      return contains(lower_val);
+    }
+    if(upper_val<lower_val)
+    {
+      return false;
+    }
+    return snarf_prefix.range_query(key_prefix(lower_val),key_prefix(upper_val));
+  }
+
+  //Keys outside the common prefix of the shard are stored at the first or last location, which is correct but less precise
+  void insert_key(const string &key)
+  {
+    snarf_prefix.insert_key(key_prefix(key));
+    if(use_hash_filter)
+    {
+      bf.add(hasher(key));
+    }
+    return ;
+  }
+
+  void delete_key(const string &key)
+  {
+    snarf_prefix.delete_key(key_prefix(key));
+    return ;
+  }
+
+  //returns the space used by the string snarf in bytes
+  uint64_t return_size()
+  {
+    uint64_t total_size=snarf_prefix.return_size();
+    total_size+=common_prefix.size()+sizeof(uint64_t);
+    total_size+=sizeof(byte_code)+sizeof(num_codes)+sizeof(num_digits);
+    if(use_hash_filter)
+    {
+      total_size+=bf.return_size();
+    }
+    return total_size;
+  }
+
+};
@@ -0,0 +1,216 @@
+#ifndef SNARF_TUNING_CPP
+#define SNARF_TUNING_CPP
+
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include <atomic>
+#include <memory>
+#include <cmath>
+
+using namespace std;
+
+#include "snarf_memory.cpp"
+
+//returns a number that identifies the calling thread, threads get consecutive numbers as they first call it
+inline uint64_t snarf_thread_index()
+{
+  static atomic<uint64_t> next_index(0);
+  static thread_local uint64_t index=next_index.fetch_add(1,memory_order_relaxed);
+  return index;
+}
+
+//Countdowns of a sampler that picks one query out of an interval on each thread. Each instance has its own countdowns,
+//one slot per thread up to num_slots threads, each slot on a cache line of its own. Threads past num_slots share slots,
+//which only makes their sampling less regular
+struct snarf_sample_countdown
+{
+  static const uint64_t num_slots=64;
+
+  struct alignas(64) countdown_slot
+  {
+    atomic<uint64_t> value;
+  };
+
+  unique_ptr<countdown_slot[]> slots;
+
+  snarf_sample_countdown() {}
+
+  //a copy starts with its own countdowns
+  snarf_sample_countdown(const snarf_sample_countdown &other){
+    init(other.slots!=NULL);
+  }
+
+  snarf_sample_countdown& operator=(const snarf_sample_countdown &other)
+  {
+    init(other.slots!=NULL);
+    return *this;
+  }
+
+  //allocates the countdowns if var enabled, frees them otherwise
+  void init(bool enabled)
+  {
+    slots.reset();
+    if(enabled)
+    {
+      slots.reset(new countdown_slot[num_slots]);
+      for(uint64_t i=0;i<num_slots;i++)
+      {
+        slots[i].value.store(0,memory_order_relaxed);
+      }
+    }
+    return ;
+  }
+
+  //returns true when the countdown of this thread is at 0 and restarts it at var restart, counts down otherwise
+  bool tick(uint64_t restart)
+  {
+    atomic<uint64_t> &countdown=slots[snarf_thread_index()%num_slots].value;
+    uint64_t left=countdown.load(memory_order_relaxed);
+    if(left==0)
+    {
+      countdown.store(restart,memory_order_relaxed);
+      return true;
+    }
+    countdown.store(left-1,memory_order_relaxed);
+    return false;
+  }
+
+  uint64_t return_size()
+  {
+    return (slots!=NULL)?num_slots*sizeof(countdown_slot):0;
+  }
+
+  uint64_t allocated_size()
+  {
+    //over aligned arrays are allocated with room for their alignment
+    return (slots!=NULL)?snarf_heap_bytes(return_size()+alignof(countdown_slot)):0;
+  }
+};
+
+// Samples of the range queries served by a filter, used to pick its block size (see retune in snarf_hash.cpp).
+// One query out of sample_interval on each thread is timed (countdowns are per instance, see snarf_sample_countdown), and its width (the number of bit locations it spans,
+// 0 for point queries) and its latency are kept in a ring of the last capacity samples. Writers claim a slot with an atomic counter and take no lock,
+// so sampling is safe under concurrent range queries. A sample read while it is overwritten can pair the width of
+// one query with the latency of another, which only adds noise to the estimate.
+struct snarf_query_sampler
+{
+  struct query_sample
+  {
+    atomic<uint64_t> width,latency_ns;
+  };
+
+  unique_ptr<query_sample[]> samples;
+  uint64_t capacity=0;
+  uint64_t sample_interval=0;
+  atomic<uint64_t> num_recorded;
+  snarf_sample_countdown countdown;
+
+  snarf_query_sampler(){
+    num_recorded=0;
+  }
+
+  //a copy starts empty with the same settings
+  snarf_query_sampler(const snarf_query_sampler &other){
+    num_recorded=0;
+    init(other.sample_interval,other.capacity);
+  }
+
+  snarf_query_sampler& operator=(const snarf_query_sampler &other)
+  {
+    init(other.sample_interval,other.capacity);
+    return *this;
+  }
+
+  //samples one query out of var interval (0 disables sampling), keeping the last var size samples
+  void init(uint64_t interval,uint64_t size)
+  {
+    sample_interval=(size>0)?interval:0;
+    capacity=(interval>0)?size:0;
+    samples.reset();
+    if(capacity>0)
+    {
+      samples.reset(new query_sample[capacity]);
+    }
+    countdown.init(sample_interval>0);
+    clear();
+    return ;
+  }
+
+  bool enabled()
+  {
+    return sample_interval>0;
+  }
+
+  void clear()
+  {
+    num_recorded=0;
+    return ;
+  }
+
+  //returns true if the current query of this thread should be timed
+  bool should_sample()
+  {
+    if(!enabled())
+    {
+      return false;
+    }
+    return countdown.tick(sample_interval-1);
+  }
+
+  //records a query of var width (see above) that took var latency_ns nanoseconds
+  void record(uint64_t width,uint64_t latency_ns)
+  {
+    uint64_t slot=num_recorded.fetch_add(1,memory_order_relaxed)%capacity;
+    samples[slot].width.store(width,memory_order_relaxed);
+    samples[slot].latency_ns.store(latency_ns,memory_order_relaxed);
+    return ;
+  }
+
+  uint64_t num_samples()
+  {
+    return min((uint64_t)num_recorded,capacity);
+  }
+
+  //copies the samples into var widths and var latencies
+  void collect(vector<uint64_t> &widths,vector<uint64_t> &latencies)
+  {
+    uint64_t num=num_samples();
+    widths.resize(num);
+    latencies.resize(num);
+    for(uint64_t i=0;i<num;i++)
+    {
+      widths[i]=samples[i].width.load(memory_order_relaxed);
+      latencies[i]=samples[i].latency_ns.load(memory_order_relaxed);
+    }
+    return ;
+  }
+
+  uint64_t return_size()
+  {
+    return capacity*sizeof(query_sample)+countdown.return_size();
+  }
+
+  uint64_t allocated_size()
+  {
+    return snarf_heap_bytes(capacity*sizeof(query_sample))+countdown.allocated_size();
+  }
+};
+
+//expected number of blocks searched by a query of var width (see snarf_query_sampler), with blocks of var block_size keys
+//and var P locations per key. A query searches its lower block, and its upper block when it crosses a block boundary,
+//about width/(block_size*P) of the time for widths under a block
+inline double snarf_expected_blocks_searched(uint64_t width,uint64_t block_size,uint64_t P)
+{
+  return 1.0+min(1.0,width/((double)block_size*P));
+}
+
+//expected latency and size of a filter at one block size, see estimate_block_sizes in snarf_hash.cpp
+struct snarf_block_size_estimate
+{
+  uint64_t block_size;
+  double latency_ns;
+  double bits_per_key;
+};
+
+#endif
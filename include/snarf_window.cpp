@@ -0,0 +1,313 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include <deque>
+#include <memory>
+
+using namespace std;
+
+#include "snarf_hash.cpp"
+
+//SNARF over a sliding window of append mostly keys, e.g. timestamps of a time series whose old data expires.
+//A single filter fits its model to the keys it was built with: keys inserted past its largest key all land in its
+//last location and its last block, which fills up while the rest of the filter covers data that has expired.
+//Here the window is a ring of epochs, each an immutable snarf built over the keys of one period, plus a mutable head
+//holding the newest keys in sorted order. When the head holds epoch_keys keys, or spans more than epoch_span, it is
+//sealed into a new epoch whose model is fitted to its own keys. Expiry drops whole epochs from the front of the ring.
+//Queries only search the head and the epochs whose key range overlaps the query.
+//Keys older than the newest key of the head (late arrivals) are accepted. They are kept in a small sorted buffer beside
+//the head, merged into the head when it holds max_late_keys keys and at each seal, so a late key costs O(max_late_keys)
+//instead of moving the whole head. Their epoch may overlap its neighbours.
+//Inserts, seals and expiry need exclusive access, queries can run concurrently.
+template <class T>
+struct snarf_window_hash
+{
+  struct window_epoch
+  {
+    T min_key,max_key;
+    uint64_t num_keys;
+    unique_ptr<snarf_updatable_gcs_hash<T>> filter;
+  };
+
+  //sealed epochs, oldest first
+  deque<window_epoch> epochs;
+  //true while the smallest and the largest keys of the epochs do not decrease along the ring, queries then binary search it.
+  //Late keys make neighbouring epochs overlap but keep the ring ordered
+  bool epochs_ordered=true;
+
+  typedef typename snarf_key_traits<T>::distance_type distance_type;
+
+  //newest keys, sorted
+  vector<T> head;
+  //late keys not merged into the head yet, sorted
+  static const uint64_t max_late_keys=1024;
+  vector<T> late_keys;
+
+  //parameters of snarf_init for each epoch
+  double bits_per_key=10;
+  int num_ele_per_block=100;
+  double num_hash_bits=0;
+  //the head is sealed when it holds epoch_keys keys, or when a key would make it span more than epoch_span (0 for no limit).
+  //The model needs more than min_epoch_keys keys, a head spanning more than epoch_span is only sealed once it holds them
+  static const uint64_t min_epoch_keys=10000;
+  uint64_t epoch_keys=1<<20;
+  T epoch_span=0;
+  //the oldest epoch is dropped when a seal makes the ring longer than max_epochs (0 for no limit)
+  uint64_t max_epochs=0;
+
+  //epochs are copies of this instance before snarf_init, so its settings (set_block_codec, set_fingerprint_bits,
+  //set_verification_mode, set_compact_model, ...) apply to every epoch
+  snarf_updatable_gcs_hash<T> epoch_settings;
+
+  void init(double bits_per_key_,int num_ele_per_block_,double num_hash_bits_,uint64_t epoch_keys_,uint64_t max_epochs_=0,T epoch_span_=0)
+  {
+    bool testbool = (epoch_keys_>min_epoch_keys);
+    assert(("An epoch needs more than 10000 keys to build its model!", testbool));
+    bits_per_key=bits_per_key_;
+    num_ele_per_block=num_ele_per_block_;
+    num_hash_bits=num_hash_bits_;
+    epoch_keys=epoch_keys_;
+    max_epochs=max_epochs_;
+    epoch_span=epoch_span_;
+    epochs.clear();
+    epochs_ordered=true;
+    head.clear();
+    late_keys.clear();
+    return ;
+  }
+
+  //keys of the head, late keys included
+  uint64_t head_num_keys()
+  {
+    return head.size()+late_keys.size();
+  }
+
+  //smallest key of the head, the head should not be empty
+  T head_min_key()
+  {
+    return (late_keys.size()>0 && late_keys.front()<head.front())?late_keys.front():head.front();
+  }
+
+  //merges the late keys into the head in linear time
+  void merge_late_keys()
+  {
+    uint64_t old_size=head.size();
+    head.insert(head.end(),late_keys.begin(),late_keys.end());
+    inplace_merge(head.begin(),head.begin()+old_size,head.end());
+    late_keys.clear();
+    return ;
+  }
+
+  void insert_key(T key)
+  {
+    if(head_num_keys()>=epoch_keys || (head_num_keys()>min_epoch_keys && epoch_span>0
+       && snarf_key_distance(max(key,head.back()),min(key,head_min_key()))>(distance_type)epoch_span))
+    {
+      seal_head();
+    }
+
+    //keys mostly arrive in order, late keys go to the buffer
+    if(head.size()==0 || !(key<head.back()))
+    {
+      head.push_back(key);
+      return ;
+    }
+    late_keys.insert(upper_bound(late_keys.begin(),late_keys.end(),key),key);
+    if(late_keys.size()>=max_late_keys)
+    {
+      merge_late_keys();
+    }
+    return ;
+  }
+
+  //builds an epoch from the keys of the head and empties the head, a head of min_epoch_keys keys or less is kept
+  void seal_head()
+  {
+    if(head_num_keys()<=min_epoch_keys)
+    {
+      return ;
+    }
+    merge_late_keys();
+
+    window_epoch epoch;
+    epoch.min_key=head.front();
+    epoch.max_key=head.back();
+    epoch.num_keys=head.size();
+    epoch.filter.reset(new snarf_updatable_gcs_hash<T>(epoch_settings));
+    epoch.filter->snarf_init(head,bits_per_key,num_ele_per_block,num_hash_bits);
+
+    if(epochs.size()>0 && (epoch.min_key<epochs.back().min_key || epoch.max_key<epochs.back().max_key))
+    {
+      epochs_ordered=false;
+    }
+    epochs.push_back(move(epoch));
+    head.clear();
+    head.shrink_to_fit();
+
+    if(max_epochs>0 && epochs.size()>max_epochs)
+    {
+      drop_oldest_epoch();
+    }
+    return ;
+  }
+
+  //drops the oldest epoch in O(1)
+  void drop_oldest_epoch()
+  {
+    if(epochs.size()==0)
+    {
+      return ;
+    }
+    epochs.pop_front();
+    if(epochs.size()==0)
+    {
+      epochs_ordered=true;
+    }
+    return ;
+  }
+
+  //drops the epochs at the front of the ring whose keys are all smaller than var cutoff, returns the number of keys dropped
+  uint64_t expire_before(T cutoff)
+  {
+    uint64_t dropped=0;
+    while(epochs.size()>0 && epochs.front().max_key<cutoff)
+    {
+      dropped+=epochs.front().num_keys;
+      drop_oldest_epoch();
+    }
+    return dropped;
+  }
+
+  //calls var visit on each epoch overlapping [lower_val, upper_val], oldest first, until it returns true.
+  //Returns true if a call returned true
+  template <class F>
+  bool for_overlapping_epochs(T lower_val,T upper_val,F visit)
+  {
+    uint64_t first=0;
+    if(epochs_ordered)
+    {
+      //the first epoch whose largest key is not below the range
+      uint64_t lo=0,hi=epochs.size();
+      while(lo<hi)
+      {
+        uint64_t mid=(lo+hi)/2;
+        if(epochs[mid].max_key<lower_val)
+        {
+          lo=mid+1;
+        }
+        else
+        {
+          hi=mid;
+        }
+      }
+      first=lo;
+    }
+
+    for(uint64_t i=first;i<epochs.size();i++)
+    {
+      window_epoch &epoch=epochs[i];
+      if(upper_val<epoch.min_key)
+      {
+        if(epochs_ordered)
+        {
+          break;
+        }
+        continue;
+      }
+      if(epoch.max_key<lower_val)
+      {
+        continue;
+      }
+      if(visit(epoch))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool head_range_query(T lower_val,T upper_val)
+  {
+    auto itr=lower_bound(head.begin(),head.end(),lower_val);
+    if(itr!=head.end() && !(upper_val<*itr))
+    {
+      return true;
+    }
+    itr=lower_bound(late_keys.begin(),late_keys.end(),lower_val);
+    return itr!=late_keys.end() && !(upper_val<*itr);
+  }
+
+  //range query over the window, false positives come from the epochs only
+  bool range_query(T lower_val,T upper_val)
+  {
+    if(head_range_query(lower_val,upper_val))
+    {
+      return true;
+    }
+    return for_overlapping_epochs(lower_val,upper_val,[&](window_epoch &epoch){
+      return epoch.filter->range_query(max(lower_val,epoch.min_key),min(upper_val,epoch.max_key));
+    });
+  }
+
+  bool contains(T key)
+  {
+    if(head_range_query(key,key))
+    {
+      return true;
+    }
+    return for_overlapping_epochs(key,key,[&](window_epoch &epoch){
+      return epoch.filter->contains(key);
+    });
+  }
+
+  uint64_t num_keys()
+  {
+    uint64_t total=head_num_keys();
+    for(uint64_t i=0;i<epochs.size();i++)
+    {
+      total+=epochs[i].num_keys;
+    }
+    return total;
+  }
+
+  uint64_t return_size()
+  {
+    uint64_t total_size=head_num_keys()*sizeof(T);
+    for(uint64_t i=0;i<epochs.size();i++)
+    {
+      total_size+=2*sizeof(T)+sizeof(uint64_t)+epochs[i].filter->return_size();
+    }
+    return total_size;
+  }
+
+  //returns the memory of the epochs summed per component, plus the head and the ring
+  snarf_memory_report memory_report()
+  {
+    snarf_memory_report report;
+    for(uint64_t i=0;i<epochs.size();i++)
+    {
+      snarf_memory_report epoch_report=epochs[i].filter->memory_report();
+      for(int j=0;j<epoch_report.components.size();j++)
+      {
+        snarf_memory_component &component=epoch_report.components[j];
+        int k=0;
+        while(k<report.components.size() && report.components[k].name!=component.name)
+        {
+          k++;
+        }
+        if(k<report.components.size())
+        {
+          report.components[k].logical_bytes+=component.logical_bytes;
+          report.components[k].allocated_bytes+=component.allocated_bytes;
+        }
+        else
+        {
+          report.add(component.name,component.logical_bytes,component.allocated_bytes);
+        }
+      }
+    }
+    report.add("window head",head_num_keys()*sizeof(T),snarf_vector_heap_bytes(head)+snarf_vector_heap_bytes(late_keys));
+    report.add("epoch ring",epochs.size()*(2*sizeof(T)+sizeof(uint64_t)),epochs.size()*(sizeof(window_epoch)+snarf_heap_bytes(sizeof(snarf_updatable_gcs_hash<T>))));
+    return report;
+  }
+};
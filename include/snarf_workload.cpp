@@ -0,0 +1,183 @@
+#include<iostream>
+#include<algorithm>
+#include<cmath>
+#include<vector>
+#include<string>
+#include <fstream>
+#include <random>
+
+using namespace std;
+
+// Seeded key and query generators, the ground truth oracle and trace files shared by example.cpp and the benchmark driver
+
+// Fast seeded generator (splitmix64), the same seed gives the same keys and queries on every run
+struct snarf_workload_rng
+{
+  uint64_t state;
+
+  snarf_workload_rng(uint64_t seed){
+    state=seed;
+  }
+
+  uint64_t next()
+  {
+    uint64_t x=(state+=0x9e3779b97f4a7c15ULL);
+    x=(x^(x>>30))*0xbf58476d1ce4e5b9ULL;
+    x=(x^(x>>27))*0x94d049bb133111ebULL;
+    return x^(x>>31);
+  }
+
+  //uniform in [0, 1)
+  double next_double()
+  {
+    return (next()>>11)*(1.0/9007199254740992.0);
+  }
+
+  //uniform in [range_min, range_max], without the modulo bias
+  uint64_t next_in(uint64_t range_min,uint64_t range_max)
+  {
+    uint64_t width=range_max-range_min+1;
+    if(width==0)
+    {
+      return next();
+    }
+    return range_min+(uint64_t)(((unsigned __int128)next()*width)>>64);
+  }
+};
+
+// To get normal distribution centered on the range with a standard deviation of a quarter of it,
+// values outside the range (beyond 2 standard deviations) are drawn again
+vector<uint64_t> get_normal_distribution(uint64_t N, uint64_t range_min, uint64_t range_max, uint64_t seed) {
+
+    std::vector<uint64_t> results;
+    results.reserve(N); 
+
+    snarf_workload_rng gen(seed);
+
+    // Box-Muller gives two standard normal values per pair of uniform values
+    double spare = 0;
+    bool has_spare = false;
+    while (results.size() < N) {
+        double z;
+        if (has_spare) {
+            z = spare;
+            has_spare = false;
+        } else {
+            double u1 = 1.0 - gen.next_double(), u2 = gen.next_double();
+            double r = sqrt(-2.0 * log(u1));
+            z = r * cos(2 * M_PI * u2);
+            spare = r * sin(2 * M_PI * u2);
+            has_spare = true;
+        }
+        double number = z / 4 * (range_max - range_min) + (range_min + range_max) / 2.0;
+        if (number < range_min || number > range_max) { // Repeat if the number is outside the range
+            continue;
+        }
+        results.push_back(static_cast<uint64_t>(number));
+    }
+    return results;
+}
+
+
+// To get uniform distribution
+vector<uint64_t> get_uniform_distribution(uint64_t N, uint64_t range_min, uint64_t range_max, uint64_t seed) {
+    vector<uint64_t> v_keys(N, 0);
+    snarf_workload_rng gen(seed);
+
+    for (uint64_t i = 0; i < N; ++i) {
+        v_keys[i] = gen.next_in(range_min, range_max);
+    }
+
+    return v_keys;
+}
+
+// To get exponential distribution
+vector<uint64_t> get_exponential_distribution(uint64_t N, double lambda, uint64_t range_min, uint64_t range_max, uint64_t seed) {
+    vector<uint64_t> v_keys(N, 0);
+    snarf_workload_rng gen(seed);
+
+    double max_exp_value = log(range_max) / lambda;
+    
+    for (uint64_t i = 0; i < N; ++i) {
+        double exp_value = -log(1.0 - gen.next_double()) / lambda;
+        
+        
+        exp_value = min(max_exp_value, exp_value); 
+        double scale = exp_value / max_exp_value;
+        v_keys[i] = range_min + static_cast<uint64_t>((range_max - range_min) * scale);
+    }
+    return v_keys;
+}
+
+// Function to find if a query performs a false positive or not; it checks if a value exists within a certain range in source_vec
+bool find_key_in(const vector<uint64_t>& source_vec, uint64_t left_end, uint64_t right_end) {
+    auto lower = lower_bound(source_vec.begin(), source_vec.end(), left_end);
+
+    if (lower != source_vec.end() && *lower <= right_end) {
+        return true; // Found a value within the range
+    }
+
+    return false; // No values found within the range
+}
+
+// Answers all queries [lower[i], upper[i]] against the sorted keys in one merged pass: the queries are visited in
+// order of their lower ends, so the position in sorted_keys only moves forward. Sets truth[i] to 1 when a key is in the range
+void compute_ground_truth(const vector<uint64_t>& sorted_keys, const vector<uint64_t>& lower, const vector<uint64_t>& upper, vector<char>& truth) {
+    truth.assign(lower.size(), 0);
+
+    // close-K queries already come in order, others are sorted as (lower end, index) pairs
+    vector<pair<uint64_t, uint64_t>> order;
+    bool in_order = is_sorted(lower.begin(), lower.end());
+    if (!in_order) {
+        order.resize(lower.size());
+        for (uint64_t i = 0; i < order.size(); ++i) {
+            order[i] = make_pair(lower[i], i);
+        }
+        sort(order.begin(), order.end());
+    }
+
+    uint64_t pos = 0;
+    for (uint64_t j = 0; j < lower.size(); ++j) {
+        uint64_t i = in_order ? j : order[j].second;
+        while (pos < sorted_keys.size() && sorted_keys[pos] < lower[i]) {
+            pos++;
+        }
+        truth[i] = (pos < sorted_keys.size() && sorted_keys[pos] <= upper[i]);
+    }
+}
+
+// Reads a trace of little endian 64 bit values from a binary file into var values,
+// returns false if the file cannot be opened or read
+bool load_trace(string path, vector<uint64_t>& values) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in.good()) {
+        return false;
+    }
+
+    uint64_t num_bytes = in.tellg();
+    values.resize(num_bytes / sizeof(uint64_t));
+    in.seekg(0);
+    in.read((char*)values.data(), values.size() * sizeof(uint64_t));
+    return in.good();
+}
+
+// Writes values as a binary trace that load_trace reads back, returns false if the file cannot be written
+bool save_trace(string path, const vector<uint64_t>& values) {
+    ofstream out(path, ios::binary);
+    if (!out.good()) {
+        return false;
+    }
+
+    out.write((const char*)values.data(), values.size() * sizeof(uint64_t));
+    out.close();
+    return out.good();
+}
+
+// Returns the value below which a fraction (var q, between 0 and 1) of the sorted samples fall
+uint64_t percentile(const vector<uint64_t>& samples, double q) {
+    if (samples.size() == 0) {
+        return 0;
+    }
+    uint64_t index = min((uint64_t)(q * samples.size()), (uint64_t)samples.size() - 1);
+    return samples[index];
+}
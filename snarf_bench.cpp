@@ -0,0 +1,621 @@
+#include<iostream>
+#include<algorithm>
+#include<cmath>
+#include <random>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <shared_mutex>
+#include <mutex>
+using namespace std;
+using namespace std::chrono;
+#include "include/snarf_batch.cpp"
+#include "include/snarf_workload.cpp"
+
+// Non-interactive benchmark driver.
+// Builds a filter over generated or traced keys, runs a mix of range queries, inserts and deletes on a number of threads
+// and reports throughput, latency percentiles, FPR and bits per key.
+// Usage: ./snarf_bench.out [--option=value ...], ./snarf_bench.out --help lists the options
+
+struct bench_options
+{
+  uint64_t num_keys=10'000'000;
+  string key_dist="uniform";
+  string key_trace="";
+  uint64_t num_queries=1'000'000;
+  string query_dist="uniform";
+  string query_trace="";
+  vector<uint64_t> widths={0,16,64,256};
+  double bits_per_key=10;
+  int block_size=100;
+  double num_hash_bits=0;
+  int block_codec=SNARF_DEFAULT_BLOCK_CODEC;
+  int verification_mode=SNARF_VERIFY_BLOOM;
+  int fingerprint_bits=0;
+  int num_threads=1;
+  //number of operations over all threads, 0 runs one operation per query
+  uint64_t num_ops=0;
+  //weights of range queries, inserts and deletes
+  double read_weight=100,insert_weight=0,delete_weight=0;
+  string save_keys="";
+  string save_queries="";
+  //keys use seed, queries seed+1
+  uint64_t seed=1;
+  //queries in flight of the interleaved batch probes, 0 probes one query at a time
+  int batch=0;
+  //entries of the range query result cache, 0 disables it
+  uint64_t cache_entries=0;
+  //keys per linear model of the snarf model, and whether the model uses its compact encoding
+  int keys_per_model=10000;
+  bool compact_model=false;
+  //retunes the block size after the run under a cap in bits per key (0 for no cap), negative does not retune
+  double retune_cap=-1;
+  //counts one read out of fpr_stats_interval in the filter's fpr statistics and reports the positives of the FPR pass to them, 0 disables them
+  uint64_t fpr_stats_interval=0;
+};
+
+enum bench_op_type
+{
+  BENCH_READ=0,
+  BENCH_INSERT=1,
+  BENCH_DELETE=2
+};
+
+//a range query [a, b], or an insert or delete of key a
+struct bench_op
+{
+  int type;
+  uint64_t a,b;
+};
+
+void print_usage()
+{
+  cout<<"Options (--name=value):"<<endl
+      <<"  --keys=N               number of keys (10000000)"<<endl
+      <<"  --key-dist=D           uniform or normal"<<endl
+      <<"  --key-trace=FILE       binary file of 64 bit keys, replaces --keys and --key-dist"<<endl
+      <<"  --queries=Q            number of queries (1000000)"<<endl
+      <<"  --query-dist=D         uniform, normal or exponential"<<endl
+      <<"  --query-trace=FILE     binary file of 64 bit (lower, upper) pairs, replaces --queries, --query-dist and --widths"<<endl
+      <<"  --widths=W,W,...       range widths, used in turn by the queries (0,16,64,256)"<<endl
+      <<"  --bpk=B                bits per key of the bit blocks (10)"<<endl
+      <<"  --block=S              keys per block (100)"<<endl
+      <<"  --hash-bits=H          bits per key of the hash filter (0)"<<endl
+      <<"  --codec=C              golomb, rice-lut or elias-fano"<<endl
+      <<"  --verify=V             bloom or cuckoo hash filter"<<endl
+      <<"  --fingerprint-bits=F   fingerprint bits in the block entries (0)"<<endl
+      <<"  --threads=T            number of threads (1)"<<endl
+      <<"  --ops=O                number of operations over all threads (one per query)"<<endl
+      <<"  --mix=R:I:D            weights of range queries, inserts and deletes (100:0:0)"<<endl
+      <<"  --save-keys=FILE       writes the keys as a trace"<<endl
+      <<"  --save-queries=FILE    writes the queries as a trace"<<endl
+      <<"  --seed=S               seed of the generated keys and queries (1)"<<endl
+      <<"  --batch=G              runs of reads are probed as interleaved batches with G queries in flight,"<<endl
+      <<"                         the latency of a read is then the average of its run"<<endl
+      <<"  --cache=E              range query result cache with E entries (0), queries repeat when --ops exceeds --queries"<<endl
+      <<"  --model-keys=K         keys per linear model of the snarf model (10000)"<<endl
+      <<"  --compact-model=0|1    compact encoding of the snarf model (0)"<<endl
+      <<"  --retune=B             samples the reads, then retunes the block size under B bits per key (0 for no cap)"<<endl
+      <<"                         and times the queries before and after"<<endl
+      <<"  --fpr-stats=K          counts one read out of K in the filter's fpr statistics, reports the FPR they measure"<<endl;
+  return ;
+}
+
+//splits a list of values separated by a character
+vector<string> split_list(string s,char sep)
+{
+  vector<string> parts;
+  size_t start=0;
+  while(true)
+  {
+    size_t end=s.find(sep,start);
+    parts.push_back(s.substr(start,end-start));
+    if(end==string::npos)
+    {
+      break;
+    }
+    start=end+1;
+  }
+  return parts;
+}
+
+//returns false on an unknown option
+bool parse_options(int argc,char **argv,bench_options &opt)
+{
+  vector<string> block_codecs({"golomb","rice-lut","elias-fano"}); // same order as snarf_codec_type
+  for(int i=1;i<argc;i++)
+  {
+    string arg=argv[i];
+    size_t eq=arg.find('=');
+    if(arg.compare(0,2,"--")!=0 || eq==string::npos)
+    {
+      return false;
+    }
+    string name=arg.substr(2,eq-2),val=arg.substr(eq+1);
+
+    if(name=="keys") opt.num_keys=stoull(val);
+    else if(name=="key-dist") opt.key_dist=val;
+    else if(name=="key-trace") opt.key_trace=val;
+    else if(name=="queries") opt.num_queries=stoull(val);
+    else if(name=="query-dist") opt.query_dist=val;
+    else if(name=="query-trace") opt.query_trace=val;
+    else if(name=="bpk") opt.bits_per_key=stod(val);
+    else if(name=="block") opt.block_size=stoi(val);
+    else if(name=="hash-bits") opt.num_hash_bits=stod(val);
+    else if(name=="fingerprint-bits") opt.fingerprint_bits=stoi(val);
+    else if(name=="threads") opt.num_threads=max(1,stoi(val));
+    else if(name=="ops") opt.num_ops=stoull(val);
+    else if(name=="save-keys") opt.save_keys=val;
+    else if(name=="save-queries") opt.save_queries=val;
+    else if(name=="seed") opt.seed=stoull(val);
+    else if(name=="batch") opt.batch=stoi(val);
+    else if(name=="cache") opt.cache_entries=stoull(val);
+    else if(name=="model-keys") opt.keys_per_model=max(1,stoi(val));
+    else if(name=="compact-model") opt.compact_model=(stoi(val)!=0);
+    else if(name=="retune") opt.retune_cap=stod(val);
+    else if(name=="fpr-stats") opt.fpr_stats_interval=stoull(val);
+    else if(name=="verify" && (val=="bloom" || val=="cuckoo")) opt.verification_mode=(val=="cuckoo")?SNARF_VERIFY_CUCKOO:SNARF_VERIFY_BLOOM;
+    else if(name=="codec" && find(block_codecs.begin(),block_codecs.end(),val)!=block_codecs.end())
+    {
+      opt.block_codec=find(block_codecs.begin(),block_codecs.end(),val)-block_codecs.begin();
+    }
+    else if(name=="widths")
+    {
+      opt.widths.resize(0);
+      vector<string> parts=split_list(val,',');
+      for(int j=0;j<parts.size();j++)
+      {
+        opt.widths.push_back(stoull(parts[j]));
+      }
+    }
+    else if(name=="mix")
+    {
+      vector<string> parts=split_list(val,':');
+      if(parts.size()!=3)
+      {
+        return false;
+      }
+      opt.read_weight=stod(parts[0]);
+      opt.insert_weight=stod(parts[1]);
+      opt.delete_weight=stod(parts[2]);
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+vector<uint64_t> generate_keys(string dist,uint64_t N,uint64_t seed)
+{
+  if(dist=="normal")
+  {
+    return get_normal_distribution(N,0,static_cast<uint64_t>(pow(2,50))-1,seed);
+  }
+  else if(dist=="exponential")
+  {
+    return get_exponential_distribution(N,10.0,0,static_cast<uint64_t>(pow(2,50))-1,seed);
+  }
+  return get_uniform_distribution(N,0,static_cast<uint64_t>(pow(2,50))-1,seed);
+}
+
+int main(int argc,char **argv)
+{
+  bench_options opt;
+  if(!parse_options(argc,argv,opt) || opt.widths.size()==0)
+  {
+    print_usage();
+    return 1;
+  }
+
+  //----------------------------------------
+  //KEYS AND QUERIES
+  //----------------------------------------
+
+  //the keys inserted during the run are held back from the end of the key list, so a trace replays in its own order
+  vector<uint64_t> all_keys;
+  if(opt.key_trace!="")
+  {
+    if(!load_trace(opt.key_trace,all_keys))
+    {
+      cerr<<"cannot read "<<opt.key_trace<<endl;
+      return 1;
+    }
+  }
+  else
+  {
+    double total_weight=opt.read_weight+opt.insert_weight+opt.delete_weight;
+    uint64_t planned_ops=(opt.num_ops>0)?opt.num_ops:opt.num_queries;
+    uint64_t num_inserts=(total_weight>0)?ceil(planned_ops*opt.insert_weight/total_weight*1.1)+opt.num_threads:0;
+    all_keys=generate_keys(opt.key_dist,opt.num_keys+num_inserts,opt.seed);
+  }
+
+  //queries are (lower, upper) pairs, the class of a query is the index of its width, or 0 for a trace
+  vector<pair<uint64_t,uint64_t>> queries;
+  vector<int> query_class;
+  vector<string> class_names;
+  if(opt.query_trace!="")
+  {
+    vector<uint64_t> values;
+    if(!load_trace(opt.query_trace,values))
+    {
+      cerr<<"cannot read "<<opt.query_trace<<endl;
+      return 1;
+    }
+    for(uint64_t i=0;i+1<values.size();i+=2)
+    {
+      queries.push_back(make_pair(values[i],values[i+1]));
+      query_class.push_back(0);
+    }
+    class_names.push_back("trace");
+  }
+  else
+  {
+    vector<uint64_t> starts=generate_keys(opt.query_dist,opt.num_queries,opt.seed+1);
+    for(uint64_t i=0;i<starts.size();i++)
+    {
+      int c=i%opt.widths.size();
+      uint64_t upper=(starts[i]>UINT64_MAX-opt.widths[c])?UINT64_MAX:starts[i]+opt.widths[c];
+      queries.push_back(make_pair(starts[i],upper));
+      query_class.push_back(c);
+    }
+    for(int c=0;c<opt.widths.size();c++)
+    {
+      class_names.push_back("width "+to_string(opt.widths[c]));
+    }
+  }
+
+  if(opt.save_queries!="")
+  {
+    vector<uint64_t> values;
+    for(uint64_t i=0;i<queries.size();i++)
+    {
+      values.push_back(queries[i].first);
+      values.push_back(queries[i].second);
+    }
+    if(!save_trace(opt.save_queries,values))
+    {
+      cerr<<"cannot write "<<opt.save_queries<<endl;
+      return 1;
+    }
+  }
+  if(opt.save_keys!="")
+  {
+    if(!save_trace(opt.save_keys,all_keys))
+    {
+      cerr<<"cannot write "<<opt.save_keys<<endl;
+      return 1;
+    }
+  }
+
+  bool testbool=(queries.size()>0 && all_keys.size()>0);
+  assert(("There must be keys and queries to run!", testbool));
+
+  //----------------------------------------
+  //OPERATIONS
+  //----------------------------------------
+
+  uint64_t num_ops=(opt.num_ops>0)?opt.num_ops:queries.size();
+  double total_weight=opt.read_weight+opt.insert_weight+opt.delete_weight;
+  mt19937_64 gen(opt.seed);
+  uniform_real_distribution<double> pick(0.0,total_weight);
+
+  //first pass decides the type of every operation, then the keys are split between loading and inserting
+  vector<int> op_types(num_ops);
+  uint64_t num_inserts=0,num_deletes=0;
+  for(uint64_t i=0;i<num_ops;i++)
+  {
+    double r=pick(gen);
+    op_types[i]=(r<opt.read_weight)?BENCH_READ:((r<opt.read_weight+opt.insert_weight)?BENCH_INSERT:BENCH_DELETE);
+    num_inserts+=(op_types[i]==BENCH_INSERT);
+    num_deletes+=(op_types[i]==BENCH_DELETE);
+  }
+  uint64_t num_loaded=(opt.key_trace!="")?all_keys.size()-min(num_inserts,(uint64_t)all_keys.size()-1):min(opt.num_keys,(uint64_t)all_keys.size());
+  num_inserts=min(num_inserts,(uint64_t)all_keys.size()-num_loaded);
+  vector<uint64_t> initial_keys(all_keys.begin(),all_keys.begin()+num_loaded);
+  vector<uint64_t> insert_keys(all_keys.begin()+num_loaded,all_keys.begin()+num_loaded+num_inserts);
+
+  //deleted keys are distinct positions of the loaded keys, in random order
+  num_deletes=min(num_deletes,(uint64_t)initial_keys.size());
+  vector<uint64_t> delete_order(initial_keys.size());
+  for(uint64_t i=0;i<delete_order.size();i++)
+  {
+    delete_order[i]=i;
+  }
+  shuffle(delete_order.begin(),delete_order.end(),gen);
+
+  //operations are dealt round robin to the threads. Operations past the held back keys become reads
+  vector<vector<bench_op>> thread_ops(opt.num_threads);
+  uint64_t next_query=0,next_insert=0,next_delete=0;
+  vector<char> deleted(initial_keys.size(),0);
+  for(uint64_t i=0;i<num_ops;i++)
+  {
+    bench_op op;
+    if(op_types[i]==BENCH_INSERT && next_insert<insert_keys.size())
+    {
+      op={BENCH_INSERT,insert_keys[next_insert],0};
+      next_insert++;
+    }
+    else if(op_types[i]==BENCH_DELETE && next_delete<num_deletes)
+    {
+      op={BENCH_DELETE,initial_keys[delete_order[next_delete]],0};
+      deleted[delete_order[next_delete]]=1;
+      next_delete++;
+    }
+    else
+    {
+      op={BENCH_READ,queries[next_query%queries.size()].first,queries[next_query%queries.size()].second};
+      next_query++;
+    }
+    thread_ops[i%opt.num_threads].push_back(op);
+  }
+  bool has_writes=(next_insert+next_delete>0);
+
+  //----------------------------------------
+  //SNARF CONSTRUCTION
+  //----------------------------------------
+
+  snarf_updatable_gcs_hash<uint64_t> snarf_instance;
+  snarf_instance.set_block_codec(opt.block_codec);
+  snarf_instance.set_verification_mode(opt.verification_mode);
+  snarf_instance.set_fingerprint_bits(opt.fingerprint_bits);
+  snarf_instance.set_compact_model(opt.compact_model);
+  snarf_instance.rmi.keys_per_model=opt.keys_per_model;
+  vector<uint64_t> temp_keys=initial_keys;
+  auto build_start=steady_clock::now();
+  snarf_instance.snarf_init(temp_keys,opt.bits_per_key,opt.block_size,opt.num_hash_bits);
+  auto build_stop=steady_clock::now();
+  snarf_instance.enable_range_cache(opt.cache_entries);
+  if(opt.retune_cap>=0)
+  {
+    snarf_instance.enable_query_sampling(16,16384);
+  }
+  if(opt.fpr_stats_interval>0)
+  {
+    snarf_instance.enable_fpr_stats(opt.fpr_stats_interval);
+  }
+
+  //----------------------------------------
+  //TIMED RUN
+  //----------------------------------------
+
+  //reads share the lock, inserts and deletes take it alone. Read only runs take no lock
+  shared_mutex filter_lock;
+  vector<vector<uint64_t>> read_latencies(opt.num_threads),write_latencies(opt.num_threads);
+  vector<uint64_t> positives(opt.num_threads,0);
+  atomic<int> ready(0);
+  atomic<bool> go(false);
+
+  auto worker=[&](int t){
+    vector<bench_op> &ops=thread_ops[t];
+    read_latencies[t].reserve(ops.size());
+    ready++;
+    while(!go.load())
+    {
+      this_thread::yield();
+    }
+
+    snarf_batch_query<uint64_t> batch_query;
+    batch_query.init(&snarf_instance,opt.batch);
+    vector<uint64_t> lower_vals,upper_vals;
+    vector<char> answers;
+
+    for(uint64_t i=0;i<ops.size();i++)
+    {
+      auto start=steady_clock::now();
+      if(ops[i].type==BENCH_READ && opt.batch>0)
+      {
+        //a run of up to 256 consecutive reads
+        lower_vals.resize(0);
+        upper_vals.resize(0);
+        while(i<ops.size() && ops[i].type==BENCH_READ && lower_vals.size()<256)
+        {
+          lower_vals.push_back(ops[i].a);
+          upper_vals.push_back(ops[i].b);
+          i++;
+        }
+        i--;
+        {
+          shared_lock<shared_mutex> lock(filter_lock,defer_lock);
+          if(has_writes)
+          {
+            lock.lock();
+          }
+          batch_query.range_query(lower_vals,upper_vals,answers);
+        }
+        uint64_t run_ns=duration_cast<nanoseconds>(steady_clock::now()-start).count();
+        for(uint64_t j=0;j<answers.size();j++)
+        {
+          positives[t]+=answers[j];
+          read_latencies[t].push_back(run_ns/answers.size());
+        }
+      }
+      else if(ops[i].type==BENCH_READ)
+      {
+        if(has_writes)
+        {
+          shared_lock<shared_mutex> lock(filter_lock);
+          positives[t]+=snarf_instance.range_query(ops[i].a,ops[i].b);
+        }
+        else
+        {
+          positives[t]+=snarf_instance.range_query(ops[i].a,ops[i].b);
+        }
+        read_latencies[t].push_back(duration_cast<nanoseconds>(steady_clock::now()-start).count());
+      }
+      else
+      {
+        {
+          unique_lock<shared_mutex> lock(filter_lock);
+          if(ops[i].type==BENCH_INSERT)
+          {
+            snarf_instance.insert_key(ops[i].a);
+          }
+          else
+          {
+            snarf_instance.delete_key(ops[i].a);
+          }
+        }
+        write_latencies[t].push_back(duration_cast<nanoseconds>(steady_clock::now()-start).count());
+      }
+    }
+  };
+
+  vector<thread> threads;
+  for(int t=0;t<opt.num_threads;t++)
+  {
+    threads.push_back(thread(worker,t));
+  }
+  while(ready.load()<opt.num_threads)
+  {
+    this_thread::yield();
+  }
+  auto run_start=steady_clock::now();
+  go=true;
+  for(int t=0;t<opt.num_threads;t++)
+  {
+    threads[t].join();
+  }
+  auto run_stop=steady_clock::now();
+  uint64_t cache_hits=snarf_instance.range_cache.hits,cache_misses=snarf_instance.range_cache.misses;
+
+  //----------------------------------------
+  //FPR AGAINST THE FINAL KEYS
+  //----------------------------------------
+
+  //the queries are checked again after the run, on the filter and keys it ended with
+  vector<uint64_t> final_keys;
+  for(uint64_t i=0;i<initial_keys.size();i++)
+  {
+    if(!deleted[i])
+    {
+      final_keys.push_back(initial_keys[i]);
+    }
+  }
+  final_keys.insert(final_keys.end(),insert_keys.begin(),insert_keys.begin()+next_insert);
+  sort(final_keys.begin(),final_keys.end());
+
+  vector<uint64_t> lower(queries.size()),upper(queries.size());
+  for(uint64_t i=0;i<queries.size();i++)
+  {
+    lower[i]=queries[i].first;
+    upper[i]=queries[i].second;
+  }
+  vector<char> truths;
+  compute_ground_truth(final_keys,lower,upper,truths);
+
+  vector<uint64_t> class_fp(class_names.size(),0),class_tn(class_names.size(),0);
+  uint64_t false_negatives=0;
+  for(uint64_t i=0;i<queries.size();i++)
+  {
+    bool answer=snarf_instance.range_query(queries[i].first,queries[i].second);
+    bool truth=truths[i];
+    false_negatives+=(truth && !answer);
+    if(answer)
+    {
+      snarf_instance.report_positive(queries[i].first,queries[i].second,!truth);
+    }
+    if(!truth)
+    {
+      class_fp[query_class[i]]+=answer;
+      class_tn[query_class[i]]+=!answer;
+    }
+  }
+
+  //----------------------------------------
+  //BLOCK SIZE RETUNING
+  //----------------------------------------
+
+  //the queries are timed on one thread before and after retuning, and must get the same answers
+  uint64_t old_block_size=snarf_instance.block_size;
+  double before_ns=0,after_ns=0,before_bits=0;
+  uint64_t changed_answers=0;
+  if(opt.retune_cap>=0)
+  {
+    vector<char> before_answers(queries.size());
+    before_bits=snarf_instance.return_size()*8.00/max((uint64_t)1,(uint64_t)final_keys.size());
+    auto start=steady_clock::now();
+    for(uint64_t i=0;i<queries.size();i++)
+    {
+      before_answers[i]=snarf_instance.range_query(queries[i].first,queries[i].second);
+    }
+    before_ns=duration_cast<nanoseconds>(steady_clock::now()-start).count()*1.00/max((size_t)1,queries.size());
+
+    snarf_instance.retune(opt.retune_cap);
+
+    start=steady_clock::now();
+    for(uint64_t i=0;i<queries.size();i++)
+    {
+      changed_answers+=(before_answers[i]!=snarf_instance.range_query(queries[i].first,queries[i].second));
+    }
+    after_ns=duration_cast<nanoseconds>(steady_clock::now()-start).count()*1.00/max((size_t)1,queries.size());
+  }
+
+  //----------------------------------------
+  //REPORT
+  //----------------------------------------
+
+  vector<uint64_t> reads,writes;
+  uint64_t total_positives=0;
+  for(int t=0;t<opt.num_threads;t++)
+  {
+    reads.insert(reads.end(),read_latencies[t].begin(),read_latencies[t].end());
+    writes.insert(writes.end(),write_latencies[t].begin(),write_latencies[t].end());
+    total_positives+=positives[t];
+  }
+  sort(reads.begin(),reads.end());
+  sort(writes.begin(),writes.end());
+
+  double run_seconds=duration_cast<nanoseconds>(run_stop-run_start).count()/1e9;
+  cout<<"keys: "<<initial_keys.size()<<" queries: "<<queries.size()<<" threads: "<<opt.num_threads<<endl;
+  cout<<"build: "<<duration_cast<milliseconds>(build_stop-build_start).count()<<" ms"<<endl;
+  cout<<"operations: "<<reads.size()<<" reads ("<<total_positives<<" positive), "<<next_insert<<" inserts, "<<next_delete<<" deletes in "
+      <<fixed<<setprecision(3)<<run_seconds<<" s, "<<setprecision(0)<<(reads.size()+writes.size())/run_seconds<<" ops/s"<<defaultfloat<<setprecision(6)<<endl;
+  if(opt.cache_entries>0)
+  {
+    cout<<"range cache: "<<cache_hits<<" hits, "<<cache_misses<<" misses, hit rate "<<cache_hits*1.0/max((uint64_t)1,cache_hits+cache_misses)<<endl;
+  }
+
+  vector<double> qs({0.5,0.9,0.99,0.999});
+  vector<string> q_names({"p50","p90","p99","p99.9"});
+  cout<<"read latency ns:";
+  for(int i=0;i<qs.size();i++)
+  {
+    cout<<" "<<q_names[i]<<" "<<percentile(reads,qs[i]);
+  }
+  cout<<" max "<<(reads.size()>0?reads.back():0)<<endl;
+  if(writes.size()>0)
+  {
+    cout<<"write latency ns:";
+    for(int i=0;i<qs.size();i++)
+    {
+      cout<<" "<<q_names[i]<<" "<<percentile(writes,qs[i]);
+    }
+    cout<<" max "<<writes.back()<<endl;
+  }
+
+  for(int c=0;c<class_names.size();c++)
+  {
+    uint64_t empty=class_fp[c]+class_tn[c];
+    cout<<"FPR "<<class_names[c]<<": "<<((empty>0)?class_fp[c]*1.0/empty:0.0)<<" ("<<empty<<" empty queries)"<<endl;
+  }
+  cout<<"false negatives: "<<false_negatives<<endl;
+  if(opt.fpr_stats_interval>0)
+  {
+    cout<<"measured FPR: "<<snarf_instance.measured_fpr()<<endl;
+    snarf_instance.fpr_stats.print(cout);
+  }
+  cout<<"bits per key: "<<snarf_instance.return_size()*8.00/max((uint64_t)1,(uint64_t)final_keys.size())
+      <<" (model "<<snarf_instance.rmi.return_size()*8.00/max((uint64_t)1,(uint64_t)final_keys.size())<<")"<<endl;
+  if(opt.retune_cap>=0)
+  {
+    cout<<"retune: block size "<<old_block_size<<" -> "<<snarf_instance.block_size<<", "<<before_ns<<" -> "<<after_ns<<" ns per query, "
+        <<before_bits<<" -> "<<snarf_instance.return_size()*8.00/max((uint64_t)1,(uint64_t)final_keys.size())<<" bits per key, "
+        <<changed_answers<<" changed answers"<<endl;
+  }
+
+  return 0;
+}
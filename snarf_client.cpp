@@ -0,0 +1,410 @@
+#include<iostream>
+#include<algorithm>
+#include<cmath>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <thread>
+#include <atomic>
+using namespace std;
+using namespace std::chrono;
+#include "include/snarf_persist.cpp"
+#include "include/snarf_workload.cpp"
+#include "include/snarf_protocol.cpp"
+
+// Load generator for snarf_server.cpp.
+// Each thread opens one connection and keeps a number of requests in flight on it for a fixed time, each request a batch
+// of probes. Reports throughput and the percentiles of the request round trip.
+// Also writes a filter over generated keys for the server to load (--make-filter), and asks the server to reload (--reload).
+// Usage: ./snarf_client.out --unix=/tmp/snarf.sock --filter=events --connections=8 --batch=64 --pipeline=4 --seconds=10
+
+struct client_options
+{
+  string tcp_address="";
+  string unix_path="";
+  string filter="";
+  int num_connections=1;
+  //probes per request, and requests in flight per connection
+  uint64_t batch=64;
+  int pipeline=4;
+  double seconds=5;
+  vector<uint64_t> widths={0,16,64,256};
+  //queries are uniform in [0, key_max], the range of the keys of --make-filter
+  uint64_t key_max=((uint64_t)1<<50)-1;
+  string query_trace="";
+  uint64_t seed=1;
+  //writes a filter over num_keys uniform keys to make_filter and exits
+  string make_filter="";
+  uint64_t num_keys=10'000'000;
+  double bits_per_key=10;
+  int block_size=100;
+  double num_hash_bits=0;
+  bool reload=false;
+};
+
+void print_usage()
+{
+  cout<<"Options (--name=value):"<<endl
+      <<"  --tcp=HOST:PORT        server TCP address"<<endl
+      <<"  --unix=PATH            server unix socket"<<endl
+      <<"  --filter=NAME          filter to probe"<<endl
+      <<"  --connections=C        number of connections, one thread each (1)"<<endl
+      <<"  --batch=B              probes per request (64)"<<endl
+      <<"  --pipeline=D           requests in flight per connection (4)"<<endl
+      <<"  --seconds=S            length of the run (5)"<<endl
+      <<"  --widths=W,W,...       range widths, used in turn by the probes, only 0 sends point requests (0,16,64,256)"<<endl
+      <<"  --key-max=K            largest probed key (2^50-1)"<<endl
+      <<"  --query-trace=FILE     binary file of 64 bit (lower, upper) pairs, replaces --widths and --key-max"<<endl
+      <<"  --seed=S               seed of the keys and probes (1)"<<endl
+      <<"  --make-filter=PATH     writes a filter over --keys uniform keys in [0, 2^50) to PATH and exits"<<endl
+      <<"  --keys=N               keys of --make-filter (10000000)"<<endl
+      <<"  --bpk=B                bits per key of --make-filter (10)"<<endl
+      <<"  --block=S              keys per block of --make-filter (100)"<<endl
+      <<"  --hash-bits=H          hash filter bits per key of --make-filter (0)"<<endl
+      <<"  --reload=1             asks the server to check its filter files for changes and exits"<<endl;
+  return ;
+}
+
+//splits a list of values separated by a character
+vector<string> split_list(string s,char sep)
+{
+  vector<string> parts;
+  size_t start=0;
+  while(true)
+  {
+    size_t end=s.find(sep,start);
+    parts.push_back(s.substr(start,end-start));
+    if(end==string::npos)
+    {
+      break;
+    }
+    start=end+1;
+  }
+  return parts;
+}
+
+//returns false on an unknown option
+bool parse_options(int argc,char **argv,client_options &opt)
+{
+  for(int i=1;i<argc;i++)
+  {
+    string arg=argv[i];
+    size_t eq=arg.find('=');
+    if(arg.compare(0,2,"--")!=0 || eq==string::npos)
+    {
+      return false;
+    }
+    string name=arg.substr(2,eq-2),val=arg.substr(eq+1);
+
+    if(name=="tcp") opt.tcp_address=val;
+    else if(name=="unix") opt.unix_path=val;
+    else if(name=="filter") opt.filter=val;
+    else if(name=="connections") opt.num_connections=max(1,stoi(val));
+    else if(name=="batch") opt.batch=max((uint64_t)1,(uint64_t)stoull(val));
+    else if(name=="pipeline") opt.pipeline=max(1,stoi(val));
+    else if(name=="seconds") opt.seconds=stod(val);
+    else if(name=="key-max") opt.key_max=stoull(val);
+    else if(name=="query-trace") opt.query_trace=val;
+    else if(name=="seed") opt.seed=stoull(val);
+    else if(name=="make-filter") opt.make_filter=val;
+    else if(name=="keys") opt.num_keys=stoull(val);
+    else if(name=="bpk") opt.bits_per_key=stod(val);
+    else if(name=="block") opt.block_size=stoi(val);
+    else if(name=="hash-bits") opt.num_hash_bits=stod(val);
+    else if(name=="reload") opt.reload=(stoi(val)!=0);
+    else if(name=="widths")
+    {
+      opt.widths.resize(0);
+      vector<string> parts=split_list(val,',');
+      for(int j=0;j<parts.size();j++)
+      {
+        opt.widths.push_back(stoull(parts[j]));
+      }
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//returns a blocking connection to the server, or -1
+int connect_to_server(client_options &opt)
+{
+  int fd=-1;
+  if(opt.unix_path!="")
+  {
+    sockaddr_un addr;
+    if(!snarf_parse_unix_address(opt.unix_path,addr))
+    {
+      return -1;
+    }
+    fd=socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd>=0 && connect(fd,(sockaddr*)&addr,sizeof(addr))!=0)
+    {
+      close(fd);
+      fd=-1;
+    }
+  }
+  else
+  {
+    sockaddr_in addr;
+    if(!snarf_parse_tcp_address(opt.tcp_address,addr))
+    {
+      return -1;
+    }
+    fd=socket(AF_INET,SOCK_STREAM,0);
+    if(fd>=0 && connect(fd,(sockaddr*)&addr,sizeof(addr))!=0)
+    {
+      close(fd);
+      fd=-1;
+    }
+    int one=1;
+    if(fd>=0)
+    {
+      setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+    }
+  }
+  return fd;
+}
+
+bool send_all(int fd,const unsigned char *data,uint64_t num_bytes)
+{
+  while(num_bytes>0)
+  {
+    ssize_t sent=send(fd,data,num_bytes,MSG_NOSIGNAL);
+    if(sent<=0)
+    {
+      return false;
+    }
+    data+=sent;
+    num_bytes-=sent;
+  }
+  return true;
+}
+
+bool receive_all(int fd,unsigned char *data,uint64_t num_bytes)
+{
+  while(num_bytes>0)
+  {
+    ssize_t received=recv(fd,data,num_bytes,0);
+    if(received<=0)
+    {
+      return false;
+    }
+    data+=received;
+    num_bytes-=received;
+  }
+  return true;
+}
+
+//reads one response into var header and var answer_bits, returns false if the connection failed
+bool receive_response(int fd,snarf_response_header &header,vector<unsigned char> &answer_bits)
+{
+  if(!receive_all(fd,(unsigned char*)&header,sizeof(header)) || header.magic!=snarf_response_magic)
+  {
+    return false;
+  }
+  answer_bits.resize(snarf_answer_bytes(header.num_answers));
+  return receive_all(fd,answer_bits.data(),answer_bits.size());
+}
+
+//writes a filter over uniform keys with snarf_persistent_hash, see --make-filter
+int make_filter(client_options &opt)
+{
+  vector<uint64_t> keys=get_uniform_distribution(opt.num_keys,0,((uint64_t)1<<50)-1,opt.seed);
+  snarf_persistent_hash<uint64_t> filter;
+  if(!filter.create(opt.make_filter,keys,opt.bits_per_key,opt.block_size,opt.num_hash_bits))
+  {
+    cerr<<"cannot write "<<opt.make_filter<<endl;
+    return 1;
+  }
+  cout<<"wrote "<<opt.make_filter<<" ("<<opt.num_keys<<" keys, "<<filter.snarf_instance.return_size()*8.00/max((uint64_t)1,opt.num_keys)<<" bits per key)"<<endl;
+  return 0;
+}
+
+int main(int argc,char **argv)
+{
+  client_options opt;
+  if(!parse_options(argc,argv,opt) || opt.widths.size()==0)
+  {
+    print_usage();
+    return 1;
+  }
+  if(opt.make_filter!="")
+  {
+    return make_filter(opt);
+  }
+  if(opt.tcp_address=="" && opt.unix_path=="")
+  {
+    print_usage();
+    return 1;
+  }
+
+  if(opt.reload)
+  {
+    int fd=connect_to_server(opt);
+    vector<unsigned char> request;
+    snarf_append_request(request,SNARF_OP_RELOAD,"",0,NULL,NULL,0);
+    snarf_response_header header;
+    vector<unsigned char> answer_bits;
+    bool ok=(fd>=0 && send_all(fd,request.data(),request.size()) && receive_response(fd,header,answer_bits));
+    cout<<(ok?"reload requested":"cannot reach the server")<<endl;
+    return ok?0:1;
+  }
+
+  //----------------------------------------
+  //PROBES
+  //----------------------------------------
+
+  //every connection cycles through the same probes from a different starting point
+  vector<uint64_t> lower_vals,upper_vals;
+  if(opt.query_trace!="")
+  {
+    vector<uint64_t> values;
+    if(!load_trace(opt.query_trace,values))
+    {
+      cerr<<"cannot read "<<opt.query_trace<<endl;
+      return 1;
+    }
+    for(uint64_t i=0;i+1<values.size();i+=2)
+    {
+      lower_vals.push_back(values[i]);
+      upper_vals.push_back(values[i+1]);
+    }
+  }
+  else
+  {
+    snarf_workload_rng rng(opt.seed+1);
+    for(uint64_t i=0;i<(1<<20);i++)
+    {
+      uint64_t width=opt.widths[i%opt.widths.size()];
+      uint64_t lower=rng.next_in(0,opt.key_max-min(opt.key_max,width));
+      lower_vals.push_back(lower);
+      upper_vals.push_back(lower+width);
+    }
+  }
+  if(lower_vals.size()<opt.batch)
+  {
+    cerr<<"fewer probes than --batch"<<endl;
+    return 1;
+  }
+  bool points_only=(opt.query_trace=="" && *max_element(opt.widths.begin(),opt.widths.end())==0);
+  uint8_t op=points_only?SNARF_OP_POINT:SNARF_OP_RANGE;
+
+  //----------------------------------------
+  //TIMED RUN
+  //----------------------------------------
+
+  vector<vector<uint64_t>> latencies(opt.num_connections);
+  vector<uint64_t> positives(opt.num_connections,0),errors(opt.num_connections,0);
+  atomic<int> failed_connections(0);
+  auto run_start=steady_clock::now();
+  auto deadline=run_start+nanoseconds((uint64_t)(opt.seconds*1e9));
+
+  auto worker=[&](int t){
+    int fd=connect_to_server(opt);
+    if(fd<0)
+    {
+      failed_connections++;
+      return ;
+    }
+
+    uint64_t next_probe=(lower_vals.size()/opt.num_connections*t)/opt.batch*opt.batch;
+    vector<steady_clock::time_point> sent_at(opt.pipeline);
+    vector<unsigned char> request,answer_bits;
+    snarf_response_header header;
+    uint64_t next_id=0,in_flight=0;
+
+    auto send_request=[&](){
+      if(next_probe+opt.batch>lower_vals.size())
+      {
+        next_probe=0;
+      }
+      request.resize(0);
+      snarf_append_request(request,op,opt.filter,next_id,&lower_vals[next_probe],&upper_vals[next_probe],opt.batch);
+      next_probe+=opt.batch;
+      sent_at[next_id%opt.pipeline]=steady_clock::now();
+      next_id++;
+      in_flight++;
+      return send_all(fd,request.data(),request.size());
+    };
+
+    bool ok=true;
+    for(int i=0;i<opt.pipeline && ok;i++)
+    {
+      ok=send_request();
+    }
+    //a response frees its slot for the next request until the deadline, then the requests in flight are drained
+    while(ok && in_flight>0)
+    {
+      if(!receive_response(fd,header,answer_bits))
+      {
+        ok=false;
+        break;
+      }
+      auto now=steady_clock::now();
+      in_flight--;
+      latencies[t].push_back(duration_cast<nanoseconds>(now-sent_at[header.request_id%opt.pipeline]).count());
+      positives[t]+=header.num_positives;
+      errors[t]+=(header.status!=SNARF_STATUS_OK);
+      if(now<deadline)
+      {
+        ok=send_request();
+      }
+    }
+    if(!ok)
+    {
+      failed_connections++;
+    }
+    close(fd);
+    return ;
+  };
+
+  vector<thread> threads;
+  for(int t=0;t<opt.num_connections;t++)
+  {
+    threads.push_back(thread(worker,t));
+  }
+  for(int t=0;t<opt.num_connections;t++)
+  {
+    threads[t].join();
+  }
+  auto run_stop=steady_clock::now();
+
+  //----------------------------------------
+  //REPORT
+  //----------------------------------------
+
+  vector<uint64_t> all_latencies;
+  uint64_t total_positives=0,total_errors=0;
+  for(int t=0;t<opt.num_connections;t++)
+  {
+    all_latencies.insert(all_latencies.end(),latencies[t].begin(),latencies[t].end());
+    total_positives+=positives[t];
+    total_errors+=errors[t];
+  }
+  sort(all_latencies.begin(),all_latencies.end());
+
+  double run_seconds=duration_cast<nanoseconds>(run_stop-run_start).count()/1e9;
+  uint64_t num_requests=all_latencies.size();
+  cout<<"connections: "<<opt.num_connections<<" batch: "<<opt.batch<<" pipeline: "<<opt.pipeline<<endl;
+  cout<<"requests: "<<num_requests<<" in "<<fixed<<setprecision(3)<<run_seconds<<" s, "<<setprecision(0)<<num_requests/run_seconds<<" requests/s, "
+      <<num_requests*opt.batch/run_seconds<<" probes/s"<<defaultfloat<<setprecision(6)<<endl;
+  cout<<"positive probes: "<<total_positives*1.0/max((uint64_t)1,num_requests*opt.batch)<<endl;
+
+  vector<double> qs({0.5,0.9,0.99,0.999});
+  vector<string> q_names({"p50","p90","p99","p99.9"});
+  cout<<"request latency us:";
+  for(int i=0;i<qs.size();i++)
+  {
+    cout<<" "<<q_names[i]<<" "<<percentile(all_latencies,qs[i])/1000.0;
+  }
+  cout<<" max "<<(all_latencies.size()>0?all_latencies.back()/1000.0:0)<<endl;
+  if(total_errors>0 || failed_connections>0)
+  {
+    cout<<"errors: "<<total_errors<<" failed requests, "<<failed_connections<<" failed connections"<<endl;
+  }
+  return (failed_connections>0)?1:0;
+}
@@ -0,0 +1,617 @@
+#include<iostream>
+#include<algorithm>
+#include<string>
+#include<vector>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <csignal>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+using namespace std;
+using namespace std::chrono;
+#include "include/snarf_persist.cpp"
+#include "include/snarf_batch.cpp"
+#include "include/snarf_protocol.cpp"
+
+// Stand-alone filter server.
+// Loads filters stored by snarf_persistent_hash (path.base, path.delta, path.log) and answers batches of range and
+// point probes over TCP and/or a unix socket, with the protocol of include/snarf_protocol.cpp.
+// An acceptor thread hands each connection to one of the worker threads, each worker runs its own epoll loop over its
+// connections and answers a request with interleaved batch probes (see snarf_batch.cpp). Filter files are checked for
+// changes every reload interval and reloaded in the background, the new filter replaces the old one atomically and
+// requests in flight finish on the old one.
+// Usage: ./snarf_server.out --unix=/tmp/snarf.sock --filter=events=/data/events [--option=value ...]
+
+struct server_options
+{
+  string tcp_address="";
+  string unix_path="";
+  //(name, path) of each filter, and a directory whose *.base files are served under their file name
+  vector<pair<string,string>> filters;
+  string filter_dir="";
+  int num_workers=max(1,(int)thread::hardware_concurrency());
+  //pins worker i to cpu i
+  bool pin_workers=false;
+  uint64_t reload_ms=1000;
+  //queries in flight of the interleaved batch probes
+  int batch=16;
+  //probes per request, a larger request closes the connection
+  uint64_t max_probes=1<<20;
+  //bytes of responses waiting to be sent past which a connection stops answering and reading requests
+  uint64_t max_pending=1<<20;
+};
+
+void print_usage()
+{
+  cout<<"Options (--name=value):"<<endl
+      <<"  --tcp=HOST:PORT        listens on a TCP address, e.g. 127.0.0.1:7070"<<endl
+      <<"  --unix=PATH            listens on a unix socket"<<endl
+      <<"  --filter=NAME=PATH     serves the filter stored at PATH (PATH.base, ...) as NAME, can be repeated"<<endl
+      <<"  --dir=DIR              serves every filter stored in DIR under its file name"<<endl
+      <<"  --workers=W            number of worker threads (one per cpu)"<<endl
+      <<"  --pin=0|1              pins each worker to a cpu (0)"<<endl
+      <<"  --reload-ms=M          checks the filter files for changes every M ms, 0 only on reload requests (1000)"<<endl
+      <<"  --batch=G              queries in flight of the interleaved batch probes (16)"<<endl
+      <<"  --max-probes=P         largest number of probes in a request (1048576)"<<endl
+      <<"  --max-pending=B        bytes of unsent responses after which a connection is not read until they are sent (1048576)"<<endl;
+  return ;
+}
+
+//returns false on an unknown option
+bool parse_options(int argc,char **argv,server_options &opt)
+{
+  for(int i=1;i<argc;i++)
+  {
+    string arg=argv[i];
+    size_t eq=arg.find('=');
+    if(arg.compare(0,2,"--")!=0 || eq==string::npos)
+    {
+      return false;
+    }
+    string name=arg.substr(2,eq-2),val=arg.substr(eq+1);
+
+    if(name=="tcp") opt.tcp_address=val;
+    else if(name=="unix") opt.unix_path=val;
+    else if(name=="dir") opt.filter_dir=val;
+    else if(name=="workers") opt.num_workers=max(1,stoi(val));
+    else if(name=="pin") opt.pin_workers=(stoi(val)!=0);
+    else if(name=="reload-ms") opt.reload_ms=stoull(val);
+    else if(name=="batch") opt.batch=max(1,stoi(val));
+    else if(name=="max-probes") opt.max_probes=stoull(val);
+    else if(name=="max-pending") opt.max_pending=max((uint64_t)1,(uint64_t)stoull(val));
+    else if(name=="filter" && val.find('=')!=string::npos)
+    {
+      opt.filters.push_back(make_pair(val.substr(0,val.find('=')),val.substr(val.find('=')+1)));
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------
+//FILTERS AND HOT RELOAD
+//----------------------------------------
+
+typedef snarf_persistent_hash<uint64_t> served_snarf;
+
+//inode, size and modification time of the files of a filter, a change of any of them triggers a reload
+struct filter_stamp
+{
+  uint64_t values[3][3];
+
+  bool operator!=(const filter_stamp &other) const
+  {
+    return memcmp(values,other.values,sizeof(values))!=0;
+  }
+};
+
+struct served_filter
+{
+  string name,path;
+  //replaced with atomic_store, read with atomic_load
+  shared_ptr<served_snarf> current;
+  filter_stamp stamp;
+};
+
+filter_stamp read_stamp(const string &path)
+{
+  filter_stamp stamp;
+  memset(&stamp,0,sizeof(stamp));
+  string files[3]={path+".base",path+".delta",path+".log"};
+  for(int i=0;i<3;i++)
+  {
+    struct stat st;
+    if(stat(files[i].c_str(),&st)==0)
+    {
+      stamp.values[i][0]=st.st_ino;
+      stamp.values[i][1]=st.st_size;
+      stamp.values[i][2]=st.st_mtim.tv_sec*1000000000ULL+st.st_mtim.tv_nsec;
+    }
+  }
+  return stamp;
+}
+
+//loads the filter files, returns NULL if there is no valid base image
+shared_ptr<served_snarf> load_filter(const string &path)
+{
+  shared_ptr<served_snarf> filter=make_shared<served_snarf>();
+  if(!filter->open_read_only(path))
+  {
+    return NULL;
+  }
+  return filter;
+}
+
+//filters by name, fixed once the server starts
+unordered_map<string,served_filter*> filters_by_name;
+
+//wakes the reload thread before its interval ends
+mutex reload_mutex;
+condition_variable reload_wakeup;
+bool reload_requested=false;
+
+void request_reload()
+{
+  lock_guard<mutex> guard(reload_mutex);
+  reload_requested=true;
+  reload_wakeup.notify_one();
+  return ;
+}
+
+//checks the files of every filter and reloads the changed ones. A file caught in the middle of a write fails to load
+//or stops at its torn end, and is reloaded again once its stamp settles
+void reload_loop(uint64_t reload_ms)
+{
+  while(true)
+  {
+    {
+      unique_lock<mutex> lock(reload_mutex);
+      if(reload_ms>0)
+      {
+        reload_wakeup.wait_for(lock,milliseconds(reload_ms),[](){ return reload_requested; });
+      }
+      else
+      {
+        reload_wakeup.wait(lock,[](){ return reload_requested; });
+      }
+      reload_requested=false;
+    }
+
+    for(auto itr=filters_by_name.begin();itr!=filters_by_name.end();itr++)
+    {
+      served_filter *filter=itr->second;
+      filter_stamp stamp=read_stamp(filter->path);
+      if(!(stamp!=filter->stamp))
+      {
+        continue;
+      }
+      shared_ptr<served_snarf> loaded=load_filter(filter->path);
+      if(loaded==NULL || read_stamp(filter->path)!=stamp)
+      {
+        continue;
+      }
+      atomic_store(&filter->current,loaded);
+      filter->stamp=stamp;
+      cerr<<"reloaded "<<filter->name<<" ("<<loaded->snarf_instance.num_stored_keys<<" keys)"<<endl;
+    }
+  }
+  return ;
+}
+
+//----------------------------------------
+//WORKERS
+//----------------------------------------
+
+struct server_connection
+{
+  int fd;
+  vector<unsigned char> in,out;
+  uint64_t in_offset=0,out_offset=0;
+  //epoll events the connection is registered for
+  uint32_t events=0;
+};
+
+struct server_worker
+{
+  int epoll_fd;
+  server_options *opt;
+  snarf_batch_query<uint64_t> batch_query;
+  vector<uint64_t> lower_vals,upper_vals;
+  vector<char> answers;
+
+  void close_connection(server_connection *conn)
+  {
+    epoll_ctl(epoll_fd,EPOLL_CTL_DEL,conn->fd,NULL);
+    close(conn->fd);
+    delete conn;
+    return ;
+  }
+
+  //answers one request whose header and body are at var data
+  void answer_request(server_connection *conn,snarf_request_header &header,const unsigned char *body)
+  {
+    answers.resize(0);
+    if(header.op==SNARF_OP_RELOAD)
+    {
+      request_reload();
+      snarf_append_response(conn->out,SNARF_STATUS_OK,header.request_id,answers);
+      return ;
+    }
+
+    string name((const char*)body,header.name_bytes);
+    auto itr=filters_by_name.find(name);
+    if(itr==filters_by_name.end())
+    {
+      snarf_append_response(conn->out,SNARF_STATUS_UNKNOWN_FILTER,header.request_id,answers);
+      return ;
+    }
+
+    //the filter stays alive until the request is answered, even if a reload replaces it meanwhile
+    shared_ptr<served_snarf> filter=atomic_load(&itr->second->current);
+
+    const unsigned char *probes=body+header.name_bytes;
+    lower_vals.resize(header.num_probes);
+    upper_vals.resize(header.num_probes);
+    for(uint32_t i=0;i<header.num_probes;i++)
+    {
+      if(header.op==SNARF_OP_RANGE)
+      {
+        memcpy(&lower_vals[i],probes+16*i,sizeof(uint64_t));
+        memcpy(&upper_vals[i],probes+16*i+8,sizeof(uint64_t));
+      }
+      else
+      {
+        memcpy(&lower_vals[i],probes+8*i,sizeof(uint64_t));
+        upper_vals[i]=lower_vals[i];
+      }
+    }
+    batch_query.init(&filter->snarf_instance,opt->batch);
+    batch_query.range_query(lower_vals,upper_vals,answers);
+    snarf_append_response(conn->out,SNARF_STATUS_OK,header.request_id,answers);
+    return ;
+  }
+
+  //bytes of the largest request accepted, the input buffer is not filled past it
+  uint64_t max_request_bytes()
+  {
+    return sizeof(snarf_request_header)+UINT16_MAX+opt->max_probes*snarf_probe_bytes(SNARF_OP_RANGE);
+  }
+
+  uint64_t pending_output(server_connection *conn)
+  {
+    return conn->out.size()-conn->out_offset;
+  }
+
+  //true if the input buffer holds a whole request
+  bool has_request(server_connection *conn)
+  {
+    if(conn->in.size()-conn->in_offset<sizeof(snarf_request_header))
+    {
+      return false;
+    }
+    snarf_request_header header;
+    memcpy(&header,conn->in.data()+conn->in_offset,sizeof(header));
+    return conn->in.size()-conn->in_offset>=sizeof(header)+snarf_request_body_bytes(header);
+  }
+
+  //answers the complete requests in the input buffer until max_pending bytes of responses wait to be sent,
+  //returns false on a protocol error
+  bool answer_requests(server_connection *conn)
+  {
+    while(conn->in.size()-conn->in_offset>=sizeof(snarf_request_header) && pending_output(conn)<opt->max_pending)
+    {
+      snarf_request_header header;
+      memcpy(&header,conn->in.data()+conn->in_offset,sizeof(header));
+      if(header.magic!=snarf_request_magic || header.num_probes>opt->max_probes || (header.op!=SNARF_OP_RELOAD && snarf_probe_bytes(header.op)==0))
+      {
+        return false;
+      }
+      uint64_t body_bytes=snarf_request_body_bytes(header);
+      if(conn->in.size()-conn->in_offset<sizeof(header)+body_bytes)
+      {
+        break;
+      }
+      answer_request(conn,header,conn->in.data()+conn->in_offset+sizeof(header));
+      conn->in_offset+=sizeof(header)+body_bytes;
+    }
+
+    //the consumed bytes are dropped once they are half of the buffer
+    if(conn->in_offset==conn->in.size())
+    {
+      conn->in.resize(0);
+      conn->in_offset=0;
+    }
+    else if(conn->in_offset>conn->in.size()/2)
+    {
+      conn->in.erase(conn->in.begin(),conn->in.begin()+conn->in_offset);
+      conn->in_offset=0;
+    }
+    return true;
+  }
+
+  //sends as much of the output buffer as the socket takes, returns false if the connection failed
+  bool flush_output(server_connection *conn)
+  {
+    while(conn->out_offset<conn->out.size())
+    {
+      ssize_t sent=send(conn->fd,conn->out.data()+conn->out_offset,conn->out.size()-conn->out_offset,MSG_NOSIGNAL);
+      if(sent<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+      {
+        break;
+      }
+      if(sent<=0)
+      {
+        return false;
+      }
+      conn->out_offset+=sent;
+    }
+    if(conn->out_offset==conn->out.size())
+    {
+      conn->out.resize(0);
+      conn->out_offset=0;
+    }
+    else if(conn->out_offset>conn->out.size()/2)
+    {
+      conn->out.erase(conn->out.begin(),conn->out.begin()+conn->out_offset);
+      conn->out_offset=0;
+    }
+    return true;
+  }
+
+  //Back-pressure: a connection is read only while its unsent responses are under max_pending and its input buffer
+  //holds less than a maximum size request, so a client that sends without reading the responses stops being read
+  //instead of growing the buffers. It waits for the socket to drain while responses are unsent
+  void update_events(server_connection *conn)
+  {
+    bool want_read=pending_output(conn)<opt->max_pending && conn->in.size()-conn->in_offset<max_request_bytes();
+    uint32_t events=(want_read?EPOLLIN|EPOLLRDHUP:0)|(pending_output(conn)>0?EPOLLOUT:0);
+    if(events!=conn->events)
+    {
+      epoll_event event;
+      event.events=events;
+      event.data.ptr=conn;
+      epoll_ctl(epoll_fd,EPOLL_CTL_MOD,conn->fd,&event);
+      conn->events=events;
+    }
+    return ;
+  }
+
+  //reads what the socket holds, up to a maximum size request in the input buffer.
+  //Returns false if the peer closed the connection or it failed
+  bool read_input(server_connection *conn)
+  {
+    while(conn->in.size()-conn->in_offset<max_request_bytes())
+    {
+      uint64_t offset=conn->in.size();
+      conn->in.resize(offset+65536);
+      ssize_t received=recv(conn->fd,conn->in.data()+offset,65536,0);
+      conn->in.resize(offset+max((ssize_t)0,received));
+      if(received<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+      {
+        return true;
+      }
+      if(received<=0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void run(int cpu)
+  {
+    if(cpu>=0)
+    {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpu,&cpu_set);
+      pthread_setaffinity_np(pthread_self(),sizeof(cpu_set),&cpu_set);
+    }
+
+    vector<epoll_event> events(256);
+    while(true)
+    {
+      int num_events=epoll_wait(epoll_fd,events.data(),events.size(),-1);
+      for(int i=0;i<num_events;i++)
+      {
+        server_connection *conn=(server_connection*)events[i].data.ptr;
+        bool ok=true;
+        if(events[i].events&(EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR))
+        {
+          //requests already received are answered even when the peer closed its side
+          ok=read_input(conn);
+        }
+        //requests held back by unsent responses are answered as the socket drains
+        bool answering=true;
+        while(answering)
+        {
+          bool answered=answer_requests(conn);
+          ok=answered && ok;
+          ok=flush_output(conn) && ok;
+          answering=ok && pending_output(conn)<opt->max_pending && has_request(conn);
+        }
+        if(!ok)
+        {
+          close_connection(conn);
+          continue;
+        }
+        update_events(conn);
+      }
+    }
+    return ;
+  }
+};
+
+//----------------------------------------
+//LISTENING
+//----------------------------------------
+
+//returns a listening socket, or -1
+int listen_on(int domain,sockaddr *addr,socklen_t addr_len)
+{
+  int fd=socket(domain,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+  if(fd<0)
+  {
+    return -1;
+  }
+  int one=1;
+  setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+  if(bind(fd,addr,addr_len)!=0 || listen(fd,1024)!=0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+//accepts connections on the listening sockets and gives them to the workers in turn
+void accept_loop(vector<int> &listen_fds,vector<server_worker> &workers)
+{
+  int epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+  for(int i=0;i<listen_fds.size();i++)
+  {
+    epoll_event event;
+    event.events=EPOLLIN;
+    event.data.fd=listen_fds[i];
+    epoll_ctl(epoll_fd,EPOLL_CTL_ADD,listen_fds[i],&event);
+  }
+
+  uint64_t next_worker=0;
+  vector<epoll_event> events(16);
+  while(true)
+  {
+    int num_events=epoll_wait(epoll_fd,events.data(),events.size(),-1);
+    for(int i=0;i<num_events;i++)
+    {
+      while(true)
+      {
+        int fd=accept4(events[i].data.fd,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if(fd<0)
+        {
+          break;
+        }
+        //requests are small, they should not wait for the acknowledgement of the previous response
+        int one=1;
+        setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+        //the worker owns the connection from here on
+        server_connection *conn=new server_connection();
+        conn->fd=fd;
+        conn->events=EPOLLIN|EPOLLRDHUP;
+        epoll_event event;
+        event.events=conn->events;
+        event.data.ptr=conn;
+        epoll_ctl(workers[next_worker%workers.size()].epoll_fd,EPOLL_CTL_ADD,fd,&event);
+        next_worker++;
+      }
+    }
+  }
+  return ;
+}
+
+int main(int argc,char **argv)
+{
+  server_options opt;
+  if(!parse_options(argc,argv,opt) || (opt.tcp_address=="" && opt.unix_path==""))
+  {
+    print_usage();
+    return 1;
+  }
+
+  //----------------------------------------
+  //FILTERS
+  //----------------------------------------
+
+  if(opt.filter_dir!="")
+  {
+    DIR *dir=opendir(opt.filter_dir.c_str());
+    if(dir==NULL)
+    {
+      cerr<<"cannot open "<<opt.filter_dir<<endl;
+      return 1;
+    }
+    while(dirent *entry=readdir(dir))
+    {
+      string file=entry->d_name;
+      if(file.size()>5 && file.compare(file.size()-5,5,".base")==0)
+      {
+        opt.filters.push_back(make_pair(file.substr(0,file.size()-5),opt.filter_dir+"/"+file.substr(0,file.size()-5)));
+      }
+    }
+    closedir(dir);
+  }
+
+  for(int i=0;i<opt.filters.size();i++)
+  {
+    served_filter *filter=new served_filter();
+    filter->name=opt.filters[i].first;
+    filter->path=opt.filters[i].second;
+    filter->stamp=read_stamp(filter->path);
+    filter->current=load_filter(filter->path);
+    if(filter->current==NULL)
+    {
+      cerr<<"cannot load "<<filter->path<<endl;
+      return 1;
+    }
+    filters_by_name[filter->name]=filter;
+    cerr<<"serving "<<filter->name<<" ("<<filter->current->snarf_instance.num_stored_keys<<" keys)"<<endl;
+  }
+
+  //----------------------------------------
+  //SOCKETS AND THREADS
+  //----------------------------------------
+
+  vector<int> listen_fds;
+  if(opt.tcp_address!="")
+  {
+    sockaddr_in addr;
+    int fd=snarf_parse_tcp_address(opt.tcp_address,addr)?listen_on(AF_INET,(sockaddr*)&addr,sizeof(addr)):-1;
+    if(fd<0)
+    {
+      cerr<<"cannot listen on "<<opt.tcp_address<<endl;
+      return 1;
+    }
+    listen_fds.push_back(fd);
+  }
+  if(opt.unix_path!="")
+  {
+    sockaddr_un addr;
+    unlink(opt.unix_path.c_str());
+    int fd=snarf_parse_unix_address(opt.unix_path,addr)?listen_on(AF_UNIX,(sockaddr*)&addr,sizeof(addr)):-1;
+    if(fd<0)
+    {
+      cerr<<"cannot listen on "<<opt.unix_path<<endl;
+      return 1;
+    }
+    listen_fds.push_back(fd);
+  }
+  signal(SIGPIPE,SIG_IGN);
+
+  vector<server_worker> workers(opt.num_workers);
+  vector<thread> threads;
+  for(int i=0;i<workers.size();i++)
+  {
+    workers[i].epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+    workers[i].opt=&opt;
+  }
+  for(int i=0;i<workers.size();i++)
+  {
+    int cpu=opt.pin_workers?i%max(1,(int)thread::hardware_concurrency()):-1;
+    threads.push_back(thread([&workers,i,cpu](){ workers[i].run(cpu); }));
+  }
+  thread reloader(reload_loop,opt.reload_ms);
+  cerr<<"listening with "<<workers.size()<<" workers"<<endl;
+
+  accept_loop(listen_fds,workers);
+  return 0;
+}